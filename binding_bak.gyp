@@ -25,5 +25,28 @@
     'defines': [ 'NAPI_DISABLE_CPP_EXCEPTIONS' ],
     "sources": ["cuda.cc"],
     'cflags_cc': [ '-frtti','-fexceptions', '-std=gnu++0x' ]
+  },{
+    "target_name": "nvrtc_precompile_win64",
+    "type": "executable",
+    'include_dirs': [
+      "C:\\Program Files\\NVIDIA GPU Computing Toolkit\\CUDA\\v10.2\\include"
+    ],
+    'libraries': [
+      "C:\\Program Files\\NVIDIA GPU Computing Toolkit\\CUDA\\v10.2\\lib\\x64\\*.lib"
+    ],
+    "sources": ["nvrtc_precompile.cc"]
+  },{
+    "target_name": "nvrtc_precompile_linux_x86_64",
+    "type": "executable",
+    'include_dirs': [
+      "/usr/local/cuda-10.2/targets/x86_64-linux/include"
+    ],
+    'libraries': [
+      "/usr/local/cuda-10.2/targets/x86_64-linux/lib/*.so",
+      "/usr/local/cuda-10.2/targets/x86_64-linux/lib/stubs/*.so",
+      "-lpthread"
+    ],
+    "sources": ["nvrtc_precompile.cc"],
+    'cflags_cc': [ '-frtti','-fexceptions', '-std=gnu++0x' ]
   }]
 }
\ No newline at end of file
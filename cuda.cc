@@ -1,19 +1,166 @@
 #include <napi.h>
+#include <condition_variable>
+#include <unordered_set>
 #include "jitify.hpp"
 #include "cuda_runtime.h"
+#include "cuda_pool.hpp"
+#include "cuda_compile_pool.hpp"
+#include "cuda_bundle.hpp"
+#include "cuda_batch.hpp"
 
 // using namespace Napi;
 
-/**ǰļӦ */
-Napi::Env * lastFileEnv;
-/**ǰļӦĻص */
-Napi::Function lastFileCallback;
+//ÿjs(̺߳ÿworker_threads)Եݣڻinstance data
+//Դ滺ء̳߳غcudaǽ̹ģ
+struct AddonData {
+  /**ͬʱļȡص */
+  Napi::FunctionReference fileCallback;
+
+  //ʱûб򿪵ĹԴ
+  ~AddonData();
+};
+
+/**ǰ߳ͬjs */
+thread_local Napi::Env * syncFileEnv = NULL;
+
+//첽ʱļȡ̰ͨ߳ȫѶȡתִ߳
+class AsyncFileResolver {
+  //һļȡ
+  struct Request {
+    std::string filename;
+    std::string source;
+    bool found = false;
+    bool done = false;
+    std::mutex mutex;
+    std::condition_variable cv;
+  };
+  Napi::ThreadSafeFunction tsfn;
+  bool enabled;
+
+public:
+  AsyncFileResolver(Napi::Env env,Napi::Value callback):enabled(callback.IsFunction()){
+    if(enabled){
+      tsfn = Napi::ThreadSafeFunction::New(env,callback.As<Napi::Function>(),"nvrtcFileCallback",0,1);
+    }
+  }
+
+  //ڹ߳еãȴ̵߳Ļص
+  std::istream* resolve(std::string filename, std::iostream& tmp_stream){
+    if(!enabled) {return 0;}
+    Request request;
+    request.filename = filename;
+    napi_status status = tsfn.BlockingCall(&request,[](Napi::Env env,Napi::Function callback,Request * request){
+      auto value = callback.Call({Napi::String::New(env,request->filename)});
+      std::lock_guard<std::mutex> lock(request->mutex);
+      if(!value.IsEmpty() && value.IsString()){
+        request->found = true;
+        request->source = value.As<Napi::String>().Utf8Value();
+      }
+      request->done = true;
+      request->cv.notify_one();
+    });
+    if(status != napi_ok) {return 0;}
+    std::unique_lock<std::mutex> lock(request.mutex);
+    request.cv.wait(lock,[&request]{return request.done;});
+    if(!request.found) {return 0;}
+    tmp_stream << request.source;
+    return &tmp_stream;
+  }
+
+  //ͷ̰߳ȫ
+  void release(){
+    if(enabled){
+      tsfn.Release();
+      enabled = false;
+    }
+  }
+};
+
+/**ǰ߳ʹõ첽ļȡ */
+thread_local AsyncFileResolver * asyncFileResolver = NULL;
+
+//ͷļעjsһдͷļƺԴ룬ʱֱԭвңҪÿ붼صjs
+//ԴֻһݣøעĳãshareRegistrySources
+class HeaderRegistry {
+  std::unordered_map<std::string,std::shared_ptr<const std::string> > headers;
+  size_t bytes;
+  //첽ʱڹ߳в
+  mutable std::mutex mutex;
+
+public:
+  HeaderRegistry():bytes(0){}
+
+  void set(const std::string & name,std::string source){
+    //ԤȰjitifyԴķʽ#pragma onceȣغԴעеܹͬ
+    //ٴμʱ仯
+    std::map<std::string,std::string> loaded;
+    jitify::detail::load_source(name + "\n" + source,loaded);
+    source = std::move(loaded[name]);
+    std::lock_guard<std::mutex> lock(mutex);
+    auto & header = headers[name];
+    if(header) {bytes -= header->size();}
+    bytes += source.size();
+    header = std::make_shared<const std::string>(std::move(source));
+  }
+
+  bool remove(const std::string & name){
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = headers.find(name);
+    if(it == headers.end()) {return false;}
+    bytes -= it->second->size();
+    headers.erase(it);
+    return true;
+  }
+
+  //ͷļnameԴʱĿ¼
+  std::shared_ptr<const std::string> find(std::string name) const {
+    while(name.compare(0,2,"./") == 0) {name = name.substr(2);}
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = headers.find(name);
+    if(it == headers.end()) {return nullptr;}
+    return it->second;
+  }
+
+  size_t count() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return headers.size();
+  }
+
+  size_t size() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return bytes;
+  }
+};
+
+/**ǰ̴߳ʱʹõͷļע */
+thread_local const HeaderRegistry * headerRegistry = NULL;
+
+//עͷļΪעԴ룬ÿиһ
+void shareRegistrySources(jitify::experimental::Program * program,const HeaderRegistry * registry){
+  if(registry == NULL) {return;}
+  program->share_sources([registry](const std::string & name){
+    return registry->find(name);
+  });
+}
+
 //ļȡص
 std::istream* file_callback(std::string filename, std::iostream& tmp_stream) {
+  //ȴͷļעв
+  if(headerRegistry != NULL){
+    std::shared_ptr<const std::string> source = headerRegistry->find(filename);
+    if(source){
+      tmp_stream << *source;
+      return &tmp_stream;
+    }
+  }
+  //첽ʱ̶ͨ߳ȡ
+  if(asyncFileResolver != NULL) {return asyncFileResolver->resolve(filename,tmp_stream);}
   //ûлص
-  if(lastFileEnv == NULL) {return 0;}
+  if(syncFileEnv == NULL) {return 0;}
+  AddonData * data = syncFileEnv->GetInstanceData<AddonData>();
+  if(data->fileCallback.IsEmpty()) {return 0;}
   //ûص
-  auto value = lastFileCallback.Call(lastFileEnv->Global(),{Napi::String::New(*lastFileEnv,filename)});
+  auto value = data->fileCallback.Value().Call(syncFileEnv->Global(),{Napi::String::New(*syncFileEnv,filename)});
   //ַ
   if(!value.IsString()) {return 0;}
   //д
@@ -29,6 +176,66 @@ void NodeCudaError(Napi::Env env,cudaError_t error){
   Napi::TypeError::New(env,err).ThrowAsJavaScriptException();
 }
 
+//ԭװΪExternaljsjs˶󱻻ʱͷԭ󣬲V8ռõڴ
+template <class T>
+struct NativeHandle {
+  T * object;
+  //V8ⲿڴֽ
+  int64_t bytes;
+};
+
+//ͷžӦԭ֮Ļղظͷ
+template <class T>
+void releaseNativeHandle(Napi::Env env,NativeHandle<T> * handle){
+  delete handle->object;
+  handle->object = NULL;
+  if(handle->bytes != 0){
+    Napi::MemoryManagement::AdjustExternalMemory(env,-handle->bytes);
+    handle->bytes = 0;
+  }
+}
+
+//ExternalʱĴ
+template <class T>
+void freeNativeHandle(Napi::Env env,NativeHandle<T> * handle){
+  releaseNativeHandle(env,handle);
+  delete handle;
+}
+
+//װԭbytesΪռõԴڴֽ
+template <class T>
+Napi::Value wrapHandle(Napi::Env env,T * object,int64_t bytes){
+  NativeHandle<T> * handle = new NativeHandle<T>();
+  handle->object = object;
+  handle->bytes = bytes;
+  if(bytes != 0){
+    Napi::MemoryManagement::AdjustExternalMemory(env,bytes);
+  }
+  return Napi::External<NativeHandle<T> >::New(env,handle,freeNativeHandle<T>);
+}
+
+template <class T>
+NativeHandle<T> * getNativeHandle(const Napi::Value & value){
+  return value.As<Napi::External<NativeHandle<T> > >().Data();
+}
+
+//ȡӦԭ
+template <class T>
+T * getHandle(const Napi::Value & value){
+  return getNativeHandle<T>(value)->object;
+}
+
+//Դռõڴ
+int64_t programBytes(jitify::experimental::Program * program){
+  //ͷļעֻԼԴ
+  return sizeof(jitify::experimental::Program) + (int64_t)program->source_bytes();
+}
+
+//ʵռõڴ棬ģԴPTXСӽ
+int64_t instanceBytes(jitify::experimental::KernelInstantiation * instance){
+  return sizeof(jitify::experimental::KernelInstantiation) + 2 * (int64_t)instance->ptx().size();
+}
+
 //======ȡ豸======
 Napi::Value getDeviceProperties(const Napi::CallbackInfo& args){
   //ȡenv
@@ -118,6 +325,105 @@ void deviceSetLimit(const Napi::CallbackInfo& args){
   NodeCudaError(env,cudaDeviceSetLimit((cudaLimit)type,value));
 }
 
+//ȡĴ̻(2ΪĿ¼3Ϊֽ)
+std::shared_ptr<jitify::experimental::KernelDiskCache> getProgramDiskCache(const Napi::CallbackInfo& args){
+  if(args.Length() <= 2 || !args[2].IsString()) {return nullptr;}
+  size_t maxBytes = 0;
+  if(args.Length() > 3 && args[3].IsNumber()){
+    maxBytes = (size_t)args[3].As<Napi::Number>().Int64Value();
+  }
+  return std::make_shared<jitify::experimental::KernelDiskCache>(args[2].As<Napi::String>().Utf8Value(),maxBytes);
+}
+
+//======ͷļע======
+Napi::Value createHeaderRegistry(const Napi::CallbackInfo& args){
+  //ȡenv
+  Napi::Env env = args.Env();
+
+  return wrapHandle(env,new HeaderRegistry(),sizeof(HeaderRegistry));
+}
+
+//======дͷļ======
+//2Ϊ{:Դ}
+void headerRegistrySet(const Napi::CallbackInfo& args){
+  //ȡenv
+  Napi::Env env = args.Env();
+
+  NativeHandle<HeaderRegistry> * handle = getNativeHandle<HeaderRegistry>(args[0]);
+  size_t before = handle->object->size();
+  Napi::Object headers = args[1].As<Napi::Object>();
+  Napi::Array names = headers.GetPropertyNames();
+  for(uint32_t i = 0;i < names.Length();i++){
+    std::string name = names.Get(i).As<Napi::String>().Utf8Value();
+    handle->object->set(name,headers.Get(name).As<Napi::String>().Utf8Value());
+  }
+  //±V8ڴ
+  int64_t delta = (int64_t)handle->object->size() - (int64_t)before;
+  handle->bytes += delta;
+  Napi::MemoryManagement::AdjustExternalMemory(env,delta);
+}
+
+//======дͷļ======
+//2ΪArrayBufferʽΪ[ֽu32][][Դֽu32][Դ]ΪС
+void headerRegistrySetPacked(const Napi::CallbackInfo& args){
+  //ȡenv
+  Napi::Env env = args.Env();
+
+  NativeHandle<HeaderRegistry> * handle = getNativeHandle<HeaderRegistry>(args[0]);
+  Napi::ArrayBuffer buffer = args[1].As<Napi::ArrayBuffer>();
+  const uint8_t * data = (const uint8_t *)buffer.Data();
+  size_t length = buffer.ByteLength();
+  size_t before = handle->object->size();
+  size_t pos = 0;
+  //ȡһȵַ
+  auto read = [&](std::string & out){
+    if(pos + 4 > length) {return false;}
+    uint32_t size = data[pos] | (data[pos + 1] << 8) | (data[pos + 2] << 16) | ((uint32_t)data[pos + 3] << 24);
+    pos += 4;
+    if(pos + size > length) {return false;}
+    out.assign((const char *)data + pos,size);
+    pos += size;
+    return true;
+  };
+  while(pos < length){
+    std::string name,source;
+    if(!read(name) || !read(source)){
+      Napi::TypeError::New(env,"ͷļʽ").ThrowAsJavaScriptException();
+      break;
+    }
+    handle->object->set(name,std::move(source));
+  }
+  int64_t delta = (int64_t)handle->object->size() - (int64_t)before;
+  handle->bytes += delta;
+  Napi::MemoryManagement::AdjustExternalMemory(env,delta);
+}
+
+//======ɾͷļ======
+Napi::Value headerRegistryRemove(const Napi::CallbackInfo& args){
+  //ȡenv
+  Napi::Env env = args.Env();
+
+  NativeHandle<HeaderRegistry> * handle = getNativeHandle<HeaderRegistry>(args[0]);
+  size_t before = handle->object->size();
+  bool removed = handle->object->remove(args[1].As<Napi::String>().Utf8Value());
+  int64_t delta = (int64_t)handle->object->size() - (int64_t)before;
+  handle->bytes += delta;
+  Napi::MemoryManagement::AdjustExternalMemory(env,delta);
+  return Napi::Boolean::New(env,removed);
+}
+
+//======ȡͷļעϢ======
+Napi::Value getHeaderRegistryInfo(const Napi::CallbackInfo& args){
+  //ȡenv
+  Napi::Env env = args.Env();
+
+  HeaderRegistry * registry = getHandle<HeaderRegistry>(args[0]);
+  Napi::Object re = Napi::Object::New(env);
+  re.Set("count",Napi::Number::New(env,(double)registry->count()));
+  re.Set("bytes",Napi::Number::New(env,(double)registry->size()));
+  return re;
+}
+
 //============
 Napi::Value createProgram(const Napi::CallbackInfo& args){
   //ȡenv
@@ -126,31 +432,57 @@ Napi::Value createProgram(const Napi::CallbackInfo& args){
   //Ĵ
   auto str = args[0].As<Napi::String>().Utf8Value();
 
-  //ص
+  //صڵǰjs
+  AddonData * data = env.GetInstanceData<AddonData>();
   if(args.Length() > 1 && args[1].IsFunction()){
-    lastFileEnv = &env;
-    lastFileCallback = args[1].As<Napi::Function>();
+    data->fileCallback = Napi::Persistent(args[1].As<Napi::Function>());
   }else{
-    lastFileEnv = NULL;
+    data->fileCallback.Reset();
   }
+  syncFileEnv = &env;
   
+  //ͷļע
+  headerRegistry = args.Length() > 4 && args[4].IsExternal() ? getHandle<HeaderRegistry>(args[4]) : NULL;
+
   jitify::experimental::Program *program = NULL;
   try{
     //cuda
     std::vector<std::string> opts;
     program = new jitify::experimental::Program(str, {}, opts,file_callback);
+    shareRegistrySources(program,headerRegistry);
   }catch(std::runtime_error msg){
+    headerRegistry = NULL;
+    syncFileEnv = NULL;
+    data->fileCallback.Reset();
     Napi::TypeError::New(env,msg.what()).ThrowAsJavaScriptException();
+    return env.Undefined();
   }
+  headerRegistry = NULL;
+  syncFileEnv = NULL;
+  data->fileCallback.Reset();
+
+  //ô̻
+  program->set_disk_cache(getProgramDiskCache(args));
 
   //ؾ
-  return Napi::Number::New(env,(size_t)program);
+  return wrapHandle(env,program,programBytes(program));
 }
 
 
 
 
 
+//======ȡNVRTC======
+Napi::Value getNvrtcCompileCount(const Napi::CallbackInfo& args){
+  //ȡenv
+  Napi::Env env = args.Env();
+
+  //ؽڵnvrtcCompileProgramܴ
+  return Napi::Number::New(env,(size_t)jitify::detail::nvrtc_compile_count());
+}
+
+
+
 //============
 Napi::Value createKernel(const Napi::CallbackInfo& args){
   //ȡenv
@@ -167,13 +499,14 @@ Napi::Value createKernel(const Napi::CallbackInfo& args){
   jitify::experimental::Program * program = NULL;
   jitify::experimental::Kernel * kernel = NULL;
   try{
-    program = (jitify::experimental::Program *)args[0].As<Napi::Number>().Int64Value();
+    program = getHandle<jitify::experimental::Program>(args[0]);
     kernel = new jitify::experimental::Kernel(program,str,std::vector<std::string>({}));
   }catch(std::runtime_error msg){
     Napi::TypeError::New(env,msg.what()).ThrowAsJavaScriptException();
+    return env.Undefined();
   }
 
-  return Napi::Number::New(env,(size_t)kernel);
+  return wrapHandle(env,kernel,sizeof(jitify::experimental::Kernel));
 }
 
 
@@ -194,13 +527,414 @@ Napi::Value createInstance(const Napi::CallbackInfo& args){
   jitify::experimental::Kernel * kernel = NULL;
   jitify::experimental::KernelInstantiation * instance = NULL;
   try{
-    kernel = (jitify::experimental::Kernel *)args[0].As<Napi::Number>().Int64Value();
+    kernel = getHandle<jitify::experimental::Kernel>(args[0]);
     instance = new jitify::experimental::KernelInstantiation(*kernel,instance_args);
   }catch(std::runtime_error msg){
     Napi::TypeError::New(env,msg.what()).ThrowAsJavaScriptException();
+    return env.Undefined();
+  }
+
+  return wrapHandle(env,instance,instanceBytes(instance));
+}
+
+
+
+//======ʵ======
+//Ϊ[{name,templates}]бʵһNVRTCɲͬһģ
+Napi::Value instantiateMany(const Napi::CallbackInfo& args){
+  //ȡenv
+  Napi::Env env = args.Env();
+
+  //ȡҪʵĺƺģ
+  Napi::Array list = args[1].As<Napi::Array>();
+  std::vector<std::pair<std::string,std::vector<std::string> > > kernels;
+  for(uint32_t i = 0;i < list.Length();i++){
+    Napi::Object item = list.Get(i).As<Napi::Object>();
+    std::vector<std::string> templates;
+    if(item.Has("templates") && item.Get("templates").IsArray()){
+      Napi::Array temps = item.Get("templates").As<Napi::Array>();
+      for(uint32_t j = 0;j < temps.Length();j++){
+        templates.push_back(temps.Get(j).As<Napi::String>().Utf8Value());
+      }
+    }
+    kernels.push_back(std::make_pair(item.Get("name").As<Napi::String>().Utf8Value(),templates));
+  }
+
+  //һαʵ
+  std::vector<jitify::experimental::KernelInstantiation> instances;
+  try{
+    jitify::experimental::Program * program = getHandle<jitify::experimental::Program>(args[0]);
+    instances = program->instantiate_many(kernels);
+  }catch(std::runtime_error msg){
+    Napi::TypeError::New(env,msg.what()).ThrowAsJavaScriptException();
+    return env.Undefined();
+  }
+
+  //ʵ
+  Napi::Array re = Napi::Array::New(env,instances.size());
+  for(uint32_t i = 0;i < instances.size();i++){
+    jitify::experimental::KernelInstantiation * instance = new jitify::experimental::KernelInstantiation(std::move(instances[i]));
+    re.Set(i,wrapHandle(env,instance,instanceBytes(instance)));
+  }
+  return re;
+}
+
+//첽Ĺlibuvִ̳߳б벢ͨPromiseؾ
+class CompileWorker : public Napi::AsyncWorker {
+protected:
+  Napi::Promise::Deferred deferred;
+  /**ʱʹõ豸߳Ҫʹͬһ豸 */
+  int device;
+
+  //ڹִ߳еı
+  virtual void Compile() = 0;
+  //߳аѱװΪ
+  virtual Napi::Value Result() = 0;
+
+  void Execute() override {
+    cudaSetDevice(device);
+    //ʼǰ̵߳cuda
+    cudaFree(0);
+    try{
+      Compile();
+    }catch(std::exception & msg){
+      SetError(msg.what());
+    }
+  }
+
+  void OnOK() override {
+    deferred.Resolve(Result());
+  }
+
+  void OnError(const Napi::Error& e) override {
+    deferred.Reject(e.Value());
+  }
+
+public:
+  CompileWorker(Napi::Env env):Napi::AsyncWorker(env),deferred(Napi::Promise::Deferred::New(env)),device(0){
+    cudaGetDevice(&device);
+  }
+
+  Napi::Promise Promise(){
+    return deferred.Promise();
+  }
+};
+
+//첽Ĺ
+class CreateProgramWorker : public CompileWorker {
+  std::string code;
+  AsyncFileResolver resolver;
+  std::shared_ptr<jitify::experimental::KernelDiskCache> diskCache;
+  HeaderRegistry * registry;
+  //ڼ䱣ͷļע
+  Napi::Reference<Napi::Value> registryRef;
+  jitify::experimental::Program * program;
+
+  void Compile() override {
+    asyncFileResolver = &resolver;
+    headerRegistry = registry;
+    try{
+      std::vector<std::string> opts;
+      program = new jitify::experimental::Program(code, {}, opts,file_callback);
+      shareRegistrySources(program,registry);
+      program->set_disk_cache(diskCache);
+    }catch(...){
+      asyncFileResolver = NULL;
+      headerRegistry = NULL;
+      resolver.release();
+      throw;
+    }
+    asyncFileResolver = NULL;
+    headerRegistry = NULL;
+    resolver.release();
+  }
+
+  Napi::Value Result() override {
+    return wrapHandle(Env(),program,programBytes(program));
+  }
+
+public:
+  CreateProgramWorker(const Napi::CallbackInfo& args)
+    :CompileWorker(args.Env()),
+    code(args[0].As<Napi::String>().Utf8Value()),
+    resolver(args.Env(),args.Length() > 1 ? args[1] : args.Env().Undefined()),
+    diskCache(getProgramDiskCache(args)),
+    registry(NULL),
+    program(NULL){
+    if(args.Length() > 4 && args[4].IsExternal()){
+      registry = getHandle<HeaderRegistry>(args[4]);
+      registryRef = Napi::Persistent(args[4]);
+    }
+  }
+};
+
+//첽ʵĹ
+class CreateInstanceWorker : public CompileWorker {
+  jitify::experimental::Kernel * kernel;
+  //ڼ䱣ֺľ
+  Napi::Reference<Napi::Value> kernelRef;
+  std::vector<std::string> instance_args;
+  jitify::experimental::KernelInstantiation * instance;
+
+  void Compile() override {
+    instance = new jitify::experimental::KernelInstantiation(*kernel,instance_args);
+  }
+
+  Napi::Value Result() override {
+    return wrapHandle(Env(),instance,instanceBytes(instance));
+  }
+
+public:
+  CreateInstanceWorker(const Napi::CallbackInfo& args):CompileWorker(args.Env()),instance(NULL){
+    kernel = getHandle<jitify::experimental::Kernel>(args[0]);
+    kernelRef = Napi::Persistent(args[0]);
+    for(int i = 1;i < args.Length();i++){
+      instance_args.push_back(args[i].As<Napi::String>().Utf8Value());
+    }
+  }
+};
+
+//======첽======
+Napi::Value createProgramAsync(const Napi::CallbackInfo& args){
+  CreateProgramWorker * worker = new CreateProgramWorker(args);
+  Napi::Promise promise = worker->Promise();
+  worker->Queue();
+  return promise;
+}
+
+//======첽ʵ======
+Napi::Value createInstanceAsync(const Napi::CallbackInfo& args){
+  CreateInstanceWorker * worker = new CreateInstanceWorker(args);
+  Napi::Promise promise = worker->Promise();
+  worker->Queue();
+  return promise;
+}
+
+//̳߳أһʱworker
+CompilePool * getCompilePool(){
+  static CompilePool * compilePool = new CompilePool();
+  return compilePool;
+}
+
+//ûнȻصʱʹõĿպ
+void noProgress(const Napi::CallbackInfo& args){}
+
+class CompileBatch;
+//ڱ񣬼Ϊ豸ʵݼֵΪеȴͬһ
+std::mutex inflightCompileMutex;
+std::unordered_map<std::string,std::vector<std::pair<CompileBatch *,size_t> > > inflightCompiles;
+
+//һ񣬰ѡģȥأбֱӵȴǴαĽ
+//ÿʱ֪ͨȣȫɺ󷵻ؽ
+class CompileBatch {
+  //ȥغһ
+  struct Job {
+    jitify::experimental::Kernel * kernel;
+    std::vector<std::string> templates;
+    int priority;
+    jitify::experimental::KernelInstantiation * instance;
+    std::string error;
+    //ʱ()
+    double time;
+    //豸ʵݼ
+    std::string key;
+  };
+  std::vector<Job> jobs;
+  //ÿӦ
+  std::vector<size_t> indices;
+  Napi::Promise::Deferred deferred;
+  //Ȼص֪̰ͨͨ߳ȫת߳
+  Napi::ThreadSafeFunction tsfn;
+  //ڼ䱣ֺľ
+  Napi::Reference<Napi::Value> listRef;
+  //Ѿ߳дɵ
+  size_t reported;
+  bool progress;
+  int device;
+
+  //ڱִ߳
+  void compile(size_t index){
+    Job & job = jobs[index];
+    auto time = std::chrono::steady_clock::now();
+    cudaSetDevice(device);
+    //ʼǰ̵߳cuda
+    cudaFree(0);
+    try{
+      job.instance = new jitify::experimental::KernelInstantiation(*job.kernel,job.templates);
+    }catch(std::exception & msg){
+      job.error = msg.what();
+    }
+    job.time = std::chrono::duration<double,std::milli>(std::chrono::steady_clock::now() - time).count();
+
+    //ѽȴͬһΣÿεõԼʵӱõģֱӼ
+    std::vector<std::pair<CompileBatch *,size_t> > waiters;
+    {
+      std::lock_guard<std::mutex> lock(inflightCompileMutex);
+      auto found = inflightCompiles.find(job.key);
+      if(found != inflightCompiles.end()){
+        waiters.swap(found->second);
+        inflightCompiles.erase(found);
+      }
+    }
+    std::string serialized;
+    for(auto & waiter : waiters){
+      Job & other = waiter.first->jobs[waiter.second];
+      other.time = job.time;
+      if(job.instance == NULL){
+        other.error = job.error;
+      }else{
+        try{
+          if(serialized.empty()) {serialized = job.instance->serialize();}
+          other.instance = jitify::experimental::KernelInstantiation::deserialize_ptr(serialized);
+        }catch(std::exception & msg){
+          other.error = msg.what();
+        }
+      }
+      waiter.first->notify(waiter.second);
+    }
+    notify(index);
+  }
+
+  //ɣת̴߳
+  void notify(size_t index){
+    tsfn.NonBlockingCall(new size_t(index),[this](Napi::Env env,Napi::Function callback,size_t * index){
+      finish(env,callback,*index);
+      delete index;
+    });
+  }
+
+  //߳дһɵ
+  void finish(Napi::Env env,Napi::Function callback,size_t index){
+    reported++;
+    Job & job = jobs[index];
+    if(progress){
+      Napi::Object info = Napi::Object::New(env);
+      info.Set("index",Napi::Number::New(env,(double)index));
+      info.Set("time",Napi::Number::New(env,job.time));
+      if(job.instance == NULL) {info.Set("error",Napi::String::New(env,job.error));}
+      callback.Call({Napi::Number::New(env,(double)reported),Napi::Number::New(env,(double)jobs.size()),info});
+    }
+    if(reported < jobs.size()) {return;}
+
+    //ȫɣÿĽ
+    std::vector<Napi::Value> handles;
+    for(size_t i = 0;i < jobs.size();i++){
+      if(jobs[i].instance == NULL) {handles.push_back(env.Undefined());continue;}
+      handles.push_back(wrapHandle(env,jobs[i].instance,instanceBytes(jobs[i].instance)));
+    }
+    Napi::Array re = Napi::Array::New(env,indices.size());
+    for(size_t i = 0;i < indices.size();i++){
+      Job & job = jobs[indices[i]];
+      Napi::Object item = Napi::Object::New(env);
+      item.Set("instance",handles[indices[i]]);
+      item.Set("time",Napi::Number::New(env,job.time));
+      if(job.instance == NULL) {item.Set("error",Napi::String::New(env,job.error));}
+      re.Set((uint32_t)i,item);
+    }
+    deferred.Resolve(re);
+    tsfn.Release();
+    delete this;
+  }
+
+public:
+  CompileBatch(const Napi::CallbackInfo& args):deferred(Napi::Promise::Deferred::New(args.Env())),reported(0),progress(false),device(0){
+    Napi::Env env = args.Env();
+    cudaGetDevice(&device);
+    listRef = Napi::Persistent(args[0]);
+    //ͬһĶģֻһݼ
+    std::map<std::pair<jitify::experimental::Kernel *,std::string>,size_t> handles;
+    //ݼȥ
+    std::map<std::string,size_t> keys;
+    Napi::Array list = args[0].As<Napi::Array>();
+    for(uint32_t i = 0;i < list.Length();i++){
+      Napi::Object item = list.Get(i).As<Napi::Object>();
+      Job job = {getHandle<jitify::experimental::Kernel>(item.Get("kernel")),{},0,NULL,"",0,""};
+      std::string templates;
+      if(item.Has("templates") && item.Get("templates").IsArray()){
+        Napi::Array temps = item.Get("templates").As<Napi::Array>();
+        for(uint32_t j = 0;j < temps.Length();j++){
+          job.templates.push_back(temps.Get(j).As<Napi::String>().Utf8Value());
+          templates += job.templates.back() + "\n";
+        }
+      }
+      if(item.Has("priority") && item.Get("priority").IsNumber()){
+        job.priority = item.Get("priority").As<Napi::Number>().Int32Value();
+      }
+      auto found = handles.find(std::make_pair(job.kernel,templates));
+      if(found == handles.end()){
+        try{
+          job.key = std::to_string(device) + ":" + jitify::experimental::KernelInstantiation::cache_key(*job.kernel,job.templates);
+        }catch(std::exception & msg){
+          //޷ݼʱֻͬһĶȥ
+          job.key = std::to_string(device) + ":" + std::to_string((size_t)job.kernel) + ":" + templates;
+        }
+        auto same = keys.find(job.key);
+        found = handles.insert(std::make_pair(std::make_pair(job.kernel,templates),same != keys.end() ? same->second : jobs.size())).first;
+      }
+      if(found->second < jobs.size()){
+        //ظʹߵȼ
+        jobs[found->second].priority = std::max(jobs[found->second].priority,job.priority);
+        indices.push_back(found->second);
+        continue;
+      }
+      keys[job.key] = jobs.size();
+      indices.push_back(jobs.size());
+      jobs.push_back(job);
+    }
+    progress = args.Length() > 1 && args[1].IsFunction();
+    Napi::Value callback = progress ? args[1] : Napi::Function::New(env,noProgress);
+    tsfn = Napi::ThreadSafeFunction::New(env,callback.As<Napi::Function>(),"nvrtcCompileBatch",0,1);
+  }
+
+  //ύûʱֱ
+  Napi::Promise Start(Napi::Env env){
+    Napi::Promise promise = deferred.Promise();
+    if(jobs.empty()){
+      deferred.Resolve(Napi::Array::New(env));
+      tsfn.Release();
+      delete this;
+      return promise;
+    }
+    CompilePool * pool = getCompilePool();
+    for(size_t i = 0;i < jobs.size();i++){
+      //ڱͬʱȴǴεĽǼǺύ
+      bool owner = true;
+      {
+        std::lock_guard<std::mutex> lock(inflightCompileMutex);
+        auto found = inflightCompiles.find(jobs[i].key);
+        if(found != inflightCompiles.end()){
+          found->second.push_back(std::make_pair(this,i));
+          owner = false;
+        }else{
+          inflightCompiles[jobs[i].key];
+        }
+      }
+      if(owner) {pool->submit([this,i](){compile(i);},jobs[i].priority);}
+    }
+    return promise;
   }
+};
+
+//======бʵ======
+//1Ϊ[{kernel,templates,priority}]б2ΪȻص(done,total,{index,time,error})
+//PromiseΪÿ{instance,time,error}
+Napi::Value compileBatch(const Napi::CallbackInfo& args){
+  CompileBatch * batch = new CompileBatch(args);
+  return batch->Start(args.Env());
+}
+
+//======ñ߳======
+//Ϊ0ʱʹCPU
+void setCompileThreads(const Napi::CallbackInfo& args){
+  getCompilePool()->resize((size_t)args[0].As<Napi::Number>().Int64Value());
+}
 
-  return Napi::Number::New(env,(size_t)instance);
+//======ȡ߳======
+Napi::Value getCompileThreads(const Napi::CallbackInfo& args){
+  //ȡenv
+  Napi::Env env = args.Env();
+
+  return Napi::Number::New(env,(double)getCompilePool()->size());
 }
 
 //======ȡʵϢ======
@@ -209,7 +943,7 @@ Napi::Value getInstancePTX(const Napi::CallbackInfo& args){
   Napi::Env env = args.Env();
 
   //ҪȡϢʵ
-  jitify::experimental::KernelInstantiation * instance = (jitify::experimental::KernelInstantiation *)args[0].As<Napi::Number>().Int64Value();
+  jitify::experimental::KernelInstantiation * instance = getHandle<jitify::experimental::KernelInstantiation>(args[0]);
 
   //
   Napi::Object re = Napi::Object::New(env);
@@ -238,7 +972,7 @@ Napi::Value serializeInstance(const Napi::CallbackInfo& args){
   Napi::Env env = args.Env();
 
   //ҪȡϢʵ
-  jitify::experimental::KernelInstantiation * instance = (jitify::experimental::KernelInstantiation *)args[0].As<Napi::Number>().Int64Value();
+  jitify::experimental::KernelInstantiation * instance = getHandle<jitify::experimental::KernelInstantiation>(args[0]);
   
   //л
   std::string code = instance->serialize();
@@ -267,12 +1001,169 @@ Napi::Value deserializeInstance(const Napi::CallbackInfo& args){
     // instance->_cuda_kernel = std::make_unique<jitify::detail::CUDAKernel>(*object._cuda_kernel);
     // memcpy(instance,&object,sizeof(jitify::experimental::KernelInstantiation));
     jitify::experimental::KernelInstantiation * instance = jitify::experimental::KernelInstantiation::deserialize_ptr(code);
-    return Napi::Number::New(env,(size_t)instance);
+    return wrapHandle(env,instance,instanceBytes(instance));
+  }catch(std::runtime_error msg){
+    Napi::TypeError::New(env,msg.what()).ThrowAsJavaScriptException();
+  }
+
+  return env.Undefined();
+}
+
+
+//======򿪴ļ======
+//ͨmmap򿪣ֻȡʵloadBundleInstanceʱŻȡӦݲģ
+Napi::Value openBundle(const Napi::CallbackInfo& args){
+  //ȡenv
+  Napi::Env env = args.Env();
+
+  try{
+    bundle::Reader * reader = new bundle::Reader(args[0].As<Napi::String>().Utf8Value());
+    return wrapHandle(env,reader,sizeof(bundle::Reader));
+  }catch(std::runtime_error msg){
+    Napi::TypeError::New(env,msg.what()).ThrowAsJavaScriptException();
+  }
+  return env.Undefined();
+}
+
+//======رմļ======
+void closeBundle(const Napi::CallbackInfo& args){
+  //ȡenv
+  Napi::Env env = args.Env();
+
+  releaseNativeHandle(env,getNativeHandle<bundle::Reader>(args[0]));
+}
+
+//======ȡļеʵб======
+//[{name,templates,arch}]
+Napi::Value getBundleList(const Napi::CallbackInfo& args){
+  //ȡenv
+  Napi::Env env = args.Env();
+
+  bundle::Reader * reader = getHandle<bundle::Reader>(args[0]);
+  if(reader == NULL){
+    Napi::TypeError::New(env,"ļѹر").ThrowAsJavaScriptException();
+    return env.Undefined();
+  }
+  Napi::Array re = Napi::Array::New(env,reader->size());
+  for(uint32_t i = 0;i < reader->size();i++){
+    Napi::Object item = Napi::Object::New(env);
+    item.Set(Napi::String::New(env,"name"),Napi::String::New(env,reader->get(i,bundle::NAME).str()));
+    std::vector<std::string> templates = bundle::split(reader->get(i,bundle::TEMPLATES).str());
+    Napi::Array temps = Napi::Array::New(env,templates.size());
+    for(uint32_t j = 0;j < templates.size();j++){
+      temps.Set(j,Napi::String::New(env,templates[j]));
+    }
+    item.Set(Napi::String::New(env,"templates"),temps);
+    item.Set(Napi::String::New(env,"arch"),Napi::String::New(env,reader->get(i,bundle::ARCH).str()));
+    re.Set(i,item);
+  }
+  return re;
+}
+
+//======Ӵļʵ======
+//Ϊļƺģ飬ʹõǰ豸ܹcubinûʱPTX룬Ҳʵʱundefined
+//ʵֻбȵǰ豸µļܹʱ׳쳣
+Napi::Value loadBundleInstance(const Napi::CallbackInfo& args){
+  //ȡenv
+  Napi::Env env = args.Env();
+
+  bundle::Reader * reader = getHandle<bundle::Reader>(args[0]);
+  if(reader == NULL){
+    Napi::TypeError::New(env,"ļѹر").ThrowAsJavaScriptException();
+    return env.Undefined();
+  }
+  std::string name = args[1].As<Napi::String>().Utf8Value();
+  std::vector<std::string> templates;
+  if(args.Length() > 2 && args[2].IsArray()){
+    Napi::Array temps = args[2].As<Napi::Array>();
+    for(uint32_t i = 0;i < temps.Length();i++){
+      templates.push_back(temps.Get(i).As<Napi::String>().Utf8Value());
+    }
+  }
+
+  try{
+    std::string arch = jitify::detail::CUDAKernel::current_arch();
+    long index = reader->find(name,templates,arch);
+    if(index < 0 && reader->contains(name,templates)){
+      //ʵֻи¼ܹPTXҲ޷ڵǰ豸ϱ
+      Napi::TypeError::New(env,"ļеʵ" + name + "û" + arch + "").ThrowAsJavaScriptException();
+      return env.Undefined();
+    }
+    if(index < 0) {return env.Undefined();}
+    //ֻƵǰܹcubinͬһ汾нϵͼܹcubinҲڵǰ豸ϼ
+    std::string entryArch = reader->get(index,bundle::ARCH).str();
+    bool compatible = bundle::Reader::cubin_compatible(entryArch,arch);
+    bundle::Entry entry = reader->entry(index,compatible ? entryArch : arch);
+    std::map<std::string,std::string> cubins;
+    if(!entry.cubin.empty()) {cubins[entry.arch] = entry.cubin;}
+    jitify::experimental::KernelInstantiation * instance = jitify::experimental::KernelInstantiation::create_ptr(
+      entry.func_name,entry.ptx,entry.link_files,entry.link_paths,cubins);
+    return wrapHandle(env,instance,instanceBytes(instance));
   }catch(std::runtime_error msg){
     Napi::TypeError::New(env,msg.what()).ThrowAsJavaScriptException();
   }
+  return env.Undefined();
+}
+
+//======дļ======
+//Ϊļ·[{name,templates,instance}]бÿʵӹÿܹcubinдһ
+void writeBundle(const Napi::CallbackInfo& args){
+  //ȡenv
+  Napi::Env env = args.Env();
+
+  bundle::Writer writer;
+  Napi::Array list = args[1].As<Napi::Array>();
+  for(uint32_t i = 0;i < list.Length();i++){
+    //ÿһѾͷŵʵûкƵʵд
+    std::string prefix = "" + std::to_string(i) + "";
+    Napi::Value value = list.Get(i);
+    if(!value.IsObject()){
+      Napi::TypeError::New(env,prefix + "Ƕ").ThrowAsJavaScriptException();
+      return;
+    }
+    Napi::Object item = value.As<Napi::Object>();
+    Napi::Value handle = item.Get("instance");
+    jitify::experimental::KernelInstantiation * instance = handle.IsExternal() ? getHandle<jitify::experimental::KernelInstantiation>(handle) : NULL;
+    if(instance == NULL){
+      Napi::TypeError::New(env,prefix + "ʵЧѾͷ").ThrowAsJavaScriptException();
+      return;
+    }
+    if(!item.Get("name").IsString()){
+      Napi::TypeError::New(env,prefix + "ûк").ThrowAsJavaScriptException();
+      return;
+    }
+    bundle::Entry entry;
+    entry.name = item.Get("name").As<Napi::String>().Utf8Value();
+    if(item.Has("templates") && item.Get("templates").IsArray()){
+      Napi::Array temps = item.Get("templates").As<Napi::Array>();
+      for(uint32_t j = 0;j < temps.Length();j++){
+        if(!temps.Get(j).IsString()){
+          Napi::TypeError::New(env,prefix + "ģַ").ThrowAsJavaScriptException();
+          return;
+        }
+        entry.templates.push_back(temps.Get(j).As<Napi::String>().Utf8Value());
+      }
+    }
+    entry.func_name = instance->mangled_name();
+    entry.ptx = instance->ptx();
+    entry.link_files = instance->link_files();
+    entry.link_paths = instance->link_paths();
+    const std::map<std::string,std::string> & cubins = instance->cubins();
+    if(cubins.empty()){
+      writer.add(entry);
+    }
+    for(auto & cubin : cubins){
+      entry.arch = cubin.first;
+      entry.cubin = cubin.second;
+      writer.add(entry);
+    }
+  }
 
-  return Napi::Number::New(env,0);
+  try{
+    writer.write(args[0].As<Napi::String>().Utf8Value());
+  }catch(std::runtime_error msg){
+    Napi::TypeError::New(env,msg.what()).ThrowAsJavaScriptException();
+  }
 }
 
 
@@ -292,12 +1183,47 @@ Napi::Value createLauncher(const Napi::CallbackInfo& args){
             bg.Get(2u).As<Napi::Number>().Uint32Value());
 
   //ʵ
-  jitify::experimental::KernelInstantiation * instance = (jitify::experimental::KernelInstantiation *)args[0].As<Napi::Number>().Int64Value();
-  jitify::experimental::KernelLauncher object = instance->configure(grid,block);
-  jitify::experimental::KernelLauncher * launcher = (jitify::experimental::KernelLauncher *)malloc(sizeof(jitify::experimental::KernelLauncher));
-  memcpy(launcher,&object,sizeof(jitify::experimental::KernelLauncher));
+  jitify::experimental::KernelInstantiation * instance = getHandle<jitify::experimental::KernelInstantiation>(args[0]);
+  cudaStream_t stream = args.Length() > 3 && args[3].IsNumber() ? (cudaStream_t)args[3].As<Napi::Number>().Int64Value() : 0;
+  unsigned int smem = args.Length() > 4 && args[4].IsNumber() ? args[4].As<Napi::Number>().Uint32Value() : 0;
+  jitify::experimental::KernelLauncher * launcher = new jitify::experimental::KernelLauncher(instance->configure(grid,block,smem,stream));
+
+  return wrapHandle(env,launcher,sizeof(jitify::experimental::KernelLauncher));
+}
+
+//ռʱÿ߳ʹõĶ̬ڴֽoccupancySharedMemoryͨÿĹڴ
+thread_local size_t occupancySmemPerThread = 0;
+
+size_t occupancySharedMemory(int block){
+  return occupancySmemPerThread * (size_t)block;
+}
+
+//======ȡռʵߴ======
+//Ϊ(ʵ,ÿ̵߳Ķ̬ڴֽ,ߴ){grid,block,smem}
+//blockΪռߵһάߴ磬gridΪﵽռҪٿsmemΪÿĶ̬ڴֽ
+Napi::Value getMaxOccupancy(const Napi::CallbackInfo& args){
+  //ȡenv
+  Napi::Env env = args.Env();
+
+  jitify::experimental::KernelInstantiation * instance = getHandle<jitify::experimental::KernelInstantiation>(args[0]);
+  size_t smemPerThread = args.Length() > 1 && args[1].IsNumber() ? (size_t)args[1].As<Napi::Number>().Int64Value() : 0;
+  int maxBlock = args.Length() > 2 && args[2].IsNumber() ? args[2].As<Napi::Number>().Int32Value() : 0;
+
+  int grid = 0,block = 0;
+  unsigned int smem = 0;
+  try{
+    occupancySmemPerThread = smemPerThread;
+    jitify::detail::get_1d_max_occupancy(*instance,smemPerThread ? occupancySharedMemory : NULL,&smem,maxBlock,0,&grid,&block);
+  }catch(std::runtime_error msg){
+    Napi::TypeError::New(env,msg.what()).ThrowAsJavaScriptException();
+    return env.Undefined();
+  }
 
-  return Napi::Number::New(env,(size_t)launcher);
+  Napi::Object re = Napi::Object::New(env);
+  re.Set(Napi::String::New(env,"grid"),Napi::Number::New(env,grid));
+  re.Set(Napi::String::New(env,"block"),Napi::Number::New(env,block));
+  re.Set(Napi::String::New(env,"smem"),Napi::Number::New(env,smem));
+  return re;
 }
 
 
@@ -312,16 +1238,195 @@ Napi::Value createBufferHost(const Napi::CallbackInfo& args){
   return Napi::Number::New(env,(size_t)buffer);
 }
 
+//ڴArrayBufferʱͷڴ
+void freeHostArrayBuffer(Napi::Env env,void * data,size_t * size){
+  cudaFreeHost(data);
+  Napi::MemoryManagement::AdjustExternalMemory(env,-(int64_t)*size);
+  delete size;
+}
+
+//======ڴArrayBuffer======
+//ֱӰڴΪArrayBufferjsjsԭдݲֱDMAʱԶͷ
+//ڶΪtrueʱʹдϲڴ(ֻʺϴ)
+Napi::Value createHostArrayBuffer(const Napi::CallbackInfo& args){
+  //ȡenv
+  Napi::Env env = args.Env();
+
+  size_t size = (size_t)args[0].As<Napi::Number>().Int64Value();
+  unsigned int flags = cudaHostAllocDefault;
+  if(args.Length() > 1 && args[1].IsBoolean() && args[1].As<Napi::Boolean>().Value()){
+    flags = cudaHostAllocWriteCombined;
+  }
+
+  void * buffer = NULL;
+  cudaError_t error = cudaHostAlloc(&buffer,size ? size : 1,flags);
+  if(error != cudaSuccess){
+    NodeCudaError(env,error);
+    return env.Undefined();
+  }
+
+  Napi::MemoryManagement::AdjustExternalMemory(env,(int64_t)size);
+  return Napi::ArrayBuffer::New(env,buffer,size,freeHostArrayBuffer,new size_t(size));
+}
+
+
+//ʹõcuda
+//createStreamڵ豸ͷԴʱЩбѾ
+std::mutex liveStreamMutex;
+std::vector<std::pair<cudaStream_t,int> > liveStreams;
+
+//ͷԴʱǵÿһ¼¼Ż豸¼ظ
+struct CudaFence {
+  int device;
+  std::vector<cudaEvent_t> events;
+};
+std::mutex fenceEventMutex;
+std::map<int,std::vector<cudaEvent_t> > fenceEvents;
+
+struct CudaDeviceAllocator {
+  typedef CudaFence Fence;
+
+  bool allocate(void ** ptr,size_t size,int device){
+    return cudaMalloc(ptr,size) == cudaSuccess;
+  }
+  void free(void * ptr,int device){
+    int current = 0;
+    cudaGetDevice(&current);
+    if(current != device) {cudaSetDevice(device);}
+    cudaFree(ptr);
+    if(current != device) {cudaSetDevice(current);}
+  }
+  //豸Ĭзм¼¼ڲеͼȴ
+  Fence fence(int device){
+    Fence re;
+    re.device = device;
+    std::vector<cudaStream_t> streams(1,(cudaStream_t)0);
+    //¼֮ǰһֱ߳ͷʱҪȴѾٵм¼¼
+    std::lock_guard<std::mutex> lock(liveStreamMutex);
+    for(auto & item : liveStreams){
+      if(item.second == device) {streams.push_back(item.first);}
+    }
+    int current = 0;
+    cudaGetDevice(&current);
+    if(current != device) {cudaSetDevice(device);}
+    for(cudaStream_t stream : streams){
+      cudaStreamCaptureStatus capture = cudaStreamCaptureStatusNone;
+      if(stream && (cudaStreamIsCapturing(stream,&capture) != cudaSuccess || capture != cudaStreamCaptureStatusNone)) {continue;}
+      cudaEvent_t event = NULL;
+      {
+        std::lock_guard<std::mutex> lock(fenceEventMutex);
+        std::vector<cudaEvent_t> & pool = fenceEvents[device];
+        if(!pool.empty()){
+          event = pool.back();
+          pool.pop_back();
+        }
+      }
+      if(event == NULL && cudaEventCreateWithFlags(&event,cudaEventDisableTiming) != cudaSuccess) {continue;}
+      if(cudaEventRecord(event,stream) == cudaSuccess){
+        re.events.push_back(event);
+      }else{
+        recycle(device,event);
+      }
+    }
+    if(current != device) {cudaSetDevice(current);}
+    return re;
+  }
+  bool ready(Fence & fence){
+    while(!fence.events.empty()){
+      if(cudaEventQuery(fence.events.back()) == cudaErrorNotReady) {return false;}
+      recycle(fence.device,fence.events.back());
+      fence.events.pop_back();
+    }
+    return true;
+  }
+  void wait(Fence & fence){
+    for(cudaEvent_t event : fence.events) {cudaEventSynchronize(event);}
+    ready(fence);
+  }
+  static void recycle(int device,cudaEvent_t event){
+    std::lock_guard<std::mutex> lock(fenceEventMutex);
+    fenceEvents[device].push_back(event);
+  }
+};
+
+/**Դ滺أ˳ʱͷ()cudaжغcudaFree */
+CachingAllocator<CudaDeviceAllocator> * bufferPool = new CachingAllocator<CudaDeviceAllocator>(size_t(1) << 30);
+
+//һԴ棬ͷʱŻػػֱͷ
+struct DeviceBuffer {
+  void * ptr;
+  size_t size;
+  bool pooled;
+  ~DeviceBuffer(){
+    if(ptr == NULL) {return;}
+    if(pooled && bufferPool->deallocate(ptr)) {return;}
+    cudaFree(ptr);
+  }
+};
+
+//װԴΪ{handle,ptr,size,pooled}Դworkerеľպͷ
+Napi::Value wrapDeviceBuffer(Napi::Env env,std::shared_ptr<DeviceBuffer> buffer){
+  Napi::Object re = Napi::Object::New(env);
+  re.Set(Napi::String::New(env,"ptr"),Napi::Number::New(env,(size_t)buffer->ptr));
+  re.Set(Napi::String::New(env,"size"),Napi::Number::New(env,(double)buffer->size));
+  re.Set(Napi::String::New(env,"pooled"),Napi::Boolean::New(env,buffer->pooled));
+  int64_t size = (int64_t)buffer->size;
+  re.Set(Napi::String::New(env,"handle"),wrapHandle(env,new std::shared_ptr<DeviceBuffer>(buffer),size));
+  return re;
+}
+
+//ȴworker򿪵ĹԴ棬ownerΪjs
+struct SharedBuffer {
+  std::shared_ptr<DeviceBuffer> buffer;
+  const AddonData * owner;
+};
+std::mutex sharedBufferMutex;
+std::unordered_map<uint64_t,SharedBuffer> sharedBuffers;
+uint64_t nextSharedBuffer = 1;
+
+//Ļٺûб򿪵ıŲٳԴ
+AddonData::~AddonData(){
+  std::lock_guard<std::mutex> lock(sharedBufferMutex);
+  for(auto it = sharedBuffers.begin();it != sharedBuffers.end();){
+    if(it->second.owner == this){
+      it = sharedBuffers.erase(it);
+    }else{
+      ++it;
+    }
+  }
+}
 
 //======ڴռ======
+//ڶΪfalseʱʹû
+//{handle,ptr}handleջߵfreeBufferʱͷԴ棬ptrΪԴַ
 Napi::Value createBuffer(const Napi::CallbackInfo& args){
   //ȡenv
   Napi::Env env = args.Env();
 
   void * buffer = NULL;
-  NodeCudaError(env,cudaMalloc(&buffer,(size_t)args[0].As<Napi::Number>().Int64Value()));
+  size_t size = (size_t)args[0].As<Napi::Number>().Int64Value();
+  bool pooled = !(args.Length() > 1 && args[1].IsBoolean() && !args[1].As<Napi::Boolean>().Value());
+  if(!pooled){
+    cudaError_t error = cudaMalloc(&buffer,size);
+    if(error != cudaSuccess){
+      NodeCudaError(env,error);
+      return env.Undefined();
+    }
+  }else{
+    int device = 0;
+    NodeCudaError(env,cudaGetDevice(&device));
+    buffer = bufferPool->allocate(size,device);
+    if(buffer == NULL){
+      Napi::TypeError::New(env,cudaGetErrorString(cudaErrorMemoryAllocation)).ThrowAsJavaScriptException();
+      return env.Undefined();
+    }
+  }
 
-  return Napi::Number::New(env,(size_t)buffer);
+  DeviceBuffer * object = new DeviceBuffer();
+  object->ptr = buffer;
+  object->size = size;
+  object->pooled = pooled;
+  return wrapDeviceBuffer(env,std::shared_ptr<DeviceBuffer>(object));
 }
 
 //======д======
@@ -347,43 +1452,144 @@ void freeBufferHost(const Napi::CallbackInfo& args){
 }
 
 //======ͷڴ======
+//ΪcreateBufferصhandleͷźhandleʱظͷ
 void freeBuffer(const Napi::CallbackInfo& args){
   //ȡenv
-  
   Napi::Env env = args.Env();
 
-  void * buffer = (void **)args[0].As<Napi::Number>().Int64Value();
-  NodeCudaError(env,cudaFree(buffer));
+  releaseNativeHandle(env,getNativeHandle<std::shared_ptr<DeviceBuffer> >(args[0]));
 }
 
-
-//======ȡ======
-void readBuffer(const Napi::CallbackInfo& args){
+//======Դ======
+//һţͨpostMessage͸workeropenSharedBufferһ
+//ڱ򿪡revokeSharedBuffer߹Ļ֮ǰԴ
+Napi::Value shareBuffer(const Napi::CallbackInfo& args){
   //ȡenv
   Napi::Env env = args.Env();
 
-  void * buffer = (void **)args[0].As<Napi::Number>().Int64Value();
-  size_t size = (size_t)args[2].As<Napi::Number>().Int64Value();
-  void * data = args[1].As<Napi::ArrayBuffer>().Data();
-  NodeCudaError(env,cudaMemcpy(data,buffer, size, cudaMemcpyDeviceToHost));
+  std::shared_ptr<DeviceBuffer> * buffer = getHandle<std::shared_ptr<DeviceBuffer> >(args[0]);
+  if(buffer == NULL){
+    Napi::TypeError::New(env,"ԴѾͷ").ThrowAsJavaScriptException();
+    return env.Undefined();
+  }
+  std::lock_guard<std::mutex> lock(sharedBufferMutex);
+  uint64_t id = nextSharedBuffer++;
+  sharedBuffers[id] = SharedBuffer{*buffer,env.GetInstanceData<AddonData>()};
+  return Napi::Number::New(env,(double)id);
 }
 
+//======Դ======
+//ֻйĻԳǷ˻ûб򿪵ı
+Napi::Value revokeSharedBuffer(const Napi::CallbackInfo& args){
+  //ȡenv
+  Napi::Env env = args.Env();
 
+  uint64_t id = (uint64_t)args[0].As<Napi::Number>().Int64Value();
+  std::lock_guard<std::mutex> lock(sharedBufferMutex);
+  auto it = sharedBuffers.find(id);
+  if(it == sharedBuffers.end() || it->second.owner != env.GetInstanceData<AddonData>()){
+    return Napi::Boolean::New(env,false);
+  }
+  sharedBuffers.erase(it);
+  return Napi::Boolean::New(env,true);
+}
 
-//============
-Napi::Value createArray3D(const Napi::CallbackInfo& args){
+//======򿪹Դ======
+//غcreateBufferͬ{handle,ptr,size,pooled}
+Napi::Value openSharedBuffer(const Napi::CallbackInfo& args){
   //ȡenv
   Napi::Env env = args.Env();
 
-  size_t sizeX = (size_t)args[0].As<Napi::Number>().Int64Value();
-  size_t sizeY = (size_t)args[1].As<Napi::Number>().Int64Value();
-  size_t sizeZ = (size_t)args[2].As<Napi::Number>().Int64Value();
+  uint64_t id = (uint64_t)args[0].As<Napi::Number>().Int64Value();
+  std::shared_ptr<DeviceBuffer> buffer;
+  {
+    std::lock_guard<std::mutex> lock(sharedBufferMutex);
+    auto it = sharedBuffers.find(id);
+    if(it != sharedBuffers.end()){
+      buffer = it->second.buffer;
+      sharedBuffers.erase(it);
+    }
+  }
+  if(!buffer){
+    Napi::TypeError::New(env,"Դ治ڡѾ򿪻Ѿ").ThrowAsJavaScriptException();
+    return env.Undefined();
+  }
+  return wrapDeviceBuffer(env,buffer);
+}
+
+//======ȡͳ======
+Napi::Value getBufferPoolStats(const Napi::CallbackInfo& args){
+  //ȡenv
+  Napi::Env env = args.Env();
+
+  auto stats = bufferPool->get_stats();
+  Napi::Object re = Napi::Object::New(env);
+  re.Set(Napi::String::New(env,"hits"),Napi::Number::New(env,stats.hits));
+  re.Set(Napi::String::New(env,"misses"),Napi::Number::New(env,stats.misses));
+  re.Set(Napi::String::New(env,"cachedBytes"),Napi::Number::New(env,stats.cached_bytes));
+  re.Set(Napi::String::New(env,"inUseBytes"),Napi::Number::New(env,stats.in_use_bytes));
+  re.Set(Napi::String::New(env,"requestedBytes"),Napi::Number::New(env,stats.requested_bytes));
+  re.Set(Napi::String::New(env,"fragmentationBytes"),Napi::Number::New(env,stats.fragmentation_bytes));
+  re.Set(Napi::String::New(env,"trimmed"),Napi::Number::New(env,stats.trimmed));
+  re.Set(Napi::String::New(env,"pendingBytes"),Napi::Number::New(env,stats.pending_bytes));
+  re.Set(Napi::String::New(env,"highWater"),Napi::Number::New(env,bufferPool->get_high_water()));
+  return re;
+}
+
+//======û======
+void setBufferPoolHighWater(const Napi::CallbackInfo& args){
+  bufferPool->set_high_water((size_t)args[0].As<Napi::Number>().Int64Value());
+}
+
+//======ͷŻеԴ======
+//ΪֽĬȫͷ
+void trimBufferPool(const Napi::CallbackInfo& args){
+  size_t target = args.Length() > 0 && args[0].IsNumber() ? (size_t)args[0].As<Napi::Number>().Int64Value() : 0;
+  bufferPool->trim(target);
+}
+
+
+//======ȡ======
+void readBuffer(const Napi::CallbackInfo& args){
+  //ȡenv
+  Napi::Env env = args.Env();
+
+  void * buffer = (void **)args[0].As<Napi::Number>().Int64Value();
+  size_t size = (size_t)args[2].As<Napi::Number>().Int64Value();
+  void * data = args[1].As<Napi::ArrayBuffer>().Data();
+  NodeCudaError(env,cudaMemcpy(data,buffer, size, cudaMemcpyDeviceToHost));
+}
+
+
+
+//ά飬ͷʱcudaFreeArray
+struct CudaArrayHandle {
+  cudaArray_t array;
+  ~CudaArrayHandle(){
+    cudaFreeArray(array);
+  }
+};
+
+//============
+Napi::Value createArray3D(const Napi::CallbackInfo& args){
+  //ȡenv
+  Napi::Env env = args.Env();
+
+  size_t sizeX = (size_t)args[0].As<Napi::Number>().Int64Value();
+  size_t sizeY = (size_t)args[1].As<Napi::Number>().Int64Value();
+  size_t sizeZ = (size_t)args[2].As<Napi::Number>().Int64Value();
 
   cudaChannelFormatDesc channelDesc = cudaCreateChannelDesc<char>();
   cudaArray_t array = NULL;
-  NodeCudaError(env,cudaMalloc3DArray(&array, &channelDesc, make_cudaExtent(sizeX*sizeof(char),sizeY,sizeZ), 0));
+  cudaError_t error = cudaMalloc3DArray(&array, &channelDesc, make_cudaExtent(sizeX*sizeof(char),sizeY,sizeZ), 0);
+  if(error != cudaSuccess){
+    NodeCudaError(env,error);
+    return env.Undefined();
+  }
 
-  return Napi::Number::New(env,(size_t)array);
+  CudaArrayHandle * object = new CudaArrayHandle();
+  object->array = array;
+  return wrapHandle(env,object,sizeX * sizeY * sizeZ);
 }
 
 //======д======
@@ -391,7 +1597,7 @@ void writeArray3D(const Napi::CallbackInfo& args){
   //ȡenv
   Napi::Env env = args.Env();
 
-  cudaArray_t array = (cudaArray_t)args[0].As<Napi::Number>().Int64Value();
+  cudaArray_t array = getHandle<CudaArrayHandle>(args[0])->array;
   void * data = args[1].As<Napi::ArrayBuffer>().Data();
   size_t sizeX = (size_t)args[2].As<Napi::Number>().Int64Value();
   size_t sizeY = (size_t)args[3].As<Napi::Number>().Int64Value();
@@ -412,7 +1618,7 @@ void readArray3D(const Napi::CallbackInfo& args){
   //ȡenv
   Napi::Env env = args.Env();
 
-  cudaArray_t array = (cudaArray_t)args[0].As<Napi::Number>().Int64Value();
+  cudaArray_t array = getHandle<CudaArrayHandle>(args[0])->array;
   void * data = args[1].As<Napi::ArrayBuffer>().Data();
   size_t sizeX = (size_t)args[2].As<Napi::Number>().Int64Value();
   size_t sizeY = (size_t)args[3].As<Napi::Number>().Int64Value();
@@ -427,20 +1633,34 @@ void readArray3D(const Napi::CallbackInfo& args){
 }
 
 
+//άԴ棬ͷʱcudaFree
+struct PitchedBuffer {
+  cudaPitchedPtr ptr;
+  ~PitchedBuffer(){
+    cudaFree(ptr.ptr);
+  }
+};
+
 //άbuffer
 Napi::Value createBuffer3D(const Napi::CallbackInfo& args){
   //ȡenv
   Napi::Env env = args.Env();
 
-  cudaPitchedPtr * ptr = new cudaPitchedPtr();
+  PitchedBuffer * object = new PitchedBuffer();
+  cudaPitchedPtr * ptr = &object->ptr;
   cudaExtent size;
   size.width = (size_t)args[0].As<Napi::Number>().Int64Value();
   size.height = (size_t)args[1].As<Napi::Number>().Int64Value();
   size.depth = (size_t)args[2].As<Napi::Number>().Int64Value();
-  NodeCudaError(env,cudaMalloc3D(ptr,size));
+  cudaError_t error = cudaMalloc3D(ptr,size);
+  if(error != cudaSuccess){
+    delete object;
+    NodeCudaError(env,error);
+    return env.Undefined();
+  }
 
   Napi::Object re = Napi::Object::New(env);
-  re.Set(Napi::String::New(env, "index"),Napi::Number::New(env,(size_t)ptr));
+  re.Set(Napi::String::New(env, "index"),wrapHandle(env,object,ptr->pitch * size.height * size.depth));
   re.Set(Napi::String::New(env, "ptr"),Napi::Number::New(env,(size_t)ptr->ptr));
   re.Set(Napi::String::New(env, "pitch"),Napi::Number::New(env,(size_t)ptr->pitch));
   re.Set(Napi::String::New(env, "xsize"),Napi::Number::New(env,(size_t)ptr->xsize));
@@ -454,7 +1674,7 @@ void writeBuffer3D(const Napi::CallbackInfo& args){
   //ȡenv
   Napi::Env env = args.Env();
 
-  cudaPitchedPtr * ptr = (cudaPitchedPtr *)args[0].As<Napi::Number>().Int64Value();
+  cudaPitchedPtr * ptr = &getHandle<PitchedBuffer>(args[0])->ptr;
   void * data = args[1].As<Napi::ArrayBuffer>().Data();
 
   cudaExtent size;
@@ -477,7 +1697,7 @@ void readBuffer3D(const Napi::CallbackInfo& args){
   //ȡenv
   Napi::Env env = args.Env();
 
-  cudaPitchedPtr * ptr = (cudaPitchedPtr *)args[0].As<Napi::Number>().Int64Value();
+  cudaPitchedPtr * ptr = &getHandle<PitchedBuffer>(args[0])->ptr;
   void * data = args[1].As<Napi::ArrayBuffer>().Data();
 
   cudaExtent size;
@@ -495,6 +1715,315 @@ void readBuffer3D(const Napi::CallbackInfo& args){
 }
 
 
+//ͷʱcudaStreamDestroy
+struct StreamHandle {
+  cudaStream_t stream;
+  ~StreamHandle(){
+    {
+      std::lock_guard<std::mutex> lock(liveStreamMutex);
+      for(auto it = liveStreams.begin();it != liveStreams.end();++it){
+        if(it->first == stream){
+          liveStreams.erase(it);
+          break;
+        }
+      }
+    }
+    cudaStreamDestroy(stream);
+  }
+};
+
+//============
+//{handle,stream}handleջߵdestroyStreamʱͷ
+Napi::Value createStream(const Napi::CallbackInfo& args){
+  //ȡenv
+  Napi::Env env = args.Env();
+
+  cudaStream_t stream = NULL;
+  cudaError_t error = cudaStreamCreateWithFlags(&stream,cudaStreamNonBlocking);
+  if(error != cudaSuccess){
+    NodeCudaError(env,error);
+    return env.Undefined();
+  }
+
+  StreamHandle * object = new StreamHandle();
+  object->stream = stream;
+  {
+    int device = 0;
+    cudaGetDevice(&device);
+    std::lock_guard<std::mutex> lock(liveStreamMutex);
+    liveStreams.push_back(std::make_pair(stream,device));
+  }
+  Napi::Object re = Napi::Object::New(env);
+  re.Set(Napi::String::New(env,"handle"),wrapHandle(env,object,0));
+  re.Set(Napi::String::New(env,"stream"),Napi::Number::New(env,(size_t)stream));
+  return re;
+}
+
+//======ͷ======
+void destroyStream(const Napi::CallbackInfo& args){
+  //ȡenv
+  Napi::Env env = args.Env();
+
+  releaseNativeHandle(env,getNativeHandle<StreamHandle>(args[0]));
+}
+
+//======ȴ======
+void streamSynchronize(const Napi::CallbackInfo& args){
+  //ȡenv
+  Napi::Env env = args.Env();
+
+  cudaStream_t stream = (cudaStream_t)args[0].As<Napi::Number>().Int64Value();
+  NodeCudaError(env,cudaStreamSynchronize(stream));
+}
+
+//֪ͨصִеʱ̰ͨ߳ȫص߳resolve Promise
+//ص֮ǰм¼¼صִкͨ¼֮ǰǷٲѯ(Ѿ֮)
+class StreamPromise {
+  cudaEvent_t event;
+  Napi::Promise::Deferred deferred;
+  Napi::ThreadSafeFunction tsfn;
+  //ǰҪִĶ󣬰ArrayBufferԴ
+  Napi::ObjectReference keep;
+
+  StreamPromise(Napi::Env env):event(NULL),deferred(Napi::Promise::Deferred::New(env)){
+    tsfn = Napi::ThreadSafeFunction::New(env,Napi::Function(),"cudaStreamCallback",0,1);
+  }
+  ~StreamPromise(){
+    if(event) {cudaEventDestroy(event);}
+  }
+
+  //cudaĻصִ߳Уܵcudaӿ
+  static void CUDART_CB onHost(void * data){
+    StreamPromise * self = (StreamPromise *)data;
+    Napi::ThreadSafeFunction tsfn = self->tsfn;
+    tsfn.BlockingCall(self,[](Napi::Env env,Napi::Function callback,StreamPromise * self){
+      //¼֮ǰǷص¼ִ֮У¼Ѿ
+      cudaError_t error = cudaEventQuery(self->event);
+      if(error == cudaSuccess || error == cudaErrorNotReady){
+        self->deferred.Resolve(env.Undefined());
+      }else{
+        self->deferred.Reject(Napi::Error::New(env,cudaGetErrorString(error)).Value());
+      }
+      delete self;
+    });
+    tsfn.Release();
+  }
+
+public:
+  //ǰ֪֮ͨضӦPromisekeepAliveеĶǰᱻ
+  static Napi::Value enqueue(Napi::Env env,cudaStream_t stream,const std::vector<Napi::Value> & keepAlive){
+    StreamPromise * self = new StreamPromise(env);
+    Napi::Promise promise = self->deferred.Promise();
+    Napi::Array keep = Napi::Array::New(env);
+    for(const Napi::Value & value : keepAlive){
+      if(value.IsObject()) {keep.Set(keep.Length(),value);}
+    }
+    self->keep = Napi::Persistent(keep.As<Napi::Object>());
+    cudaError_t error = cudaEventCreateWithFlags(&self->event,cudaEventDisableTiming);
+    if(error == cudaSuccess) {error = cudaEventRecord(self->event,stream);}
+    if(error == cudaSuccess) {error = cudaLaunchHostFunc(stream,onHost,self);}
+    if(error != cudaSuccess){
+      self->deferred.Reject(Napi::Error::New(env,cudaGetErrorString(error)).Value());
+      self->tsfn.Release();
+      delete self;
+    }
+    return promise;
+  }
+};
+
+//======֪ͨ======
+//Ϊ(,)һеǰɺresolvePromiseǰ
+Napi::Value streamPromise(const Napi::CallbackInfo& args){
+  //ȡenv
+  Napi::Env env = args.Env();
+
+  cudaStream_t stream = (cudaStream_t)args[0].As<Napi::Number>().Int64Value();
+  return StreamPromise::enqueue(env,stream,{args[1]});
+}
+
+//======첽д======
+//Ϊ(Դ,ArrayBuffer,ֽ,,,Դ)ǰֺ
+Napi::Value writeBufferAsync(const Napi::CallbackInfo& args){
+  //ȡenv
+  Napi::Env env = args.Env();
+
+  void * buffer = (void **)args[0].As<Napi::Number>().Int64Value();
+  size_t size = (size_t)args[2].As<Napi::Number>().Int64Value();
+  void * data = args[1].As<Napi::ArrayBuffer>().Data();
+  cudaStream_t stream = (cudaStream_t)args[3].As<Napi::Number>().Int64Value();
+
+  NodeCudaError(env,cudaMemcpyAsync(buffer, data, size, cudaMemcpyHostToDevice, stream));
+  if(env.IsExceptionPending()) {return env.Undefined();}
+  return StreamPromise::enqueue(env,stream,{args[1],args[4],args[5]});
+}
+
+//======첽ȡ======
+//writeBufferAsyncͬ
+Napi::Value readBufferAsync(const Napi::CallbackInfo& args){
+  //ȡenv
+  Napi::Env env = args.Env();
+
+  void * buffer = (void **)args[0].As<Napi::Number>().Int64Value();
+  size_t size = (size_t)args[2].As<Napi::Number>().Int64Value();
+  void * data = args[1].As<Napi::ArrayBuffer>().Data();
+  cudaStream_t stream = (cudaStream_t)args[3].As<Napi::Number>().Int64Value();
+
+  NodeCudaError(env,cudaMemcpyAsync(data, buffer, size, cudaMemcpyDeviceToHost, stream));
+  if(env.IsExceptionPending()) {return env.Undefined();}
+  return StreamPromise::enqueue(env,stream,{args[1],args[4],args[5]});
+}
+
+//======첽дάbuffer======
+Napi::Value writeBuffer3DAsync(const Napi::CallbackInfo& args){
+  //ȡenv
+  Napi::Env env = args.Env();
+
+  cudaPitchedPtr * ptr = &getHandle<PitchedBuffer>(args[0])->ptr;
+  void * data = args[1].As<Napi::ArrayBuffer>().Data();
+
+  cudaExtent size;
+  size.width = (size_t)args[2].As<Napi::Number>().Int64Value();
+  size.height = (size_t)args[3].As<Napi::Number>().Int64Value();
+  size.depth = (size_t)args[4].As<Napi::Number>().Int64Value();
+  size_t width = (size_t)args[5].As<Napi::Number>().Int64Value();
+  cudaStream_t stream = (cudaStream_t)args[6].As<Napi::Number>().Int64Value();
+
+  cudaMemcpy3DParms parms = {0};
+  parms.srcPtr = make_cudaPitchedPtr(data, size.width, width, size.height);
+  parms.dstPtr = *ptr;
+  parms.extent = size;
+  parms.kind = cudaMemcpyHostToDevice;
+  NodeCudaError(env,cudaMemcpy3DAsync(&parms,stream));
+  if(env.IsExceptionPending()) {return env.Undefined();}
+  return StreamPromise::enqueue(env,stream,{args[1],args[7],args[8]});
+}
+
+//======첽ȡάbuffer======
+Napi::Value readBuffer3DAsync(const Napi::CallbackInfo& args){
+  //ȡenv
+  Napi::Env env = args.Env();
+
+  cudaPitchedPtr * ptr = &getHandle<PitchedBuffer>(args[0])->ptr;
+  void * data = args[1].As<Napi::ArrayBuffer>().Data();
+
+  cudaExtent size;
+  size.width = (size_t)args[2].As<Napi::Number>().Int64Value();
+  size.height = (size_t)args[3].As<Napi::Number>().Int64Value();
+  size.depth = (size_t)args[4].As<Napi::Number>().Int64Value();
+  size_t width = (size_t)args[5].As<Napi::Number>().Int64Value();
+  cudaStream_t stream = (cudaStream_t)args[6].As<Napi::Number>().Int64Value();
+
+  cudaMemcpy3DParms parms = {0};
+  parms.dstPtr = make_cudaPitchedPtr(data, size.width, width, size.height);
+  parms.srcPtr = *ptr;
+  parms.extent = size;
+  parms.kind = cudaMemcpyDeviceToHost;
+  NodeCudaError(env,cudaMemcpy3DAsync(&parms,stream));
+  if(env.IsExceptionPending()) {return env.Undefined();}
+  return StreamPromise::enqueue(env,stream,{args[1],args[7],args[8]});
+}
+
+
+//¼ͷʱcudaEventDestroy
+struct EventHandle {
+  cudaEvent_t event;
+  ~EventHandle(){
+    cudaEventDestroy(event);
+  }
+};
+
+//======¼======
+//Ϊ(disableTiming,blockingSync){handle,event}handleջߵdestroyEventʱͷ¼
+Napi::Value createEvent(const Napi::CallbackInfo& args){
+  //ȡenv
+  Napi::Env env = args.Env();
+
+  unsigned int flags = cudaEventDefault;
+  if(args.Length() > 0 && args[0].IsBoolean() && args[0].As<Napi::Boolean>().Value()) {flags |= cudaEventDisableTiming;}
+  if(args.Length() > 1 && args[1].IsBoolean() && args[1].As<Napi::Boolean>().Value()) {flags |= cudaEventBlockingSync;}
+  cudaEvent_t event = NULL;
+  cudaError_t error = cudaEventCreateWithFlags(&event,flags);
+  if(error != cudaSuccess){
+    NodeCudaError(env,error);
+    return env.Undefined();
+  }
+
+  EventHandle * object = new EventHandle();
+  object->event = event;
+  Napi::Object re = Napi::Object::New(env);
+  re.Set(Napi::String::New(env,"handle"),wrapHandle(env,object,0));
+  re.Set(Napi::String::New(env,"event"),Napi::Number::New(env,(size_t)event));
+  return re;
+}
+
+//======ͷ¼======
+void destroyEvent(const Napi::CallbackInfo& args){
+  //ȡenv
+  Napi::Env env = args.Env();
+
+  releaseNativeHandle(env,getNativeHandle<EventHandle>(args[0]));
+}
+
+//======¼¼======
+//еǰ֮¼¼
+void eventRecord(const Napi::CallbackInfo& args){
+  //ȡenv
+  Napi::Env env = args.Env();
+
+  cudaEvent_t event = (cudaEvent_t)args[0].As<Napi::Number>().Int64Value();
+  cudaStream_t stream = (cudaStream_t)args[1].As<Napi::Number>().Int64Value();
+  NodeCudaError(env,cudaEventRecord(event,stream));
+}
+
+//======ѯ¼======
+//¼֮ǰʱtrue
+Napi::Value eventQuery(const Napi::CallbackInfo& args){
+  //ȡenv
+  Napi::Env env = args.Env();
+
+  cudaEvent_t event = (cudaEvent_t)args[0].As<Napi::Number>().Int64Value();
+  cudaError_t error = cudaEventQuery(event);
+  if(error == cudaErrorNotReady) {return Napi::Boolean::New(env,false);}
+  NodeCudaError(env,error);
+  return Napi::Boolean::New(env,error == cudaSuccess);
+}
+
+//======ȴ¼======
+void eventSynchronize(const Napi::CallbackInfo& args){
+  //ȡenv
+  Napi::Env env = args.Env();
+
+  cudaEvent_t event = (cudaEvent_t)args[0].As<Napi::Number>().Int64Value();
+  NodeCudaError(env,cudaEventSynchronize(event));
+}
+
+//======¼======
+//ɵ¼֮GPUʱ()
+Napi::Value eventElapsedTime(const Napi::CallbackInfo& args){
+  //ȡenv
+  Napi::Env env = args.Env();
+
+  cudaEvent_t start = (cudaEvent_t)args[0].As<Napi::Number>().Int64Value();
+  cudaEvent_t end = (cudaEvent_t)args[1].As<Napi::Number>().Int64Value();
+  float ms = 0;
+  cudaError_t error = cudaEventElapsedTime(&ms,start,end);
+  if(error != cudaSuccess){
+    NodeCudaError(env,error);
+    return env.Undefined();
+  }
+  return Napi::Number::New(env,ms);
+}
+
+
+//ͼͷʱcudaDestroyTextureObject
+struct TextureHandle {
+  cudaTextureObject_t texture;
+  ~TextureHandle(){
+    cudaDestroyTextureObject(texture);
+  }
+};
+
+//{handle,texture}handleʱͷͼ
 Napi::Value createTexture3D(const Napi::CallbackInfo& args){
   //ȡenv
   Napi::Env env = args.Env();
@@ -522,8 +2051,18 @@ Napi::Value createTexture3D(const Napi::CallbackInfo& args){
   texDescr.addressMode[2] = cudaAddressModeMirror;
   texDescr.readMode = cudaReadModeElementType;
 
-  NodeCudaError(env,cudaCreateTextureObject(&texture, &texRes, &texDescr, NULL));
-  return Napi::Number::New(env,(size_t)texture);
+  cudaError_t error = cudaCreateTextureObject(&texture, &texRes, &texDescr, NULL);
+  if(error != cudaSuccess){
+    NodeCudaError(env,error);
+    return env.Undefined();
+  }
+
+  TextureHandle * object = new TextureHandle();
+  object->texture = texture;
+  Napi::Object re = Napi::Object::New(env);
+  re.Set(Napi::String::New(env,"handle"),wrapHandle(env,object,0));
+  re.Set(Napi::String::New(env,"texture"),Napi::Number::New(env,(size_t)texture));
+  return re;
 }
 
 
@@ -537,7 +2076,7 @@ Napi::Value runKernel(const Napi::CallbackInfo& args){
   re.Set(Napi::String::New(env,"code"),Napi::Number::New(env,0));
 
   //ַ
-  jitify::experimental::Program * program = (jitify::experimental::Program *)args[0].As<Napi::Number>().Int64Value();
+  jitify::experimental::Program * program = getHandle<jitify::experimental::Program>(args[0]);
   //
   auto kname = args[1].As<Napi::String>().Utf8Value();
 
@@ -585,7 +2124,7 @@ Napi::Value runInstance(const Napi::CallbackInfo& args){
   re.Set(Napi::String::New(env,"code"),Napi::Number::New(env,0));
 
   //ַ
-  jitify::experimental::KernelInstantiation * instance = (jitify::experimental::KernelInstantiation *)args[0].As<Napi::Number>().Int64Value();
+  jitify::experimental::KernelInstantiation * instance = getHandle<jitify::experimental::KernelInstantiation>(args[0]);
 
   //ʼʵ
   auto arguments = args[1].As<Napi::Array>();
@@ -623,7 +2162,7 @@ Napi::Value runLauncher(const Napi::CallbackInfo& args){
   re.Set(Napi::String::New(env,"code"),Napi::Number::New(env,0));
 
   //ַ
-  jitify::experimental::KernelLauncher * launcher = (jitify::experimental::KernelLauncher *)args[0].As<Napi::Number>().Int64Value();
+  jitify::experimental::KernelLauncher * launcher = getHandle<jitify::experimental::KernelLauncher>(args[0]);
 
   //ʼʵ
   auto arguments = args[1].As<Napi::Array>();
@@ -653,6 +2192,704 @@ Napi::Value runLauncher(const Napi::CallbackInfo& args){
 
 
 
+class PackedLauncher;
+//дԤύʱеֵָʹ
+std::mutex packedLauncherMutex;
+std::unordered_set<PackedLauncher *> livePackedLaunchers;
+
+//Ԥ鰴PTX.entryĲǩŲʱٲκζѷ
+class PackedLauncher {
+public:
+  jitify::experimental::KernelLauncher launcher;
+  //launcherֻʵָ룬ʵľʹģͷ֮ǰᱻж
+  Napi::Reference<Napi::Value> instanceRef;
+  //ǩ
+  std::vector<jitify::detail::PtxParam> layout;
+  //ÿڲеƫ
+  std::vector<size_t> offsets;
+  //飬JSͨⲿArrayBufferֱд
+  std::vector<uint64_t> block;
+  //ֽ
+  size_t bytes;
+  //cuLaunchKernelĲָ룬ֱָеÿ
+  std::vector<void *> ptrs;
+  //õĳߴύʱֻһ
+  dim3 grid_size;
+  dim3 block_size;
+  cudaStream_t stream;
+
+  //countΪ޷ǩʱʹõĲʱÿ8ָֽ봦
+  PackedLauncher(jitify::experimental::KernelInstantiation * instance,Napi::Value instanceHandle,dim3 grid,dim3 block_size,size_t count,cudaStream_t stream,unsigned int smem = 0)
+    : launcher(instance->configure(grid,block_size,smem,stream)),instanceRef(Napi::Persistent(instanceHandle)),bytes(0),grid_size(grid),block_size(block_size),stream(stream){
+    try{
+      layout = instance->get_param_layout();
+    }catch(std::runtime_error msg){
+      layout.clear();
+      for(size_t i = 0;i < count;i++){
+        jitify::detail::PtxParam param;
+        param.type = "u64";
+        param.size = 8;
+        param.align = 8;
+        layout.push_back(param);
+      }
+    }
+    for(size_t i = 0;i < layout.size();i++){
+      size_t align = layout[i].align ? layout[i].align : 1;
+      bytes = (bytes + align - 1) / align * align;
+      offsets.push_back(bytes);
+      bytes += layout[i].size;
+    }
+    block.resize(bytes / 8 + 1,0);
+    ptrs.resize(layout.size() ? layout.size() : 1);
+    for(size_t i = 0;i < layout.size();i++){
+      ptrs[i] = (char *)block.data() + offsets[i];
+    }
+    std::lock_guard<std::mutex> lock(packedLauncherMutex);
+    livePackedLaunchers.insert(this);
+  }
+  ~PackedLauncher(){
+    std::lock_guard<std::mutex> lock(packedLauncherMutex);
+    livePackedLaunchers.erase(this);
+  }
+
+  //ҴʱNULL
+  static PackedLauncher * find(uint64_t handle){
+    std::lock_guard<std::mutex> lock(packedLauncherMutex);
+    auto it = livePackedLaunchers.find((PackedLauncher *)handle);
+    return it == livePackedLaunchers.end() ? NULL : *it;
+  }
+};
+
+//ArrayBufferʱͷ
+void freePackedLauncher(Napi::Env env,void * data,PackedLauncher * launcher){
+  delete launcher;
+}
+
+//======Ԥ======
+//{handle,params,layout}paramsΪArrayBufferڸparamsͷǰʵᱻ
+Napi::Value createPackedLauncher(const Napi::CallbackInfo& args){
+  //ȡenv
+  Napi::Env env = args.Env();
+
+  auto sg = args[1].As<Napi::Array>();
+  auto bg = args[2].As<Napi::Array>();
+
+  dim3 grid(sg.Get(0u).As<Napi::Number>().Uint32Value(),
+            sg.Get(1u).As<Napi::Number>().Uint32Value(),
+            sg.Get(2u).As<Napi::Number>().Uint32Value());
+  dim3 block(bg.Get(0u).As<Napi::Number>().Uint32Value(),
+            bg.Get(1u).As<Napi::Number>().Uint32Value(),
+            bg.Get(2u).As<Napi::Number>().Uint32Value());
+
+  //
+  jitify::experimental::KernelInstantiation * instance = args[0].IsExternal() ? getHandle<jitify::experimental::KernelInstantiation>(args[0]) : NULL;
+  if(instance == NULL){
+    Napi::TypeError::New(env,"ʵڻѾͷ").ThrowAsJavaScriptException();
+    return env.Undefined();
+  }
+  size_t count = (size_t)args[3].As<Napi::Number>().Int64Value();
+  cudaStream_t stream = args.Length() > 4 && args[4].IsNumber() ? (cudaStream_t)args[4].As<Napi::Number>().Int64Value() : 0;
+  unsigned int smem = args.Length() > 5 && args[5].IsNumber() ? args[5].As<Napi::Number>().Uint32Value() : 0;
+  PackedLauncher * launcher = new PackedLauncher(instance,args[0],grid,block,count,stream,smem);
+
+  //ǩ
+  Napi::Array layout = Napi::Array::New(env,launcher->layout.size());
+  for(uint32_t i = 0;i < launcher->layout.size();i++){
+    Napi::Object param = Napi::Object::New(env);
+    param.Set(Napi::String::New(env,"type"),Napi::String::New(env,launcher->layout[i].type));
+    param.Set(Napi::String::New(env,"size"),Napi::Number::New(env,launcher->layout[i].size));
+    param.Set(Napi::String::New(env,"offset"),Napi::Number::New(env,launcher->offsets[i]));
+    layout.Set(i,param);
+  }
+
+  Napi::Object re = Napi::Object::New(env);
+  re.Set(Napi::String::New(env,"handle"),Napi::Number::New(env,(size_t)launcher));
+  re.Set(Napi::String::New(env,"params"),Napi::ArrayBuffer::New(env,launcher->block.data(),launcher->bytes,freePackedLauncher,launcher));
+  re.Set(Napi::String::New(env,"layout"),layout);
+  return re;
+}
+
+
+
+//======Ԥ======
+//ֱʹòʱ׳쳣
+Napi::Value launchPacked(const Napi::CallbackInfo& args){
+  //ȡenv
+  Napi::Env env = args.Env();
+
+  PackedLauncher * launcher = PackedLauncher::find((uint64_t)args[0].As<Napi::Number>().Int64Value());
+  if(launcher == NULL){
+    Napi::TypeError::New(env,"ڻѾͷ").ThrowAsJavaScriptException();
+    return env.Undefined();
+  }
+  CUresult res = launcher->launcher.launch_raw(launcher->ptrs.data());
+  if(res != CUDA_SUCCESS){
+    const char* str;
+    cuGetErrorName(res, &str);
+    Napi::TypeError::New(env,str).ThrowAsJavaScriptException();
+  }
+  return env.Undefined();
+}
+
+
+
+
+//ͳƣÿʵһkWindowGPUʱύʱ
+//ǰм¼һ¼֮߶ȡͳʱٲѯѾɵ¼
+//δɵ¼ֱŶӣһеĳʱ񲻻ᵲסѾɵ
+class LaunchProfile {
+public:
+  static const size_t kWindow = 1024;
+  //δɵ¼ԳʱȴɣGPU̫ʱ¼
+  static const size_t kMaxPending = 4096;
+  //ֱͼiΪ[2^(i-1),2^i)΢룬0Ϊ1΢
+  static const size_t kBuckets = 24;
+
+  struct Pending {
+    int device;
+    cudaEvent_t start;
+    cudaEvent_t end;
+    double submit;
+  };
+
+  //ÿδɵ¼ԣͬһе¼˳
+  std::map<cudaStream_t,std::deque<Pending> > pending;
+  size_t pendingCount;
+  //GPUʱύʱ(΢)ѭд
+  std::vector<double> gpuTimes;
+  std::vector<double> submitTimes;
+  size_t next;
+  //ܵѾõGPUʱĴ
+  uint64_t launches;
+  uint64_t measured;
+  double totalGpu;
+  double totalSubmit;
+
+  LaunchProfile():pendingCount(0),next(0),launches(0),measured(0),totalGpu(0),totalSubmit(0){}
+  ~LaunchProfile(){
+    for(auto & queue : pending){
+      for(size_t i = 0;i < queue.second.size();i++) {release(queue.second[i]);}
+    }
+  }
+
+  //¼أ豸֣ʱ¼ֻͳʹã
+  static std::mutex & poolMutex(){
+    static std::mutex mutex;
+    return mutex;
+  }
+  static std::map<int,std::vector<cudaEvent_t> > & pool(){
+    static std::map<int,std::vector<cudaEvent_t> > events;
+    return events;
+  }
+  static cudaError_t acquire(int device,cudaEvent_t * event){
+    {
+      std::lock_guard<std::mutex> lock(poolMutex());
+      std::vector<cudaEvent_t> & events = pool()[device];
+      if(!events.empty()){
+        *event = events.back();
+        events.pop_back();
+        return cudaSuccess;
+      }
+    }
+    return cudaEventCreate(event);
+  }
+  static void release(const Pending & item){
+    std::lock_guard<std::mutex> lock(poolMutex());
+    std::vector<cudaEvent_t> & events = pool()[item.device];
+    events.push_back(item.start);
+    events.push_back(item.end);
+  }
+
+  //ռѾɵwaitΪtrueʱȴɣÿֻѯһδɵ
+  void collect(bool wait){
+    for(auto it = pending.begin();it != pending.end();){
+      std::deque<Pending> & queue = it->second;
+      while(!queue.empty()){
+        Pending & item = queue.front();
+        cudaError_t error = wait ? cudaEventSynchronize(item.end) : cudaEventQuery(item.end);
+        if(error == cudaErrorNotReady) {break;}
+        float ms = 0;
+        if(error == cudaSuccess && cudaEventElapsedTime(&ms,item.start,item.end) == cudaSuccess){
+          add(ms * 1000,item.submit);
+        }
+        release(item);
+        queue.pop_front();
+        pendingCount--;
+      }
+      if(queue.empty()){
+        it = pending.erase(it);
+      }else{
+        ++it;
+      }
+    }
+  }
+
+  void add(double gpu,double submit){
+    if(gpuTimes.size() < kWindow){
+      gpuTimes.push_back(gpu);
+      submitTimes.push_back(submit);
+    }else{
+      gpuTimes[next] = gpu;
+      submitTimes[next] = submit;
+      next = (next + 1) % kWindow;
+    }
+    measured++;
+    totalGpu += gpu;
+    totalSubmit += submit;
+  }
+
+  //launchǰ¼¼launchĽ
+  template <class Launch>
+  CUresult record(cudaStream_t stream,Launch launch){
+    collect(false);
+    while(pendingCount >= kMaxPending){
+      //ȵȴǰ
+      auto it = pending.find(stream);
+      if(it == pending.end()) {it = pending.begin();}
+      cudaEventSynchronize(it->second.front().end);
+      collect(false);
+    }
+    Pending item;
+    cudaGetDevice(&item.device);
+    if(acquire(item.device,&item.start) != cudaSuccess) {return launch();}
+    if(acquire(item.device,&item.end) != cudaSuccess){
+      cudaEventDestroy(item.start);
+      return launch();
+    }
+    cudaEventRecord(item.start,stream);
+    auto time = std::chrono::steady_clock::now();
+    CUresult res = launch();
+    item.submit = std::chrono::duration<double,std::micro>(std::chrono::steady_clock::now() - time).count();
+    cudaEventRecord(item.end,stream);
+    launches++;
+    if(res != CUDA_SUCCESS){
+      release(item);
+      return res;
+    }
+    pending[stream].push_back(item);
+    pendingCount++;
+    return res;
+  }
+};
+
+//ݵͳ{mean,p50,p90,p99,max,histogram}λΪ΢
+Napi::Object launchProfileSummary(Napi::Env env,std::vector<double> values){
+  Napi::Object re = Napi::Object::New(env);
+  std::vector<uint32_t> buckets(LaunchProfile::kBuckets,0);
+  double sum = 0;
+  for(size_t i = 0;i < values.size();i++){
+    sum += values[i];
+    size_t bucket = 0;
+    while(bucket + 1 < LaunchProfile::kBuckets && values[i] >= (double)(1ull << bucket)) {bucket++;}
+    buckets[bucket]++;
+  }
+  std::sort(values.begin(),values.end());
+  auto percentile = [&values](double p){
+    return values.empty() ? 0.0 : values[std::min(values.size() - 1,(size_t)(p * values.size()))];
+  };
+  re.Set(Napi::String::New(env,"mean"),Napi::Number::New(env,values.empty() ? 0 : sum / values.size()));
+  re.Set(Napi::String::New(env,"p50"),Napi::Number::New(env,percentile(0.5)));
+  re.Set(Napi::String::New(env,"p90"),Napi::Number::New(env,percentile(0.9)));
+  re.Set(Napi::String::New(env,"p99"),Napi::Number::New(env,percentile(0.99)));
+  re.Set(Napi::String::New(env,"max"),Napi::Number::New(env,values.empty() ? 0 : values.back()));
+  Napi::Array histogram = Napi::Array::New(env,buckets.size());
+  for(uint32_t i = 0;i < buckets.size();i++) {histogram.Set(i,Napi::Number::New(env,buckets[i]));}
+  re.Set(Napi::String::New(env,"histogram"),histogram);
+  return re;
+}
+
+//======ͳ======
+Napi::Value createLaunchProfile(const Napi::CallbackInfo& args){
+  //ȡenv
+  Napi::Env env = args.Env();
+
+  return wrapHandle(env,new LaunchProfile(),0);
+}
+
+//======ͳԤ======
+//Ϊ(,ͳ)launchPackedͬͬʱ¼GPUʱύʱ
+Napi::Value launchPackedProfiled(const Napi::CallbackInfo& args){
+  //ȡenv
+  Napi::Env env = args.Env();
+
+  PackedLauncher * launcher = PackedLauncher::find((uint64_t)args[0].As<Napi::Number>().Int64Value());
+  if(launcher == NULL){
+    Napi::TypeError::New(env,"ڻѾͷ").ThrowAsJavaScriptException();
+    return env.Undefined();
+  }
+  LaunchProfile * profile = getHandle<LaunchProfile>(args[1]);
+  CUresult res = profile->record(launcher->stream,[launcher]{return launcher->launcher.launch_raw(launcher->ptrs.data());});
+  if(res != CUDA_SUCCESS){
+    const char* str;
+    cuGetErrorName(res, &str);
+    Napi::TypeError::New(env,str).ThrowAsJavaScriptException();
+  }
+  return env.Undefined();
+}
+
+//======ȡͳ======
+//Ϊ(ͳ,wait)waitΪtrueʱȴ
+//{launches,measured,pending,totalGpuTime,totalSubmitTime,gpu,submit}ʱ䵥λΪ΢룬gpusubmitΪkWindowķֲ
+Napi::Value getLaunchProfile(const Napi::CallbackInfo& args){
+  //ȡenv
+  Napi::Env env = args.Env();
+
+  LaunchProfile * profile = getHandle<LaunchProfile>(args[0]);
+  profile->collect(args.Length() > 1 && args[1].IsBoolean() && args[1].As<Napi::Boolean>().Value());
+  Napi::Object re = Napi::Object::New(env);
+  re.Set(Napi::String::New(env,"launches"),Napi::Number::New(env,(double)profile->launches));
+  re.Set(Napi::String::New(env,"measured"),Napi::Number::New(env,(double)profile->measured));
+  re.Set(Napi::String::New(env,"pending"),Napi::Number::New(env,(double)profile->pendingCount));
+  re.Set(Napi::String::New(env,"totalGpuTime"),Napi::Number::New(env,profile->totalGpu));
+  re.Set(Napi::String::New(env,"totalSubmitTime"),Napi::Number::New(env,profile->totalSubmit));
+  re.Set(Napi::String::New(env,"gpu"),launchProfileSummary(env,profile->gpuTimes));
+  re.Set(Napi::String::New(env,"submit"),launchProfileSummary(env,profile->submitTimes));
+  return re;
+}
+
+//======ͳ======
+//δɵȻɺ
+void resetLaunchProfile(const Napi::CallbackInfo& args){
+  LaunchProfile * profile = getHandle<LaunchProfile>(args[0]);
+  profile->gpuTimes.clear();
+  profile->submitTimes.clear();
+  profile->next = 0;
+  profile->launches = profile->pendingCount;
+  profile->measured = 0;
+  profile->totalGpu = 0;
+  profile->totalSubmit = 0;
+}
+
+
+
+
+//ύʹõDriverΪPackedLauncherΪύʱб
+struct BatchDriver {
+  std::vector<cudaStream_t> streams;
+  std::vector<std::pair<char *,size_t> > hosts;
+
+  bool resolve(uint32_t index,cudaStream_t * stream,std::string * error){
+    if(index == batch::kDefaultStream) {return true;}
+    if(index >= streams.size()){
+      *error = "ųΧ";
+      return false;
+    }
+    *stream = streams[index];
+    return true;
+  }
+
+  bool resolve(const batch::Address & address,uint64_t size,void ** ptr,std::string * error){
+    if(address.kind == batch::kDevice){
+      *ptr = (void *)address.value;
+      return true;
+    }
+    if(address.kind == batch::kHost && address.value < hosts.size() && size <= hosts[address.value].second && address.offset <= hosts[address.value].second - size){
+      *ptr = hosts[address.value].first + address.offset;
+      return true;
+    }
+    *error = "ַΧ";
+    return false;
+  }
+
+  bool launch(uint64_t handle,const batch::Dims * dims,uint32_t stream,std::string * error){
+    PackedLauncher * launcher = PackedLauncher::find(handle);
+    if(!launcher){
+      *error = "ڻѾͷ";
+      return false;
+    }
+    CUresult res;
+    if(dims == NULL && stream == batch::kDefaultStream){
+      res = launcher->launcher.launch_raw(launcher->ptrs.data());
+    }else{
+      cudaStream_t target = launcher->stream;
+      if(!resolve(stream,&target,error)) {return false;}
+      dim3 grid = dims ? dim3(dims->grid[0],dims->grid[1],dims->grid[2]) : launcher->grid_size;
+      dim3 block = dims ? dim3(dims->block[0],dims->block[1],dims->block[2]) : launcher->block_size;
+      res = launcher->launcher.launch_raw(grid,block,target,launcher->ptrs.data());
+    }
+    if(res != CUDA_SUCCESS){
+      const char* str;
+      cuGetErrorName(res, &str);
+      *error = str;
+      return false;
+    }
+    return true;
+  }
+
+  //ΪСˣֱӸֵĵλֽ
+  bool set_arg(uint64_t handle,uint32_t index,uint64_t value,std::string * error){
+    PackedLauncher * launcher = PackedLauncher::find(handle);
+    if(!launcher){
+      *error = "ڻѾͷ";
+      return false;
+    }
+    if(index >= launcher->layout.size()){
+      *error = "ųΧ";
+      return false;
+    }
+    size_t size = launcher->layout[index].size;
+    if(size > 8){
+      *error = "ύֻ޸8ֽڵĲ";
+      return false;
+    }
+    memcpy(launcher->ptrs[index],&value,size);
+    return true;
+  }
+
+  bool copy(const batch::Address & dst,const batch::Address & src,uint64_t size,uint32_t stream,std::string * error){
+    void * to = NULL;
+    void * from = NULL;
+    cudaStream_t target = 0;
+    if(!resolve(dst,size,&to,error) || !resolve(src,size,&from,error) || !resolve(stream,&target,error)) {return false;}
+    cudaError_t res = cudaMemcpyAsync(to,from,(size_t)size,cudaMemcpyDefault,target);
+    if(res != cudaSuccess){
+      *error = cudaGetErrorString(res);
+      return false;
+    }
+    return true;
+  }
+};
+
+//======ύ======
+//Ϊ(Uint32Array,б,ArrayBufferб)һεð˳ִʽcuda_batch.hpp
+//ִеʱ׳쳣֮ǰѾ
+Napi::Value submitBatch(const Napi::CallbackInfo& args){
+  //ȡenv
+  Napi::Env env = args.Env();
+
+  Napi::Uint32Array commands = args[0].As<Napi::Uint32Array>();
+  BatchDriver driver;
+  if(args.Length() > 1 && args[1].IsArray()){
+    auto streams = args[1].As<Napi::Array>();
+    for(uint32_t i = 0;i < streams.Length();i++){
+      driver.streams.push_back((cudaStream_t)streams.Get(i).As<Napi::Number>().Int64Value());
+    }
+  }
+  if(args.Length() > 2 && args[2].IsArray()){
+    auto hosts = args[2].As<Napi::Array>();
+    for(uint32_t i = 0;i < hosts.Length();i++){
+      Napi::ArrayBuffer buffer = hosts.Get(i).As<Napi::ArrayBuffer>();
+      driver.hosts.push_back(std::make_pair((char *)buffer.Data(),buffer.ByteLength()));
+    }
+  }
+
+  batch::Status status = batch::execute(commands.Data(),commands.ElementLength(),driver);
+  if(!status.ok){
+    Napi::TypeError::New(env,"" + std::to_string(status.command) + "ִʧ:" + status.error).ThrowAsJavaScriptException();
+    return env.Undefined();
+  }
+  return Napi::Number::New(env,(double)status.commands);
+}
+
+
+
+
+//======CUDAͼ======
+//ͼʵĿִͼͷʱ
+struct GraphHandle {
+  cudaGraph_t graph;
+  cudaGraphExec_t exec;
+  //ִ˳еĽڵ
+  std::vector<cudaGraphNode_t> nodes;
+  GraphHandle():graph(NULL),exec(NULL){}
+  ~GraphHandle(){
+    if(exec) {cudaGraphExecDestroy(exec);}
+    if(graph) {cudaGraphDestroy(graph);}
+  }
+};
+
+//ĵַnumberΪԴָ룬ArrayBufferΪڴ
+static void * copyPointer(Napi::Value value){
+  if(value.IsArrayBuffer()) {return value.As<Napi::ArrayBuffer>().Data();}
+  return (void *)value.As<Napi::Number>().Int64Value();
+}
+
+//======첽======
+//֪ͨڲʹãַΪԴָڴArrayBuffer
+void memcpyAsync(const Napi::CallbackInfo& args){
+  //ȡenv
+  Napi::Env env = args.Env();
+
+  void * dst = copyPointer(args[0]);
+  void * src = copyPointer(args[1]);
+  size_t size = (size_t)args[2].As<Napi::Number>().Int64Value();
+  cudaStream_t stream = (cudaStream_t)args[3].As<Napi::Number>().Int64Value();
+  NodeCudaError(env,cudaMemcpyAsync(dst,src,size,cudaMemcpyDefault,stream));
+}
+
+//======ʼ======
+//֮еͿֻ¼ͼУִ
+void graphBeginCapture(const Napi::CallbackInfo& args){
+  //ȡenv
+  Napi::Env env = args.Env();
+
+  cudaStream_t stream = (cudaStream_t)args[0].As<Napi::Number>().Int64Value();
+  //ڼԴʹ
+  NodeCudaError(env,cudaStreamBeginCapture(stream,cudaStreamCaptureModeRelaxed));
+}
+
+//============
+//ʵͼ{handle,nodes}nodesΪִ˳еĽڵ
+Napi::Value graphEndCapture(const Napi::CallbackInfo& args){
+  //ȡenv
+  Napi::Env env = args.Env();
+
+  cudaStream_t stream = (cudaStream_t)args[0].As<Napi::Number>().Int64Value();
+  cudaGraph_t graph = NULL;
+  cudaError_t error = cudaStreamEndCapture(stream,&graph);
+  if(error != cudaSuccess){
+    NodeCudaError(env,error);
+    return env.Undefined();
+  }
+  GraphHandle * object = new GraphHandle();
+  object->graph = graph;
+
+  //ϵڵ㣬вͼΪһ˳һ
+  size_t count = 0,edges = 0;
+  cudaGraphGetNodes(graph,NULL,&count);
+  cudaGraphGetEdges(graph,NULL,NULL,&edges);
+  std::vector<cudaGraphNode_t> nodes(count),from(edges),to(edges);
+  if(count) {cudaGraphGetNodes(graph,nodes.data(),&count);}
+  if(edges) {cudaGraphGetEdges(graph,from.data(),to.data(),&edges);}
+  std::map<cudaGraphNode_t,size_t> inputs;
+  for(size_t i = 0;i < edges;i++) {inputs[to[i]]++;}
+  std::deque<cudaGraphNode_t> ready;
+  for(size_t i = 0;i < count;i++){
+    if(!inputs[nodes[i]]) {ready.push_back(nodes[i]);}
+  }
+  while(!ready.empty()){
+    cudaGraphNode_t node = ready.front();
+    ready.pop_front();
+    object->nodes.push_back(node);
+    for(size_t i = 0;i < edges;i++){
+      if(from[i] == node && !--inputs[to[i]]) {ready.push_back(to[i]);}
+    }
+  }
+
+#if CUDART_VERSION >= 11040
+  error = cudaGraphInstantiateWithFlags(&object->exec,graph,0);
+#else
+  error = cudaGraphInstantiate(&object->exec,graph,NULL,NULL,0);
+#endif
+  if(error != cudaSuccess){
+    delete object;
+    NodeCudaError(env,error);
+    return env.Undefined();
+  }
+
+  Napi::Array types = Napi::Array::New(env,object->nodes.size());
+  for(uint32_t i = 0;i < object->nodes.size();i++){
+    cudaGraphNodeType type;
+    cudaGraphNodeGetType(object->nodes[i],&type);
+    const char * name = type == cudaGraphNodeTypeKernel ? "kernel" : type == cudaGraphNodeTypeMemcpy ? "memcpy" :
+      type == cudaGraphNodeTypeMemset ? "memset" : type == cudaGraphNodeTypeHost ? "host" : "other";
+    types.Set(i,Napi::String::New(env,name));
+  }
+  Napi::Object re = Napi::Object::New(env);
+  re.Set(Napi::String::New(env,"handle"),wrapHandle(env,object,0));
+  re.Set(Napi::String::New(env,"nodes"),types);
+  return re;
+}
+
+//======ͼ======
+//һεͼ
+void graphLaunch(const Napi::CallbackInfo& args){
+  //ȡenv
+  Napi::Env env = args.Env();
+
+  GraphHandle * graph = getHandle<GraphHandle>(args[0]);
+  cudaStream_t stream = (cudaStream_t)args[1].As<Napi::Number>().Int64Value();
+  NodeCudaError(env,cudaGraphLaunch(graph->exec,stream));
+}
+
+//======޸ĺĽڵ======
+//Ϊ(handle,ڵ,grid,block,,ƫ)gridblockΪnullʱֲ
+//ͬʱ޸Ŀִͼԭͼֻ֮޸ĲֲʱΪϴõֵ
+void graphSetKernelNode(const Napi::CallbackInfo& args){
+  //ȡenv
+  Napi::Env env = args.Env();
+
+  GraphHandle * graph = getHandle<GraphHandle>(args[0]);
+  uint32_t index = args[1].As<Napi::Number>().Uint32Value();
+  if(index >= graph->nodes.size()){
+    Napi::TypeError::New(env,"ڵųΧ").ThrowAsJavaScriptException();
+    return;
+  }
+  CUgraphNode node = (CUgraphNode)graph->nodes[index];
+  CUDA_KERNEL_NODE_PARAMS params;
+  CUresult res = cuGraphKernelNodeGetParams(node,&params);
+  if(res == CUDA_SUCCESS){
+    if(args[2].IsArray()){
+      auto sg = args[2].As<Napi::Array>();
+      params.gridDimX = sg.Get(0u).As<Napi::Number>().Uint32Value();
+      params.gridDimY = sg.Get(1u).As<Napi::Number>().Uint32Value();
+      params.gridDimZ = sg.Get(2u).As<Napi::Number>().Uint32Value();
+    }
+    if(args[3].IsArray()){
+      auto bg = args[3].As<Napi::Array>();
+      params.blockDimX = bg.Get(0u).As<Napi::Number>().Uint32Value();
+      params.blockDimY = bg.Get(1u).As<Napi::Number>().Uint32Value();
+      params.blockDimZ = bg.Get(2u).As<Napi::Number>().Uint32Value();
+    }
+    //ÿָ룬ʱḴƲֵ
+    std::vector<void *> ptrs;
+    if(args[4].IsArrayBuffer()){
+      char * data = (char *)args[4].As<Napi::ArrayBuffer>().Data();
+      auto offsets = args[5].As<Napi::Array>();
+      for(uint32_t i = 0;i < offsets.Length();i++){
+        ptrs.push_back(data + offsets.Get(i).As<Napi::Number>().Int64Value());
+      }
+      params.kernelParams = ptrs.empty() ? NULL : ptrs.data();
+      params.extra = NULL;
+    }
+    res = cuGraphExecKernelNodeSetParams((CUgraphExec)graph->exec,node,&params);
+  }
+  if(res == CUDA_SUCCESS){
+    res = cuGraphKernelNodeSetParams(node,&params);
+  }
+  if(res != CUDA_SUCCESS){
+    const char* str;
+    cuGetErrorName(res, &str);
+    Napi::TypeError::New(env,str).ThrowAsJavaScriptException();
+  }
+}
+
+//======޸Ŀڵ======
+//Ϊ(handle,ڵ,dst,src,size)ַmemcpyAsyncͬҪCUDA 11.1
+void graphSetMemcpyNode(const Napi::CallbackInfo& args){
+  //ȡenv
+  Napi::Env env = args.Env();
+
+  GraphHandle * graph = getHandle<GraphHandle>(args[0]);
+  uint32_t index = args[1].As<Napi::Number>().Uint32Value();
+  if(index >= graph->nodes.size()){
+    Napi::TypeError::New(env,"ڵųΧ").ThrowAsJavaScriptException();
+    return;
+  }
+#if CUDART_VERSION >= 11010
+  void * dst = copyPointer(args[2]);
+  void * src = copyPointer(args[3]);
+  size_t size = (size_t)args[4].As<Napi::Number>().Int64Value();
+  cudaError_t error = cudaGraphExecMemcpyNodeSetParams1D(graph->exec,graph->nodes[index],dst,src,size,cudaMemcpyDefault);
+  if(error == cudaSuccess){
+    error = cudaGraphMemcpyNodeSetParams1D(graph->nodes[index],dst,src,size,cudaMemcpyDefault);
+  }
+  NodeCudaError(env,error);
+#else
+  Napi::TypeError::New(env,"޸ĿڵҪCUDA 11.1").ThrowAsJavaScriptException();
+#endif
+}
+
+//======ͷͼ======
+void graphDestroy(const Napi::CallbackInfo& args){
+  //ȡenv
+  Napi::Env env = args.Env();
+
+  releaseNativeHandle(env,getNativeHandle<GraphHandle>(args[0]));
+}
+
+
+
 
 Napi::Value test(const Napi::CallbackInfo& args){
   //ȡenv
@@ -669,7 +2906,7 @@ Napi::Value test(const Napi::CallbackInfo& args){
   for(int i = 3;i < args.Length();i++){
     instance_args.push_back(args[i].As<Napi::String>().Utf8Value());
   }
-  jitify::experimental::Program * program = (jitify::experimental::Program *)args[0].As<Napi::Number>().Int64Value();
+  jitify::experimental::Program * program = getHandle<jitify::experimental::Program>(args[0]);
   auto kname = args[1].As<Napi::String>().Utf8Value();
 
   dim3 grid(1);
@@ -718,6 +2955,9 @@ Napi::Object CudaTest(const Napi::CallbackInfo& args){
 
 //ʼ
 Napi::Object Init(Napi::Env env, Napi::Object exports) {
+  //ǰjsݣʱԶͷ
+  env.SetInstanceData(new AddonData());
+
   //ʼcuda
   // void * buffer;
   // cudaMalloc(&buffer,1);
@@ -725,23 +2965,63 @@ Napi::Object Init(Napi::Env env, Napi::Object exports) {
   exports.Set(Napi::String::New(env, "CudaTest"),Napi::Function::New(env, CudaTest));
   exports.Set(Napi::String::New(env, "createProgram"),Napi::Function::New(env, createProgram));
   exports.Set(Napi::String::New(env, "createKernel"),Napi::Function::New(env, createKernel));
+  exports.Set(Napi::String::New(env, "createHeaderRegistry"),Napi::Function::New(env, createHeaderRegistry));
+  exports.Set(Napi::String::New(env, "headerRegistrySet"),Napi::Function::New(env, headerRegistrySet));
+  exports.Set(Napi::String::New(env, "headerRegistrySetPacked"),Napi::Function::New(env, headerRegistrySetPacked));
+  exports.Set(Napi::String::New(env, "headerRegistryRemove"),Napi::Function::New(env, headerRegistryRemove));
+  exports.Set(Napi::String::New(env, "getHeaderRegistryInfo"),Napi::Function::New(env, getHeaderRegistryInfo));
+  exports.Set(Napi::String::New(env, "getNvrtcCompileCount"),Napi::Function::New(env, getNvrtcCompileCount));
   exports.Set(Napi::String::New(env, "createInstance"),Napi::Function::New(env, createInstance));
+  exports.Set(Napi::String::New(env, "instantiateMany"),Napi::Function::New(env, instantiateMany));
   exports.Set(Napi::String::New(env, "createLauncher"),Napi::Function::New(env, createLauncher));
+  exports.Set(Napi::String::New(env, "getMaxOccupancy"),Napi::Function::New(env, getMaxOccupancy));
+  exports.Set(Napi::String::New(env, "createProgramAsync"),Napi::Function::New(env, createProgramAsync));
+  exports.Set(Napi::String::New(env, "createInstanceAsync"),Napi::Function::New(env, createInstanceAsync));
+  exports.Set(Napi::String::New(env, "compileBatch"),Napi::Function::New(env, compileBatch));
+  exports.Set(Napi::String::New(env, "setCompileThreads"),Napi::Function::New(env, setCompileThreads));
+  exports.Set(Napi::String::New(env, "getCompileThreads"),Napi::Function::New(env, getCompileThreads));
 
   exports.Set(Napi::String::New(env, "getInstancePTX"),Napi::Function::New(env, getInstancePTX));
   exports.Set(Napi::String::New(env, "serializeInstance"),Napi::Function::New(env, serializeInstance));
   exports.Set(Napi::String::New(env, "deserializeInstance"),Napi::Function::New(env, deserializeInstance));
+  exports.Set(Napi::String::New(env, "openBundle"),Napi::Function::New(env, openBundle));
+  exports.Set(Napi::String::New(env, "closeBundle"),Napi::Function::New(env, closeBundle));
+  exports.Set(Napi::String::New(env, "getBundleList"),Napi::Function::New(env, getBundleList));
+  exports.Set(Napi::String::New(env, "loadBundleInstance"),Napi::Function::New(env, loadBundleInstance));
+  exports.Set(Napi::String::New(env, "writeBundle"),Napi::Function::New(env, writeBundle));
 
   exports.Set(Napi::String::New(env, "createBuffer"),Napi::Function::New(env, createBuffer));
   exports.Set(Napi::String::New(env, "createBufferHost"),Napi::Function::New(env, createBufferHost));
   exports.Set(Napi::String::New(env, "writeBuffer"),Napi::Function::New(env, writeBuffer));
   exports.Set(Napi::String::New(env, "readBuffer"),Napi::Function::New(env, readBuffer));
   exports.Set(Napi::String::New(env, "freeBuffer"),Napi::Function::New(env, freeBuffer));
+  exports.Set(Napi::String::New(env, "shareBuffer"),Napi::Function::New(env, shareBuffer));
+  exports.Set(Napi::String::New(env, "openSharedBuffer"),Napi::Function::New(env, openSharedBuffer));
+  exports.Set(Napi::String::New(env, "revokeSharedBuffer"),Napi::Function::New(env, revokeSharedBuffer));
   exports.Set(Napi::String::New(env, "freeBufferHost"),Napi::Function::New(env, freeBufferHost));
+  exports.Set(Napi::String::New(env, "createHostArrayBuffer"),Napi::Function::New(env, createHostArrayBuffer));
+  exports.Set(Napi::String::New(env, "getBufferPoolStats"),Napi::Function::New(env, getBufferPoolStats));
+  exports.Set(Napi::String::New(env, "setBufferPoolHighWater"),Napi::Function::New(env, setBufferPoolHighWater));
+  exports.Set(Napi::String::New(env, "trimBufferPool"),Napi::Function::New(env, trimBufferPool));
+  exports.Set(Napi::String::New(env, "writeBufferAsync"),Napi::Function::New(env, writeBufferAsync));
+  exports.Set(Napi::String::New(env, "readBufferAsync"),Napi::Function::New(env, readBufferAsync));
+
+  exports.Set(Napi::String::New(env, "createStream"),Napi::Function::New(env, createStream));
+  exports.Set(Napi::String::New(env, "destroyStream"),Napi::Function::New(env, destroyStream));
+  exports.Set(Napi::String::New(env, "streamSynchronize"),Napi::Function::New(env, streamSynchronize));
+  exports.Set(Napi::String::New(env, "streamPromise"),Napi::Function::New(env, streamPromise));
 
   exports.Set(Napi::String::New(env, "createBuffer3D"),Napi::Function::New(env, createBuffer3D));
   exports.Set(Napi::String::New(env, "writeBuffer3D"),Napi::Function::New(env, writeBuffer3D));
   exports.Set(Napi::String::New(env, "readBuffer3D"),Napi::Function::New(env, readBuffer3D));
+  exports.Set(Napi::String::New(env, "writeBuffer3DAsync"),Napi::Function::New(env, writeBuffer3DAsync));
+  exports.Set(Napi::String::New(env, "readBuffer3DAsync"),Napi::Function::New(env, readBuffer3DAsync));
+  exports.Set(Napi::String::New(env, "createEvent"),Napi::Function::New(env, createEvent));
+  exports.Set(Napi::String::New(env, "destroyEvent"),Napi::Function::New(env, destroyEvent));
+  exports.Set(Napi::String::New(env, "eventRecord"),Napi::Function::New(env, eventRecord));
+  exports.Set(Napi::String::New(env, "eventQuery"),Napi::Function::New(env, eventQuery));
+  exports.Set(Napi::String::New(env, "eventSynchronize"),Napi::Function::New(env, eventSynchronize));
+  exports.Set(Napi::String::New(env, "eventElapsedTime"),Napi::Function::New(env, eventElapsedTime));
 
   exports.Set(Napi::String::New(env, "createArray3D"),Napi::Function::New(env, createArray3D));
   exports.Set(Napi::String::New(env, "writeArray3D"),Napi::Function::New(env, writeArray3D));
@@ -751,6 +3031,20 @@ Napi::Object Init(Napi::Env env, Napi::Object exports) {
 
   exports.Set(Napi::String::New(env, "runKernel"),Napi::Function::New(env, runKernel));
   exports.Set(Napi::String::New(env, "runLauncher"),Napi::Function::New(env, runLauncher));
+  exports.Set(Napi::String::New(env, "createPackedLauncher"),Napi::Function::New(env, createPackedLauncher));
+  exports.Set(Napi::String::New(env, "launchPacked"),Napi::Function::New(env, launchPacked));
+  exports.Set(Napi::String::New(env, "submitBatch"),Napi::Function::New(env, submitBatch));
+  exports.Set(Napi::String::New(env, "launchPackedProfiled"),Napi::Function::New(env, launchPackedProfiled));
+  exports.Set(Napi::String::New(env, "createLaunchProfile"),Napi::Function::New(env, createLaunchProfile));
+  exports.Set(Napi::String::New(env, "getLaunchProfile"),Napi::Function::New(env, getLaunchProfile));
+  exports.Set(Napi::String::New(env, "resetLaunchProfile"),Napi::Function::New(env, resetLaunchProfile));
+  exports.Set(Napi::String::New(env, "memcpyAsync"),Napi::Function::New(env, memcpyAsync));
+  exports.Set(Napi::String::New(env, "graphBeginCapture"),Napi::Function::New(env, graphBeginCapture));
+  exports.Set(Napi::String::New(env, "graphEndCapture"),Napi::Function::New(env, graphEndCapture));
+  exports.Set(Napi::String::New(env, "graphLaunch"),Napi::Function::New(env, graphLaunch));
+  exports.Set(Napi::String::New(env, "graphSetKernelNode"),Napi::Function::New(env, graphSetKernelNode));
+  exports.Set(Napi::String::New(env, "graphSetMemcpyNode"),Napi::Function::New(env, graphSetMemcpyNode));
+  exports.Set(Napi::String::New(env, "graphDestroy"),Napi::Function::New(env, graphDestroy));
   exports.Set(Napi::String::New(env, "runInstance"),Napi::Function::New(env, runInstance));
   exports.Set(Napi::String::New(env, "test"),Napi::Function::New(env, test));
   exports.Set(Napi::String::New(env, "getDeviceCount"),Napi::Function::New(env, getDeviceCount));
@@ -0,0 +1,166 @@
+#pragma once
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+//ύ
+//JS˰һ޸ĺͿΪUint32ArraysubmitBatchһεý벢ִֻԽһJSC++ı߽
+//ʽ(Ϊu3264λֵΪ32λ͸32λ)
+//  ÿĵһΪ  | ( << 8)һ
+//  LAUNCH       [ͷ, λ, λ, ]
+//  LAUNCH_DIMS  [ͷ, λ, λ, , grid.x, grid.y, grid.z, block.x, block.y, block.z]
+//  SET_ARG      [ͷ, λ, λ, , ֵλ, ֵλ]  ǩֽдֵĵλֽ
+//  COPY         [ͷ, Ŀַ(3), Դַ(3), ֽλ, ֽλ, ]
+//ΪcreatePackedLauncherصhandleΪύʱбеţkDefaultStreamʾõ(ΪĬ)
+//ַΪ [kDevice, ָλ, ָλ]  [kHost, , ڵƫ]ΪύʱArrayBufferб
+//ֻDriverӿڣcudaʹü¼õDriverûԿĻ²
+namespace batch {
+
+enum Op {
+  LAUNCH = 1,
+  LAUNCH_DIMS = 2,
+  SET_ARG = 3,
+  COPY = 4
+};
+
+//ÿΪ
+static const uint32_t kCommandWords[] = {0,4,10,6,10};
+static const uint32_t kDefaultStream = 0xFFFFFFFFu;
+static const uint32_t kDevice = 0;
+static const uint32_t kHost = 1;
+
+//ߴ
+struct Dims {
+  uint32_t grid[3];
+  uint32_t block[3];
+};
+
+//ĵַ
+struct Address {
+  uint32_t kind;
+  //kDeviceʱΪָ룬kHostʱΪ
+  uint64_t value;
+  //kHostʱΪڵƫ
+  uint64_t offset;
+  static Address device(uint64_t ptr) {Address re = {kDevice,ptr,0};return re;}
+  static Address host(uint32_t index,uint32_t offset) {Address re = {kHost,index,offset};return re;}
+};
+
+//ִнʱcommandΪ
+struct Status {
+  bool ok;
+  size_t commands;
+  size_t command;
+  std::string error;
+};
+
+//index.jsеCudaCommandBufferͬC++Ͳ
+class Encoder {
+  std::vector<uint32_t> _words;
+
+  void header(Op op) {_words.push_back((uint32_t)op | (kCommandWords[op] << 8));}
+  void u64(uint64_t value){
+    _words.push_back((uint32_t)value);
+    _words.push_back((uint32_t)(value >> 32));
+  }
+  void address(const Address & value){
+    _words.push_back(value.kind);
+    if(value.kind == kDevice){
+      u64(value.value);
+    }else{
+      _words.push_back((uint32_t)value.value);
+      _words.push_back((uint32_t)value.offset);
+    }
+  }
+
+public:
+  void launch(uint64_t launcher,uint32_t stream = kDefaultStream){
+    header(LAUNCH);
+    u64(launcher);
+    _words.push_back(stream);
+  }
+  void launch(uint64_t launcher,const Dims & dims,uint32_t stream = kDefaultStream){
+    header(LAUNCH_DIMS);
+    u64(launcher);
+    _words.push_back(stream);
+    _words.insert(_words.end(),dims.grid,dims.grid + 3);
+    _words.insert(_words.end(),dims.block,dims.block + 3);
+  }
+  void set_arg(uint64_t launcher,uint32_t index,uint64_t value){
+    header(SET_ARG);
+    u64(launcher);
+    _words.push_back(index);
+    u64(value);
+  }
+  void copy(const Address & dst,const Address & src,uint64_t size,uint32_t stream = kDefaultStream){
+    header(COPY);
+    address(dst);
+    address(src);
+    u64(size);
+    _words.push_back(stream);
+  }
+  const std::vector<uint32_t> & words() const {return _words;}
+  void clear() {_words.clear();}
+};
+
+//˳ִʱֹ֮ͣǰѾ
+//DriverҪʵ֣
+//  bool launch(uint64_t launcher,const Dims * dims,uint32_t stream,std::string * error)  dimsΪNULLʱʹõĳߴ
+//  bool set_arg(uint64_t launcher,uint32_t index,uint64_t value,std::string * error)
+//  bool copy(const Address & dst,const Address & src,uint64_t size,uint32_t stream,std::string * error)
+template <class Driver>
+Status execute(const uint32_t * words,size_t count,Driver & driver){
+  Status status = {true,0,0,""};
+  size_t pos = 0;
+  while(pos < count){
+    const uint32_t * cmd = words + pos;
+    uint32_t op = cmd[0] & 0xFF;
+    uint32_t size = cmd[0] >> 8;
+    status.command = status.commands;
+    if(op < LAUNCH || op > COPY || size != kCommandWords[op] || pos + size > count){
+      status.ok = false;
+      status.error = "ʽ";
+      return status;
+    }
+    uint64_t launcher = cmd[1] | ((uint64_t)cmd[2] << 32);
+    bool ok = false;
+    switch(op){
+      case LAUNCH:
+        ok = driver.launch(launcher,NULL,cmd[3],&status.error);
+        break;
+      case LAUNCH_DIMS:{
+        Dims dims;
+        for(int i = 0;i < 3;i++){
+          dims.grid[i] = cmd[4 + i];
+          dims.block[i] = cmd[7 + i];
+        }
+        ok = driver.launch(launcher,&dims,cmd[3],&status.error);
+        break;
+      }
+      case SET_ARG:
+        ok = driver.set_arg(launcher,cmd[3],cmd[4] | ((uint64_t)cmd[5] << 32),&status.error);
+        break;
+      case COPY:{
+        Address address[2];
+        for(int i = 0;i < 2;i++){
+          const uint32_t * a = cmd + 1 + i * 3;
+          address[i].kind = a[0];
+          address[i].value = a[0] == kDevice ? (a[1] | ((uint64_t)a[2] << 32)) : a[1];
+          address[i].offset = a[0] == kDevice ? 0 : a[2];
+        }
+        ok = driver.copy(address[0],address[1],cmd[7] | ((uint64_t)cmd[8] << 32),cmd[9],&status.error);
+        break;
+      }
+    }
+    if(!ok){
+      status.ok = false;
+      return status;
+    }
+    status.commands++;
+    pos += size;
+  }
+  return status;
+}
+
+}
@@ -0,0 +1,303 @@
+#pragma once
+
+#include <stdint.h>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#if defined(_WIN32) || defined(_WIN64)
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+//Ĵļ
+//Ѷõʵ(PTXͶӦܹcubin)Ϊһļͨmmap򿪣ֻõĺĲŻᱻȡ
+//ļʽ(ΪС)
+//  ļͷ 48ֽڣ
+//    char magic[8] = "NVRTCBDL"
+//    u64 version
+//    u64 entry_count
+//    u64 index_offset  λ
+//    u64 file_size     ڼļǷ
+//    u64 reserved
+//   ÿʵ kFieldCount  (u64 offset,u64 size) ֶΣΪ
+//    ơģ(\nָ)Ŀܹ(sm_75PTXӦܹcubinļܹûָʱΪ)ĺPTXcubinļ(\nָ)Ŀ¼(\nָ)
+//   ÿݰ kAlignment ֽڶ룬PTXĩβ\0ֱΪַʹ
+//дcudaûԿĻ²
+namespace bundle {
+
+//ļеһݣָmmapڴ棬Ḵ
+struct Blob {
+  const char * data;
+  size_t size;
+  std::string str() const {return std::string(data,size);}
+  bool operator==(const std::string & value) const {return size == value.size() && memcmp(data,value.data(),size) == 0;}
+};
+
+//һʵ
+struct Entry {
+  std::string name;
+  std::vector<std::string> templates;
+  std::string arch;
+  std::string func_name;
+  std::string ptx;
+  std::string cubin;
+  std::vector<std::string> link_files;
+  std::vector<std::string> link_paths;
+};
+
+static const char kMagic[8] = {'N','V','R','T','C','B','D','L'};
+static const uint64_t kVersion = 1;
+static const size_t kHeaderSize = 48;
+static const size_t kFieldCount = 8;
+static const size_t kAlignment = 64;
+
+enum Field {NAME,TEMPLATES,ARCH,FUNC_NAME,PTX,CUBIN,LINK_FILES,LINK_PATHS};
+
+inline std::string join(const std::vector<std::string> & list){
+  std::string re;
+  for(size_t i = 0;i < list.size();i++) {re += (i ? "\n" : "") + list[i];}
+  return re;
+}
+
+inline std::vector<std::string> split(const std::string & value){
+  std::vector<std::string> re;
+  if(value.empty()) {return re;}
+  size_t start = 0,end;
+  while((end = value.find('\n',start)) != std::string::npos){
+    re.push_back(value.substr(start,end - start));
+    start = end + 1;
+  }
+  re.push_back(value.substr(start));
+  return re;
+}
+
+inline void put_u64(std::string & out,size_t pos,uint64_t value){
+  for(int i = 0;i < 8;i++) {out[pos + i] = (char)(unsigned char)(value >> (i * 8));}
+}
+
+inline uint64_t get_u64(const char * data){
+  uint64_t value = 0;
+  for(int i = 0;i < 8;i++) {value |= uint64_t((unsigned char)data[i]) << (i * 8);}
+  return value;
+}
+
+//ļд
+class Writer {
+  std::vector<Entry> entries;
+
+public:
+  void add(const Entry & entry) {entries.push_back(entry);}
+
+  size_t size() const {return entries.size();}
+
+  //ɴļ
+  std::string str() const {
+    size_t indexSize = entries.size() * kFieldCount * 16;
+    std::string out(kHeaderSize + indexSize,'\0');
+    memcpy(&out[0],kMagic,8);
+    put_u64(out,8,kVersion);
+    put_u64(out,16,entries.size());
+    put_u64(out,24,kHeaderSize);
+    for(size_t i = 0;i < entries.size();i++){
+      const Entry & entry = entries[i];
+      std::string fields[kFieldCount] = {entry.name,join(entry.templates),entry.arch,entry.func_name,entry.ptx,entry.cubin,join(entry.link_files),join(entry.link_paths)};
+      for(size_t j = 0;j < kFieldCount;j++){
+        out.resize((out.size() + kAlignment - 1) / kAlignment * kAlignment,'\0');
+        size_t field = kHeaderSize + (i * kFieldCount + j) * 16;
+        put_u64(out,field,out.size());
+        put_u64(out,field + 8,fields[j].size());
+        out += fields[j];
+        //ַĩβ\0
+        out += '\0';
+      }
+    }
+    put_u64(out,32,out.size());
+    return out;
+  }
+
+  //дļʧʱ׳쳣
+  void write(const std::string & path) const {
+    std::string data = str();
+    std::ofstream file(path.c_str(),std::ios::out | std::ios::binary | std::ios::trunc);
+    file.write(data.data(),data.size());
+    if(!file.good()) {throw std::runtime_error("дļʧ:" + path);}
+  }
+};
+
+//ļĶȡͨmmap򿪣ҲֱӶȡڴе
+class Reader {
+  const char * data;
+  size_t length;
+  size_t count;
+  //mmapڴ棬ʹڴʱΪ
+  void * mapped;
+#if defined(_WIN32) || defined(_WIN64)
+  HANDLE mapping;
+#endif
+  //ƺģʵ
+  std::multimap<std::string,size_t> lookup;
+
+  void parse(){
+    if(length < kHeaderSize || memcmp(data,kMagic,8) != 0) {throw std::runtime_error("Ǵļ");}
+    if(get_u64(data + 8) != kVersion) {throw std::runtime_error("ֵ֧Ĵļ汾");}
+    count = (size_t)get_u64(data + 16);
+    uint64_t indexOffset = get_u64(data + 24);
+    if(get_u64(data + 32) != length) {throw std::runtime_error("ļ");}
+    if(indexOffset > length || count > (length - indexOffset) / (kFieldCount * 16)) {throw std::runtime_error("ļ");}
+    for(size_t i = 0;i < count;i++){
+      for(size_t j = 0;j < kFieldCount;j++){
+        const char * field = data + indexOffset + (i * kFieldCount + j) * 16;
+        uint64_t offset = get_u64(field),size = get_u64(field + 8);
+        if(offset > length || size >= length - offset) {throw std::runtime_error("ļԽ");}
+      }
+      lookup.insert(std::make_pair(key(get(i,NAME).str(),get(i,TEMPLATES).str()),i));
+    }
+  }
+
+  static std::string key(const std::string & name,const std::string & templates){
+    return name + '\0' + templates;
+  }
+
+public:
+  //ȡڴеĴݣҪReaderʹڼ䱣Ч
+  Reader(const char * data,size_t length):data(data),length(length),count(0),mapped(NULL){
+#if defined(_WIN32) || defined(_WIN64)
+    mapping = NULL;
+#endif
+    parse();
+  }
+
+  //ͨmmap򿪴ļʧʱ׳쳣
+  explicit Reader(const std::string & path):data(NULL),length(0),count(0),mapped(NULL){
+#if defined(_WIN32) || defined(_WIN64)
+    mapping = NULL;
+    HANDLE file = CreateFileA(path.c_str(),GENERIC_READ,FILE_SHARE_READ,NULL,OPEN_EXISTING,FILE_ATTRIBUTE_NORMAL,NULL);
+    if(file == INVALID_HANDLE_VALUE) {throw std::runtime_error("޷򿪴ļ:" + path);}
+    LARGE_INTEGER size;
+    GetFileSizeEx(file,&size);
+    length = (size_t)size.QuadPart;
+    mapping = length ? CreateFileMappingA(file,NULL,PAGE_READONLY,0,0,NULL) : NULL;
+    CloseHandle(file);
+    mapped = mapping ? MapViewOfFile(mapping,FILE_MAP_READ,0,0,0) : NULL;
+#else
+    int file = open(path.c_str(),O_RDONLY);
+    if(file < 0) {throw std::runtime_error("޷򿪴ļ:" + path);}
+    struct stat info;
+    fstat(file,&info);
+    length = (size_t)info.st_size;
+    mapped = length ? mmap(NULL,length,PROT_READ,MAP_PRIVATE,file,0) : NULL;
+    if(mapped == MAP_FAILED) {mapped = NULL;}
+    close(file);
+#endif
+    if(mapped == NULL){
+      close_mapping();
+      throw std::runtime_error("޷ӳļ:" + path);
+    }
+    data = (const char *)mapped;
+    try{
+      parse();
+    }catch(...){
+      close_mapping();
+      throw;
+    }
+  }
+
+  Reader(const Reader &) = delete;
+  Reader & operator=(const Reader &) = delete;
+
+  ~Reader(){
+    close_mapping();
+  }
+
+  void close_mapping(){
+#if defined(_WIN32) || defined(_WIN64)
+    if(mapped != NULL) {UnmapViewOfFile(mapped);}
+    if(mapping != NULL) {CloseHandle(mapping);}
+    mapping = NULL;
+#else
+    if(mapped != NULL) {munmap(mapped,length);}
+#endif
+    mapped = NULL;
+  }
+
+  size_t size() const {return count;}
+
+  //indexʵһֶ
+  Blob get(size_t index,Field field) const {
+    const char * item = data + get_u64(data + 24) + (index * kFieldCount + field) * 16;
+    Blob blob = {data + get_u64(item),(size_t)get_u64(item + 8)};
+    return blob;
+  }
+
+  //ȡindexʵֶΣcubinֻڼܹarchͬʱƣʵݲᱻȡ
+  Entry entry(size_t index,const std::string & arch) const {
+    Entry re;
+    re.name = get(index,NAME).str();
+    re.templates = split(get(index,TEMPLATES).str());
+    re.arch = get(index,ARCH).str();
+    re.func_name = get(index,FUNC_NAME).str();
+    re.ptx = get(index,PTX).str();
+    if(!arch.empty() && re.arch == arch) {re.cubin = get(index,CUBIN).str();}
+    re.link_files = split(get(index,LINK_FILES).str());
+    re.link_paths = split(get(index,LINK_PATHS).str());
+    return re;
+  }
+
+  //ܹıţsm_75Ϊ75sm_XXcompute_XXʽʱ-1
+  static int arch_number(const std::string & arch){
+    size_t pos = arch.find('_');
+    if(pos == std::string::npos || pos + 1 >= arch.size()) {return -1;}
+    int number = 0;
+    for(size_t i = pos + 1;i < arch.size();i++){
+      if(arch[i] < '0' || arch[i] > '9') {return -1;}
+      number = number * 10 + (arch[i] - '0');
+    }
+    return number;
+  }
+
+  //archcubinܷdeviceܹ豸ϼأ汾ͬҴΰ汾豸
+  //sm_100Ϊ汾10׺ļܹ(sm_90a)ֻȫͬļܹϼ
+  static bool cubin_compatible(const std::string & arch,const std::string & device){
+    if(!arch.empty() && arch == device) {return true;}
+    int number = arch_number(arch),target = arch_number(device);
+    return number >= 0 && target >= 0 && number / 10 == target / 10 && number <= target;
+  }
+
+  //Ƿƺģͬʵ(Ǽܹ)
+  bool contains(const std::string & name,const std::vector<std::string> & templates) const {
+    return lookup.count(key(name,join(templates))) > 0;
+  }
+
+  //ʵȷؼܹΪarchʵǲarch߼ܹ(PTXڸµ豸ϱ)ûмܹĴPTXʵ
+  //archΪʱصһʵʵļܹarchʱ޷ʹã-1
+  long find(const std::string & name,const std::vector<std::string> & templates,const std::string & arch = "") const {
+    auto range = lookup.equal_range(key(name,join(templates)));
+    long ptxOnly = -1,compatible = -1;
+    int target = arch_number(arch),best = -1;
+    for(auto it = range.first;it != range.second;++it){
+      if(arch.empty()) {return (long)it->second;}
+      std::string entryArch = get(it->second,ARCH).str();
+      if(entryArch == arch) {return (long)it->second;}
+      if(entryArch.empty()){
+        if(ptxOnly < 0) {ptxOnly = (long)it->second;}
+        continue;
+      }
+      int number = arch_number(entryArch);
+      if(target >= 0 && number >= 0 && number <= target && number > best){
+        best = number;
+        compatible = (long)it->second;
+      }
+    }
+    return compatible >= 0 ? compatible : ptxOnly;
+  }
+};
+
+}  // namespace bundle
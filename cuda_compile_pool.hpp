@@ -0,0 +1,153 @@
+#pragma once
+
+#include <stdint.h>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+
+//̳߳
+//ͨÿ߳ԼĶУ߳̿ʱ̵߳Ķĩβȡ
+//ȼ0ڹȶУ̶ִ߳Уʹ״ҪĺĿԲ
+//NVRTCڶ߳ͬʱ룬ʵʱк
+class CompilePool {
+public:
+  typedef std::function<void()> Job;
+
+private:
+  //ȼͬʱύִ
+  struct PriorityJob {
+    int priority;
+    uint64_t order;
+    Job job;
+    bool operator<(const PriorityJob & other) const {
+      return priority != other.priority ? priority < other.priority : order > other.order;
+    }
+  };
+
+  //ÿ߳ԼУα룬вֱmutex
+  std::vector<std::deque<Job> > workers;
+  std::priority_queue<PriorityJob> urgent;
+  //гԱ
+  std::mutex mutex;
+  std::condition_variable cv;
+  //߳˳ʱ֪ͨʱȴ߳˳
+  std::condition_variable exited;
+  //ûб߳ȡ
+  size_t pending;
+  uint64_t order;
+  size_t next;
+  //̵߳Ĵresizeɴ߳ɵǰ˳
+  uint64_t generation;
+  //ǰ߳ͻû˳߳(ɴ)
+  size_t count;
+  size_t alive;
+  bool stop;
+
+  //ԼĶͷȡûʱ̵߳Ķβȡ
+  bool take(size_t self,Job & job){
+    for(size_t i = 0;i < workers.size();i++){
+      std::deque<Job> & jobs = workers[(self + i) % workers.size()];
+      if(jobs.empty()) {continue;}
+      if(i == 0){
+        job = std::move(jobs.front());
+        jobs.pop_front();
+      }else{
+        job = std::move(jobs.back());
+        jobs.pop_back();
+      }
+      return true;
+    }
+    return false;
+  }
+
+  void run(size_t self,uint64_t gen){
+    std::unique_lock<std::mutex> lock(mutex);
+    while(true){
+      cv.wait(lock,[this,gen]{return stop || gen != generation || pending > 0;});
+      if(stop || gen != generation) {break;}
+      //ȡһpending0ʱһ
+      pending--;
+      Job job;
+      if(!urgent.empty()){
+        job = std::move(const_cast<PriorityJob &>(urgent.top()).job);
+        urgent.pop();
+      }else{
+        take(self,job);
+      }
+      lock.unlock();
+      job();
+      lock.lock();
+    }
+    alive--;
+    exited.notify_all();
+  }
+
+  //mutexеãһ̲߳ԭе·
+  void start_locked(size_t threads){
+    if(threads < 1) {threads = 1;}
+    std::vector<std::deque<Job> > old;
+    old.swap(workers);
+    workers.resize(threads);
+    for(size_t i = 0;i < old.size();i++){
+      for(auto & job : old[i]) {workers[(next++) % threads].push_back(std::move(job));}
+    }
+    generation++;
+    count = threads;
+    alive += threads;
+    for(size_t i = 0;i < threads;i++) {std::thread(&CompilePool::run,this,i,generation).detach();}
+  }
+
+public:
+  //countΪ0ʱʹCPU
+  explicit CompilePool(size_t threads = 0):pending(0),order(0),next(0),generation(0),count(0),alive(0),stop(false){
+    std::lock_guard<std::mutex> lock(mutex);
+    start_locked(threads ? threads : default_threads());
+  }
+  ~CompilePool(){
+    std::unique_lock<std::mutex> lock(mutex);
+    stop = true;
+    cv.notify_all();
+    exited.wait(lock,[this]{return alive == 0;});
+  }
+
+  static size_t default_threads(){
+    size_t threads = std::thread::hardware_concurrency();
+    return threads ? threads : 1;
+  }
+
+  //ύpriorityԽԽִ
+  void submit(Job job,int priority = 0){
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      if(priority > 0){
+        PriorityJob item = {priority,order++,std::move(job)};
+        urgent.push(std::move(item));
+      }else{
+        workers[(next++) % workers.size()].push_back(std::move(job));
+      }
+      pending++;
+    }
+    cv.notify_one();
+  }
+
+  //޸߳ȴԭִ̣߳е˳еᱣµ߳
+  void resize(size_t threads){
+    if(threads == 0) {threads = default_threads();}
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      if(threads == count) {return;}
+      start_locked(threads);
+    }
+    cv.notify_all();
+  }
+
+  size_t size(){
+    std::lock_guard<std::mutex> lock(mutex);
+    return count;
+  }
+};
@@ -0,0 +1,203 @@
+#pragma once
+
+#include <stdint.h>
+#include <algorithm>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+//Դ滺
+//ͷŵԴ水λ(1MBΪ2ݴ)ÿ豸ĿбУ´ͬλʱֱӸãcudaMalloc/cudaFreeͬ
+//BackendΪʵʵķҪṩ
+//  bool allocate(void ** ptr,size_t size,int device)
+//  void free(void * ptr,int device)
+//  Fence fence(int device)          Ǹ豸ĿǰѾ
+//  bool ready(Fence & fence)        ֮ǰǷɣɺͷfenceռõԴ
+//  void wait(Fence & fence)         ȴ֮ǰɲͷԴ
+//˿滻ΪٵķûԿĻ²ԺͲ
+//ͷŵԴȽȴбfence(ͷǰĺ˺Ϳִ)ŷб
+template <class Backend>
+class CachingAllocator {
+public:
+  //ͳϢ
+  struct Stats {
+    //л
+    size_t hits;
+    //Ҫʵʷ
+    size_t misses;
+    //пеֽ
+    size_t cached_bytes;
+    //ʹõֽ(λ)
+    size_t in_use_bytes;
+    //ʹõĻʵֽ
+    size_t requested_bytes;
+    //λȡ˷ѵֽ in_use_bytes - requested_bytes
+    size_t fragmentation_bytes;
+    //ӻʵͷŵĻ
+    size_t trimmed;
+    //Ѿͷŵǻڵȴɵֽ
+    size_t pending_bytes;
+  };
+
+private:
+  //һʹõĻ
+  struct Block {
+    int device;
+    size_t bin_size;
+    size_t requested;
+  };
+  //һȴɵĻ
+  struct Pending {
+    void * ptr;
+    int device;
+    size_t bin_size;
+    typename Backend::Fence fence;
+  };
+  //ÿ豸ĿбλС
+  typedef std::map<size_t,std::vector<void *> > FreeBins;
+
+  Backend backend;
+  std::map<int,FreeBins> free_bins;
+  std::deque<Pending> pending;
+  std::unordered_map<void *,Block> live;
+  size_t high_water;
+  Stats stats;
+  std::mutex mutex;
+
+  //fenceѾɵĻбwaitΪtrueʱȴdevice(-1Ϊ豸)л
+  //ͬһ豸fenceͷ˳ͬǰûʱҲɣÿ豸ֻѯһδɵfence
+  void collect_locked(bool wait,int device){
+    std::vector<int> blocked;
+    for(auto it = pending.begin();it != pending.end();){
+      bool match = device < 0 || it->device == device;
+      if(match && wait) {backend.wait(it->fence);}
+      else if(std::find(blocked.begin(),blocked.end(),it->device) != blocked.end()) {++it;continue;}
+      else if(!backend.ready(it->fence)) {blocked.push_back(it->device);++it;continue;}
+      free_bins[it->device][it->bin_size].push_back(it->ptr);
+      stats.pending_bytes -= it->bin_size;
+      stats.cached_bytes += it->bin_size;
+      it = pending.erase(it);
+    }
+  }
+
+  //ͷŻֱtargetֽڣdeviceΪ-1ʱ豸ĵλʼͷ
+  void trim_locked(size_t target,int device){
+    for(auto & dev : free_bins){
+      if(device >= 0 && dev.first != device) {continue;}
+      FreeBins & bins = dev.second;
+      for(auto bin = bins.rbegin();bin != bins.rend() && stats.cached_bytes > target;++bin){
+        while(!bin->second.empty() && stats.cached_bytes > target){
+          backend.free(bin->second.back(),dev.first);
+          bin->second.pop_back();
+          stats.cached_bytes -= bin->first;
+          stats.trimmed++;
+        }
+      }
+    }
+  }
+
+public:
+  //Сĵλ
+  static const size_t kMinBinSize = 512;
+
+  //high_waterΪԴ(ֽ)0Ϊ
+  explicit CachingAllocator(size_t high_water = 0,Backend backend = Backend())
+    : backend(backend),high_water(high_water){
+    stats = Stats();
+  }
+  ~CachingAllocator(){
+    std::lock_guard<std::mutex> lock(mutex);
+    collect_locked(true,-1);
+    trim_locked(0,-1);
+  }
+
+  //1MBϵĵλÿ2ݴٷΪ4ٴ󻺳ȡ˷ѵԴ
+  static const size_t kLargeBinSize = 1 << 20;
+
+  //ֽڵĵλ
+  static size_t bin_size(size_t size){
+    size_t bin = kMinBinSize;
+    while(bin < size) {bin <<= 1;}
+    if(bin <= kLargeBinSize) {return bin;}
+    size_t step = bin / 8;
+    return (size + step - 1) / step * step;
+  }
+
+  //Դ棬ʧʱNULL
+  void * allocate(size_t size,int device){
+    std::lock_guard<std::mutex> lock(mutex);
+    collect_locked(false,-1);
+    size_t bin = bin_size(size);
+    void * ptr = NULL;
+    std::vector<void *> & list = free_bins[device][bin];
+    if(!list.empty()){
+      ptr = list.back();
+      list.pop_back();
+      stats.cached_bytes -= bin;
+      stats.hits++;
+    }else{
+      stats.misses++;
+      if(!backend.allocate(&ptr,bin,device)){
+        //Դ治ʱȴ豸ͷŵĻȫͷźһ
+        collect_locked(true,device);
+        trim_locked(0,device);
+        if(!backend.allocate(&ptr,bin,device)) {return NULL;}
+      }
+    }
+    Block block = {device,bin,size};
+    live[ptr] = block;
+    stats.in_use_bytes += bin;
+    stats.requested_bytes += size;
+    stats.fragmentation_bytes = stats.in_use_bytes - stats.requested_bytes;
+    return ptr;
+  }
+
+  //ԴŻػ棬ɻָ뷵false
+  //ԴfenceɺŻᱻã⻹ִеĺ˺첽ͼдѾ˵Դ
+  bool deallocate(void * ptr){
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = live.find(ptr);
+    if(it == live.end()) {return false;}
+    Block block = it->second;
+    live.erase(it);
+    stats.in_use_bytes -= block.bin_size;
+    stats.requested_bytes -= block.requested;
+    stats.fragmentation_bytes = stats.in_use_bytes - stats.requested_bytes;
+    Pending entry = {ptr,block.device,block.bin_size,backend.fence(block.device)};
+    pending.push_back(entry);
+    stats.pending_bytes += block.bin_size;
+    collect_locked(false,-1);
+    if(high_water && stats.cached_bytes > high_water){
+      trim_locked(high_water,-1);
+    }
+    return true;
+  }
+
+  //ͷŻֱtargetֽ
+  void trim(size_t target){
+    std::lock_guard<std::mutex> lock(mutex);
+    collect_locked(false,-1);
+    trim_locked(target,-1);
+  }
+
+  //ûޣ0Ϊ
+  void set_high_water(size_t bytes){
+    std::lock_guard<std::mutex> lock(mutex);
+    high_water = bytes;
+    if(high_water && stats.cached_bytes > high_water){
+      trim_locked(high_water,-1);
+    }
+  }
+
+  size_t get_high_water(){
+    std::lock_guard<std::mutex> lock(mutex);
+    return high_water;
+  }
+
+  Stats get_stats(){
+    std::lock_guard<std::mutex> lock(mutex);
+    return stats;
+  }
+};
@@ -0,0 +1,109 @@
+//ύ(cuda_batch.hpp)ıԺͲ٣ü¼õDrivercudaҪԿ
+//g++ -std=c++11 -O2 -I.. batch_benchmark.cc -o batch_benchmark && ./batch_benchmark
+#include <chrono>
+#include <cstdio>
+#include "../cuda_batch.hpp"
+
+//¼ÿεãfailAtΪҪģʧܵĵ
+struct RecordingDriver {
+  std::vector<std::string> calls;
+  size_t failAt;
+  RecordingDriver():failAt((size_t)-1){}
+
+  bool record(const std::string & call,std::string * error){
+    if(calls.size() == failAt){
+      *error = "ģĴ";
+      return false;
+    }
+    calls.push_back(call);
+    return true;
+  }
+  bool launch(uint64_t launcher,const batch::Dims * dims,uint32_t stream,std::string * error){
+    std::string call = "launch " + std::to_string(launcher) + " " + std::to_string(stream);
+    if(dims){
+      for(int i = 0;i < 3;i++) {call += " " + std::to_string(dims->grid[i]);}
+      for(int i = 0;i < 3;i++) {call += " " + std::to_string(dims->block[i]);}
+    }
+    return record(call,error);
+  }
+  bool set_arg(uint64_t launcher,uint32_t index,uint64_t value,std::string * error){
+    return record("set_arg " + std::to_string(launcher) + " " + std::to_string(index) + " " + std::to_string(value),error);
+  }
+  bool copy(const batch::Address & dst,const batch::Address & src,uint64_t size,uint32_t stream,std::string * error){
+    return record("copy " + std::to_string(dst.kind) + ":" + std::to_string(dst.value) + "+" + std::to_string(dst.offset) + " " +
+      std::to_string(src.kind) + ":" + std::to_string(src.value) + "+" + std::to_string(src.offset) + " " + std::to_string(size) + " " + std::to_string(stream),error);
+  }
+};
+
+//ֻDriverڲ
+struct CountingDriver {
+  size_t count;
+  uint64_t check;
+  CountingDriver():count(0),check(0){}
+  bool launch(uint64_t launcher,const batch::Dims * dims,uint32_t stream,std::string *) {count++;check += launcher + stream + (dims ? dims->grid[0] : 0);return true;}
+  bool set_arg(uint64_t launcher,uint32_t index,uint64_t value,std::string *) {count++;check += launcher + index + value;return true;}
+  bool copy(const batch::Address & dst,const batch::Address & src,uint64_t size,uint32_t,std::string *) {count++;check += dst.value + src.value + size;return true;}
+};
+
+int main(){
+  bool ok = true;
+  const uint64_t launcherA = 0x7f0012345678ull,launcherB = 0x7f0087654321ull;
+
+  //룬¼ĵҪͱһ
+  batch::Encoder encoder;
+  batch::Dims dims = {{64,1,1},{256,1,1}};
+  encoder.copy(batch::Address::device(0x700000001000ull),batch::Address::host(0,16),4096,1);
+  encoder.set_arg(launcherA,2,0x3fc00000);
+  encoder.launch(launcherA);
+  encoder.launch(launcherB,dims,0);
+  encoder.copy(batch::Address::host(1,0),batch::Address::device(0x700000002000ull),1024);
+  RecordingDriver recorder;
+  batch::Status status = batch::execute(encoder.words().data(),encoder.words().size(),recorder);
+  const char * expected[] = {
+    "copy 0:123145302315008+0 1:0+16 4096 1",
+    "set_arg 139638282147448 2 1069547520",
+    "launch 139638282147448 4294967295",
+    "launch 139640248288033 0 64 1 1 256 1 1",
+    "copy 1:1+0 0:123145302319104+0 1024 4294967295",
+  };
+  ok = ok && status.ok && status.commands == 5 && recorder.calls.size() == 5;
+  for(size_t i = 0;ok && i < 5;i++){
+    ok = recorder.calls[i] == expected[i];
+    if(!ok) {printf("mismatch %zu: %s\n",i,recorder.calls[i].c_str());}
+  }
+
+  //ʱͣڳ֮ǰѾִ
+  RecordingDriver failing;
+  failing.failAt = 3;
+  status = batch::execute(encoder.words().data(),encoder.words().size(),failing);
+  ok = ok && !status.ok && status.command == 3 && status.commands == 3 && failing.calls.size() == 3;
+  printf("fail at command %zu: %s\n",status.command,status.error.c_str());
+
+  //ضϺʹԽȡ
+  RecordingDriver truncated;
+  status = batch::execute(encoder.words().data(),encoder.words().size() - 1,truncated);
+  ok = ok && !status.ok && status.command == 4 && truncated.calls.size() == 4;
+  std::vector<uint32_t> broken = encoder.words();
+  broken[0] = batch::COPY | (3 << 8);
+  status = batch::execute(broken.data(),broken.size(),truncated);
+  ok = ok && !status.ok && status.command == 0;
+  printf("malformed: %s\n",status.error.c_str());
+
+  //ٶ
+  const int frames = 2000,launches = 30;
+  encoder.clear();
+  for(int i = 0;i < launches;i++){
+    encoder.set_arg(launcherA,0,0x700000001000ull + i * 256);
+    encoder.launch(launcherA);
+  }
+  CountingDriver counter;
+  auto time = std::chrono::steady_clock::now();
+  for(int i = 0;i < frames;i++){
+    status = batch::execute(encoder.words().data(),encoder.words().size(),counter);
+  }
+  double ms = std::chrono::duration<double,std::milli>(std::chrono::steady_clock::now() - time).count();
+  ok = ok && counter.count == (size_t)frames * launches * 2;
+  printf("decode: %zu commands in %.2fms (%.1fns each) check %llu\n",counter.count,ms,ms * 1e6 / counter.count,(unsigned long long)counter.check);
+  printf("check: %s\n",ok ? "ok" : "failed");
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,94 @@
+//ļĶдԺͲ٣ҪԿ
+//g++ -std=c++11 -O2 -I.. bundle_benchmark.cc -o bundle_benchmark && ./bundle_benchmark
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include "../cuda_bundle.hpp"
+
+int main(){
+  //ģʵÿʵPTX/cubinС
+  const int kernels = 200;
+  const size_t ptxSize = 200000,cubinSize = 100000;
+  const char * path = "bundle_benchmark.bundle";
+
+  bundle::Writer writer;
+  for(int i = 0;i < kernels;i++){
+    for(int sm = 0;sm < 2;sm++){
+      bundle::Entry entry;
+      entry.name = "kernel" + std::to_string(i);
+      entry.templates.push_back("float");
+      entry.templates.push_back(std::to_string(i % 4));
+      entry.arch = sm ? "sm_86" : "sm_75";
+      entry.func_name = "_Z" + entry.name;
+      entry.ptx = std::string(ptxSize,'a' + i % 26);
+      entry.cubin = std::string(cubinSize,'A' + sm);
+      entry.link_files.push_back("lib" + std::to_string(i) + ".a");
+      writer.add(entry);
+    }
+  }
+  auto time = std::chrono::steady_clock::now();
+  writer.write(path);
+  double write = std::chrono::duration<double,std::milli>(std::chrono::steady_clock::now() - time).count();
+
+  //ʱֻ
+  time = std::chrono::steady_clock::now();
+  bundle::Reader reader(path);
+  double open = std::chrono::duration<double,std::milli>(std::chrono::steady_clock::now() - time).count();
+
+  //һʵ
+  std::vector<std::string> templates;
+  templates.push_back("float");
+  templates.push_back("3");
+  time = std::chrono::steady_clock::now();
+  long index = reader.find("kernel7",templates,"sm_86");
+  bundle::Entry entry = reader.entry(index,"sm_86");
+  double load = std::chrono::duration<double,std::milli>(std::chrono::steady_clock::now() - time).count();
+
+  //ȡ
+  bool ok = reader.size() == kernels * 2 && entry.name == "kernel7" && entry.arch == "sm_86" &&
+    entry.func_name == "_Zkernel7" && entry.ptx == std::string(ptxSize,'h') && entry.cubin == std::string(cubinSize,'B') &&
+    entry.link_files.size() == 1 && entry.link_files[0] == "lib7.a" && entry.link_paths.empty();
+  //ûжӦܹʱܹʵcubin
+  bundle::Entry other = reader.entry(reader.find("kernel7",templates,"sm_90"),"sm_90");
+  ok = ok && other.cubin.empty() && other.ptx == entry.ptx;
+  ok = ok && reader.find("kernel7",std::vector<std::string>(),"sm_86") < 0;
+  //豸мܹʱҲõʵ
+  ok = ok && reader.find("kernel7",templates,"sm_70") < 0 && reader.contains("kernel7",templates);
+  ok = ok && reader.find("kernel7",templates) >= 0;
+  //ֻPTXʵκ豸ʹãпõcubinʱʹcubin
+  bundle::Writer mixed;
+  bundle::Entry ptxEntry = entry;
+  ptxEntry.arch = "";
+  ptxEntry.cubin = "";
+  mixed.add(ptxEntry);
+  mixed.add(entry);
+  std::string mixedData = mixed.str();
+  bundle::Reader mixedReader(mixedData.data(),mixedData.size());
+  ok = ok && mixedReader.find("kernel7",templates,"sm_70") == 0 && mixedReader.find("kernel7",templates,"sm_90") == 1;
+  //cubinΰ汾жܷأλļܹʹ׺ļܹҲȷȽ
+  ok = ok && bundle::Reader::cubin_compatible("sm_80","sm_86") && bundle::Reader::cubin_compatible("sm_86","sm_86") &&
+    !bundle::Reader::cubin_compatible("sm_86","sm_80") && !bundle::Reader::cubin_compatible("sm_75","sm_80");
+  ok = ok && bundle::Reader::cubin_compatible("sm_100","sm_103") && !bundle::Reader::cubin_compatible("sm_100","sm_120") &&
+    !bundle::Reader::cubin_compatible("sm_90","sm_100") && !bundle::Reader::cubin_compatible("sm_120","sm_100");
+  ok = ok && bundle::Reader::cubin_compatible("sm_90a","sm_90a") && !bundle::Reader::cubin_compatible("sm_90a","sm_90") &&
+    !bundle::Reader::cubin_compatible("","sm_90");
+  //PTXݶ벢\0β
+  bundle::Blob ptx = reader.get(index,bundle::PTX);
+  ok = ok && (ptx.data - reader.get(0,bundle::NAME).data) % bundle::kAlignment == 0 && ptx.data[ptx.size] == '\0';
+
+  printf("entries: %zu\n",reader.size());
+  printf("write: %.2fms open: %.3fms load one: %.3fms\n",write,open,load);
+  printf("check: %s\n",ok ? "ok" : "failed");
+
+  //𻵵ļ
+  std::string data = writer.str();
+  data.resize(data.size() - 1);
+  try{
+    bundle::Reader broken(data.data(),data.size());
+    ok = false;
+  }catch(std::runtime_error & e){
+    printf("truncated: %s\n",e.what());
+  }
+  remove(path);
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,49 @@
+//ѡ(jitify::detail::resolve_options)Ĳ٣ҪԿ
+//ԭÿʵѯ豸ܹ-stdƴѡַhashķʽԱ
+//g++ -std=c++11 -O2 -pthread -I.. -I<cuda>/include compile_profile_benchmark.cc -o compile_profile_benchmark -L<cuda>/lib64 -lcuda -lcudart -lnvrtc && ./compile_profile_benchmark
+#include <chrono>
+#include <cstdio>
+#include <vector>
+#include "../jitify.hpp"
+
+//ԭʵ֣ÿζѡ²ѯ豸
+uint64_t oldResolve(const std::vector<std::string> & kernelOptions,const std::vector<std::string> & programOptions){
+  std::vector<std::string> options = kernelOptions;
+  options.insert(options.end(),programOptions.begin(),programOptions.end());
+  if(!jitify::detail::has_cuda_arch_option(options)){
+    int device = jitify::detail::get_current_device();
+    options.push_back("-arch=compute_" + std::to_string(jitify::detail::detect_cuda_arch(device)));
+  }
+  jitify::detail::detect_and_add_cxx11_flag(options);
+  std::string options_string = jitify::reflection::reflect_list(options);
+  return jitify::detail::hash_larson64(options_string.c_str());
+}
+
+uint64_t newResolve(const std::vector<std::string> & kernelOptions,const std::vector<std::string> & programOptions){
+  std::vector<std::string> options = kernelOptions;
+  options.insert(options.end(),programOptions.begin(),programOptions.end());
+  return jitify::detail::resolve_options(options)->hash;
+}
+
+int main(){
+  const int count = 200000;
+  std::vector<std::string> programOptions = {"-I/usr/local/include","-I/opt/project/kernels/include","--use_fast_math","-DBLOCK_SIZE=256","-DUSE_HALF=1"};
+  std::vector<std::string> kernelOptions = {"-DTILE=16"};
+  cudaFree(0);
+
+  uint64_t check = 0;
+  auto time = std::chrono::steady_clock::now();
+  for(int i = 0;i < count;i++) {check ^= oldResolve(kernelOptions,programOptions);}
+  double old = std::chrono::duration<double,std::milli>(std::chrono::steady_clock::now() - time).count();
+
+  uint64_t check2 = 0;
+  time = std::chrono::steady_clock::now();
+  for(int i = 0;i < count;i++) {check2 ^= newResolve(kernelOptions,programOptions);}
+  double cached = std::chrono::duration<double,std::milli>(std::chrono::steady_clock::now() - time).count();
+
+  printf("%d resolves\n",count);
+  printf("old: %.2fms (%.3fus each)\n",old,old * 1000 / count);
+  printf("cached profile: %.2fms (%.3fus each)\n",cached,cached * 1000 / count);
+  printf("hash match: %s\n",check == check2 ? "yes" : "no");
+  return 0;
+}
@@ -0,0 +1,80 @@
+var NVRTC = require("../index.js");
+
+/**
+ * CUDA图的性能测试，对比每帧逐个启动和捕获为图后整体重放的CPU提交开销
+ * node examples/graph_benchmark.js
+ */
+
+/**每帧的核心数量 */
+var kernelCount = 20;
+/**测试的帧数 */
+var frameCount = 5000;
+/**数据元素数量 */
+var size = 1024;
+
+var code = `graph_program
+__global__
+void add_kernel(float* a, const float* b, float scale, int n) {
+    int i = blockIdx.x * blockDim.x + threadIdx.x;
+    if(i < n) a[i] += b[i] * scale;
+}`;
+
+var instantiate = new NVRTC.CudaProgram(code).createKernel("add_kernel").createInstantiate([]);
+var a = new NVRTC.CudaBuffer(size * 4);
+var b = new NVRTC.CudaBuffer(size * 4);
+var c = new NVRTC.CudaBuffer(size * 4);
+var input = new NVRTC.CudaHostBuffer(size * 4);
+var output = new NVRTC.CudaHostBuffer(size * 4);
+new Float32Array(input.arrayBuffer).fill(1);
+
+var graph = new NVRTC.CudaGraph();
+var stream = graph.stream;
+var launchers = [];
+for(var i = 0;i < kernelCount;i++){
+  launchers.push(instantiate.createLauncher([size / 256,1,1],[256,1,1],stream).bind(a,b,1,size));
+}
+
+/**一帧：上传输入、运行所有核心、下载结果 */
+function frame(){
+  b.writeDataAsync(input,stream);
+  for(var i = 0;i < kernelCount;i++){
+    launchers[i].launch();
+  }
+  a.readDataAsync(output,stream);
+}
+
+/**
+ * 测试一种提交方式
+ * @param {string} name 提交方式的名称
+ * @param {()=>void} submit 提交一帧
+ */
+function bench(name,submit){
+  for(var i = 0;i < 100;i++){
+    submit();
+  }
+  stream.synchronize();
+  var time = process.hrtime.bigint();
+  for(var i = 0;i < frameCount;i++){
+    submit();
+  }
+  var submitTime = Number(process.hrtime.bigint() - time) / 1e6;
+  stream.synchronize();
+  var totalTime = Number(process.hrtime.bigint() - time) / 1e6;
+  console.log(`${name}: 提交 ${(submitTime * 1000 / frameCount).toFixed(2)}us/帧，总计 ${(totalTime * 1000 / frameCount).toFixed(2)}us/帧`);
+}
+
+bench("逐个启动",frame);
+graph.capture(frame);
+console.log("图节点",graph.nodes.map(v => v.type).join(","));
+bench("图重放",() => graph.launch());
+
+//修改节点：第一个核心改为写入c，不需要重新捕获
+graph.setKernel(1,{args:[c,undefined,2]});
+graph.launch();
+stream.synchronize();
+var result = new Float32Array(size);
+c.readData(result.buffer);
+console.log("修改节点后c[0] =",result[0]);
+
+graph.destory();
+NVRTC.DestoryAllBuffer();
@@ -0,0 +1,85 @@
+var NVRTC = require("../index.js");
+
+/**
+ * 头文件查找的性能测试：node examples/include_benchmark.js
+ * 在同一个进程中对比静态扫描(默认)和逐个编译查找头文件(旧的方式，JITIFY_OPTIONS=-no-scan-includes)，
+ * 每种方式再对比js回调和头文件注册表(HeaderRegistry)两种头文件来源，最后输出NVRTC编译次数和耗时的对比
+ * 只需要NVRTC，不需要显卡
+ */
+
+/**头文件数量 */
+var headerCount = 40;
+
+/**模拟的头文件，每个头文件引用下一个头文件 */
+var headers = {};
+for(var i = 0;i < headerCount;i++){
+  var next = i + 1 < headerCount ? `#include "header_${i + 1}.h"` : "";
+  headers[`header_${i}.h`] = `#pragma once
+${next}
+/* #include "not_included.h" */
+#if 0
+#include "also_not_included.h"
+#endif
+__device__ float add_${i}(float v) { return v + ${i}; }
+`;
+}
+
+var code = `bench_program
+#include "header_0.h"
+__global__
+void my_kernel(float* data) {
+    data[threadIdx.x] = add_0(data[threadIdx.x]);
+}`;
+
+/**
+ * 创建程序并统计耗时
+ * @param {()=>any} create 创建程序
+ * @returns {{count:number,time:number}} NVRTC编译次数和创建程序的耗时(毫秒)
+ */
+function bench(create){
+  var count = NVRTC.getNvrtcCompileCount();
+  var time = process.hrtime.bigint();
+  create();
+  time = Number(process.hrtime.bigint() - time) / 1e6;
+  return {count:NVRTC.getNvrtcCompileCount() - count,time:time};
+}
+
+console.log(`头文件数量: ${headerCount}`);
+
+var registry = new NVRTC.HeaderRegistry(headers);
+/**每次创建使用不同的程序名称，避免命中任何缓存 */
+var round = 0;
+
+/**
+ * 使用一种头文件查找方式分别测试js回调和头文件注册表
+ * @param {string} options 创建程序时的JITIFY_OPTIONS
+ */
+function benchMode(options){
+  if(options){
+    process.env.JITIFY_OPTIONS = options;
+  }else{
+    delete process.env.JITIFY_OPTIONS;
+  }
+  var callbacks = 0;
+  var callback = bench(function(){
+    return new NVRTC.CudaProgram(code.replace("bench_program",`bench_program_${round++}`),function(filename){
+      callbacks++;
+      return headers[filename] || null;
+    });
+  });
+  var header = bench(function(){
+    return new NVRTC.CudaProgram(code.replace("bench_program",`bench_program_${round++}`),null,{headers:registry});
+  });
+  return {callback:callback,callbacks:callbacks,registry:header};
+}
+
+var before = benchMode("-no-scan-includes");
+var after = benchMode("");
+delete process.env.JITIFY_OPTIONS;
+
+console.log("| 头文件查找 | 头文件来源 | NVRTC编译次数 | 创建程序耗时(ms) | js回调次数 |");
+console.log("| --- | --- | --- | --- | --- |");
+for(var [name,result] of [["逐个编译(旧)",before],["静态扫描",after]]){
+  console.log(`| ${name} | js回调 | ${result.callback.count} | ${result.callback.time.toFixed(2)} | ${result.callbacks} |`);
+  console.log(`| ${name} | 头文件注册表 | ${result.registry.count} | ${result.registry.time.toFixed(2)} | 0 |`);
+}
@@ -0,0 +1,76 @@
+//̱߳ں˻(jitify::SharedObjectCache)Ĳ٣CPUģNVRTC룬ҪԿ
+//ԭڱڼһֱлķʽԱȣͬںӦб룬ͬںֻһ
+//g++ -std=c++11 -O2 -pthread -I.. -I<cuda>/include jit_cache_benchmark.cc -o jit_cache_benchmark -L<cuda>/lib64 -lcuda -lcudart -lnvrtc && ./jit_cache_benchmark
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <thread>
+#include <vector>
+#include "../jitify.hpp"
+
+//ģ룬ռCPUԼms
+static std::atomic<size_t> compiles(0);
+std::shared_ptr<uint64_t> fakeCompile(uint64_t key,int ms){
+  compiles++;
+  uint64_t x = key;
+  auto end = std::chrono::steady_clock::now() + std::chrono::milliseconds(ms);
+  while(std::chrono::steady_clock::now() < end){
+    for(int i = 0;i < 1000;i++) {x = x * 6364136223846793005ull + 1442695040888963407ull;}
+  }
+  return std::make_shared<uint64_t>(x);
+}
+
+//ԭķʽڼ
+struct GlobalLockCache {
+  jitify::ObjectCache<uint64_t,std::shared_ptr<uint64_t> > cache;
+  std::mutex mutex;
+  GlobalLockCache(size_t capacity):cache(capacity){}
+  std::shared_ptr<uint64_t> get(uint64_t key,int ms){
+    std::lock_guard<std::mutex> lock(mutex);
+    if(cache.contains(key)) {return cache.get(key);}
+    return cache.insert(key,fakeCompile(key,ms));
+  }
+};
+
+struct ShardedCache {
+  jitify::SharedObjectCache<uint64_t,uint64_t> cache;
+  ShardedCache(size_t capacity):cache(capacity){}
+  std::shared_ptr<uint64_t> get(uint64_t key,int ms){
+    return cache.get_or_build(key,[key,ms](size_t * weight){*weight = 0;return fakeCompile(key,ms);});
+  }
+};
+
+//ÿ߳kernelsںˣһ̹߳õ
+template <class Cache>
+double run(int threads,int kernels,int ms){
+  Cache cache(1024);
+  compiles = 0;
+  std::vector<std::thread> workers;
+  auto time = std::chrono::steady_clock::now();
+  for(int t = 0;t < threads;t++){
+    workers.push_back(std::thread([&cache,t,kernels,ms](){
+      for(int i = 0;i < kernels;i++){
+        uint64_t key = i % 2 ? (uint64_t)i : (uint64_t)(t + 1) * 100000 + i;
+        cache.get(key,ms);
+      }
+    }));
+  }
+  for(size_t i = 0;i < workers.size();i++) {workers[i].join();}
+  return std::chrono::duration<double,std::milli>(std::chrono::steady_clock::now() - time).count();
+}
+
+int main(){
+  const int kernels = 16;
+  const int ms = 5;
+  int cores = (int)std::thread::hardware_concurrency();
+  if(cores < 1) {cores = 1;}
+  for(int threads = 1;threads <= cores * 2;threads *= 2){
+    double locked = run<GlobalLockCache>(threads,kernels,ms);
+    size_t lockedCompiles = compiles;
+    double sharded = run<ShardedCache>(threads,kernels,ms);
+    size_t shardedCompiles = compiles;
+    printf("threads %d: global lock %.1fms (%.0f compiles/s) sharded %.1fms (%.0f compiles/s) compiles %zu/%zu\n",
+      threads,locked,lockedCompiles / locked * 1000,sharded,shardedCompiles / sharded * 1000,shardedCompiles,lockedCompiles);
+  }
+  return 0;
+}
@@ -0,0 +1,54 @@
+var NVRTC = require("../index.js");
+
+/**
+ * 启动开销的性能测试，对比run(每次传入参数)和bind+launch(预打包参数块)每秒的启动次数
+ * node examples/launch_benchmark.js
+ */
+
+/**每种方式的启动次数 */
+var launchCount = 200000;
+
+var code = `launch_program
+__global__
+void my_kernel(float* a, float* b) {
+    a[threadIdx.x] += b[threadIdx.x];
+}`;
+
+var launcher = new NVRTC.CudaProgram(code).createKernel("my_kernel").createInstantiate([]).createLauncher([1,1,1],[1,1,1]);
+var a = new NVRTC.CudaBuffer(4);
+var b = new NVRTC.CudaBuffer(4);
+
+/**
+ * 测试一种启动方式
+ * @param {string} name 启动方式的名称
+ * @param {()=>void} launch 执行一次启动
+ */
+function bench(name,launch){
+  //预热
+  for(var i = 0;i < 1000;i++){
+    launch();
+  }
+  var time = process.hrtime.bigint();
+  for(var i = 0;i < launchCount;i++){
+    launch();
+  }
+  time = Number(process.hrtime.bigint() - time) / 1e9;
+  console.log(`${name}: ${(launchCount / time).toFixed(0)} 次/秒`);
+}
+
+bench("run",() => launcher.run(a,b));
+launcher.bind(a,b);
+bench("bind+launch",() => launcher.launch());
+
+//每次提交100次启动
+var commands = new NVRTC.CudaCommandBuffer();
+for(var i = 0;i < 100;i++){
+  commands.launch(launcher);
+}
+var submit = 0;
+bench("submitBatch",() => {
+  if(submit++ % 100 == 0)
+    commands.submit();
+});
+
+NVRTC.DestoryAllBuffer();
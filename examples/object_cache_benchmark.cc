@@ -0,0 +1,120 @@
+//ں˻(jitify::ObjectCache)Ĳ٣ԭstd::map+std::dequeʵֶԱȣҪԿ
+//g++ -std=c++11 -O2 -I.. -I<cuda>/include object_cache_benchmark.cc -o object_cache_benchmark -L<cuda>/lib64 -lcuda -lcudart -lnvrtc && ./object_cache_benchmark
+#include <chrono>
+#include <cstdio>
+#include <deque>
+#include <map>
+#include <random>
+#include <vector>
+#include "../jitify.hpp"
+
+//ԭʵ֣touchҪdequeԲ
+template <typename KeyType, typename ValueType>
+class OldObjectCache {
+ public:
+  typedef KeyType key_type;
+  typedef ValueType value_type;
+
+ private:
+  typedef std::map<key_type, value_type> object_map;
+  typedef std::deque<key_type> key_rank;
+  typedef typename key_rank::iterator rank_iterator;
+  object_map _objects;
+  key_rank _ranked_keys;
+  size_t _capacity;
+
+  inline void discard_old(size_t n = 0) {
+    if (n > _capacity) {
+      throw std::runtime_error("Insufficient capacity in cache");
+    }
+    while (_objects.size() > _capacity - n) {
+      key_type discard_key = _ranked_keys.back();
+      _ranked_keys.pop_back();
+      _objects.erase(discard_key);
+    }
+  }
+
+ public:
+  inline OldObjectCache(size_t capacity = 8) : _capacity(capacity) {}
+  inline bool contains(const key_type& k) const {
+    return (bool)_objects.count(k);
+  }
+  inline void touch(const key_type& k) {
+    if (!this->contains(k)) {
+      throw std::runtime_error("Key not found in cache");
+    }
+    rank_iterator rank = std::find(_ranked_keys.begin(), _ranked_keys.end(), k);
+    if (rank != _ranked_keys.begin()) {
+      _ranked_keys.erase(rank);
+      _ranked_keys.push_front(k);
+    }
+  }
+  inline value_type& get(const key_type& k) {
+    if (!this->contains(k)) {
+      throw std::runtime_error("Key not found in cache");
+    }
+    this->touch(k);
+    return _objects[k];
+  }
+  template <typename... Args>
+  inline value_type& emplace(const key_type& k, Args&&... args) {
+    this->discard_old(1);
+    auto iter = _objects
+                    .emplace(std::piecewise_construct, std::forward_as_tuple(k),
+                             std::forward_as_tuple(args...))
+                    .first;
+    _ranked_keys.push_front(iter->first);
+    return iter->second;
+  }
+};
+
+//ģں˻ķʣkeysеkey˳ңʱ
+template <class Cache>
+double run(Cache & cache,const std::vector<uint64_t> & keys,size_t * hits){
+  size_t sum = 0;
+  auto time = std::chrono::steady_clock::now();
+  for(size_t i = 0;i < keys.size();i++){
+    if(cache.contains(keys[i])){
+      sum += cache.get(keys[i]);
+      (*hits)++;
+    }else{
+      cache.emplace(keys[i],keys[i]);
+    }
+  }
+  double ms = std::chrono::duration<double,std::milli>(std::chrono::steady_clock::now() - time).count();
+  if(sum == 1) {printf("\n");}
+  return ms;
+}
+
+int main(){
+  const size_t capacities[] = {128,1024,8192};
+  const size_t lookups = 200000;
+  std::mt19937_64 rng(1234);
+
+  for(size_t c = 0;c < sizeof(capacities) / sizeof(capacities[0]);c++){
+    size_t capacity = capacities[c];
+    //󲿷ַʼڳõںϣʳ
+    std::vector<uint64_t> keys(lookups);
+    std::uniform_int_distribution<uint64_t> hot(0,capacity - 1),cold(0,capacity * 4);
+    for(size_t i = 0;i < lookups;i++) {keys[i] = (rng() % 10 < 9 ? hot(rng) : cold(rng)) * 0x9E3779B97F4A7C15ull;}
+
+    size_t old_hits = 0,new_hits = 0;
+    OldObjectCache<uint64_t,uint64_t> old_cache(capacity);
+    jitify::ObjectCache<uint64_t,uint64_t> new_cache(capacity);
+    double old_ms = run(old_cache,keys,&old_hits);
+    double new_ms = run(new_cache,keys,&new_hits);
+    jitify::ObjectCacheStats stats = new_cache.stats();
+    printf("capacity %zu: old %.2fms new %.2fms (hits %zu/%zu, evictions %zu)\n",
+      capacity,old_ms,new_ms,new_hits,old_hits,stats.evictions);
+  }
+
+  //ֽƣÿĿȨΪ1KB64KBʱౣ64
+  jitify::ObjectCache<uint64_t,uint64_t> byte_cache(1024,64 << 10);
+  for(uint64_t i = 0;i < 1000;i++){
+    byte_cache.emplace(i,i);
+    byte_cache.set_weight(i,1024);
+  }
+  jitify::ObjectCacheStats stats = byte_cache.stats();
+  printf("byte budget 64KB: size %zu bytes %zu evictions %zu\n",stats.size,stats.bytes,stats.evictions);
+  return 0;
+}
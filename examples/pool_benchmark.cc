@@ -0,0 +1,208 @@
+//Դ滺صĲԺͲ٣ʹüٵķҪԿ
+//g++ -std=c++11 -O2 -I.. pool_benchmark.cc -o pool_benchmark && ./pool_benchmark
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+#include "../cuda_pool.hpp"
+
+//ģsubmittedΪѾcompletedΪѾɵqueriesΪѯfenceĴ
+struct FakeStream {
+  size_t submitted;
+  size_t completed;
+  size_t queries;
+};
+
+//ٵķmallocģⲢcudaMalloc/cudaFreeͬʱfenceΪͷʱѾ
+struct FakeAllocator {
+  typedef size_t Fence;
+  size_t * allocs;
+  size_t * frees;
+  int delay_us;
+  FakeStream * stream;
+  FakeAllocator(size_t * allocs = NULL,size_t * frees = NULL,int delay_us = 0,FakeStream * stream = NULL):allocs(allocs),frees(frees),delay_us(delay_us),stream(stream){}
+  bool allocate(void ** ptr,size_t size,int device){
+    if(delay_us) {std::this_thread::sleep_for(std::chrono::microseconds(delay_us));}
+    *ptr = malloc(size);
+    if(allocs) {(*allocs)++;}
+    return *ptr != NULL;
+  }
+  void free(void * ptr,int device){
+    if(delay_us) {std::this_thread::sleep_for(std::chrono::microseconds(delay_us));}
+    ::free(ptr);
+    if(frees) {(*frees)++;}
+  }
+  Fence fence(int device) {return stream ? stream->submitted : 0;}
+  bool ready(Fence & fence){
+    if(!stream) {return true;}
+    stream->queries++;
+    return stream->completed >= fence;
+  }
+  void wait(Fence & fence) {if(stream && stream->completed < fence) {stream->completed = fence;}}
+};
+
+typedef CachingAllocator<FakeAllocator> Pool;
+
+bool failed = false;
+void check(bool ok,const char * what){
+  if(!ok){
+    printf("check failed: %s\n",what);
+    failed = true;
+  }
+}
+
+//λȡ
+void testBins(){
+  check(Pool::bin_size(1) == 512,"bin 1");
+  check(Pool::bin_size(512) == 512,"bin 512");
+  check(Pool::bin_size(513) == 1024,"bin 513");
+  check(Pool::bin_size(300000) == 524288,"bin 300000");
+  check(Pool::bin_size(1 << 20) == 1 << 20,"bin 1MB");
+  check(Pool::bin_size((1 << 20) + 1) == (1 << 20) + (1 << 18),"bin 1MB+1");
+  check(Pool::bin_size(3000000) == 3145728,"bin 3000000");
+  check(Pool::bin_size(4194304) == 4194304,"bin 4MB");
+}
+
+//Сδкȡ˷ѵͳƣͷźȴɲŸ
+void testStats(){
+  size_t allocs = 0,frees = 0;
+  FakeStream stream = {0,0,0};
+  {
+    Pool pool(0,FakeAllocator(&allocs,&frees,0,&stream));
+    void * a = pool.allocate(1000,0);
+    void * b = pool.allocate(3000000,0);
+    Pool::Stats stats = pool.get_stats();
+    check(stats.misses == 2 && stats.hits == 0 && allocs == 2,"misses");
+    check(stats.in_use_bytes == 1024 + 3145728 && stats.requested_bytes == 3001000,"in use bytes");
+    check(stats.fragmentation_bytes == 24 + 145728,"fragmentation bytes");
+
+    //ͷʱл񣬲ܸ
+    stream.submitted++;
+    check(pool.deallocate(a),"deallocate");
+    check(!pool.deallocate(a),"double deallocate");
+    stats = pool.get_stats();
+    check(stats.pending_bytes == 1024 && stats.cached_bytes == 0 && stats.in_use_bytes == 3145728,"pending bytes");
+    void * c = pool.allocate(900,0);
+    check(c != a && pool.get_stats().misses == 3,"pending buffer reused");
+
+    //ɺ
+    stream.completed = stream.submitted;
+    pool.deallocate(c);
+    void * d = pool.allocate(600,0);
+    stats = pool.get_stats();
+    check(stats.hits == 1 && stats.pending_bytes == 0 && stats.cached_bytes == 1024,"reuse after fence");
+    check(d == a || d == c,"reused pointer");
+    check(stats.fragmentation_bytes == 1024 - 600 + 145728,"fragmentation after reuse");
+
+    //豸Ļ治ᱻ
+    pool.deallocate(d);
+    void * e = pool.allocate(600,1);
+    check(pool.get_stats().misses == 4,"device isolation");
+    pool.deallocate(e);
+    pool.deallocate(b);
+  }
+  check(allocs == frees,"destructor frees all");
+}
+
+//ȴеĻܶʱͷֻѯÿ豸һδɵfence
+void testCollect(){
+  FakeStream stream = {0,0,0};
+  Pool pool(0,FakeAllocator(NULL,NULL,0,&stream));
+  std::vector<void *> buffers;
+  for(int i = 0;i < 100;i++) {buffers.push_back(pool.allocate(1000,i % 2));}
+  for(void * ptr : buffers){
+    stream.submitted++;
+    pool.deallocate(ptr);
+  }
+  check(pool.get_stats().pending_bytes == 100 * 1024,"collect pending");
+  stream.queries = 0;
+  void * a = pool.allocate(1000,0);
+  check(stream.queries == 2,"collect stops at first pending fence");
+  //һǰɵfenceգȻȴ
+  stream.completed = 50;
+  pool.deallocate(a);
+  Pool::Stats stats = pool.get_stats();
+  check(stats.cached_bytes == 50 * 1024 && stats.pending_bytes == 51 * 1024,"collect in order");
+}
+
+//
+void testHighWater(){
+  size_t allocs = 0,frees = 0;
+  FakeStream stream = {0,0,0};
+  Pool pool(4096,FakeAllocator(&allocs,&frees,0,&stream));
+  void * ptrs[8];
+  for(int i = 0;i < 8;i++) {ptrs[i] = pool.allocate(1024,0);}
+  for(int i = 0;i < 8;i++) {pool.deallocate(ptrs[i]);}
+  Pool::Stats stats = pool.get_stats();
+  check(stats.cached_bytes == 4096 && stats.trimmed == 4 && frees == 4,"high water trim");
+  pool.set_high_water(1024);
+  stats = pool.get_stats();
+  check(stats.cached_bytes == 1024 && stats.trimmed == 7 && frees == 7,"lower high water");
+  pool.trim(0);
+  check(pool.get_stats().cached_bytes == 0 && frees == 8,"trim");
+
+  //ȴеĻ뻺ޣɺٰͷ
+  stream.submitted++;
+  void * a = pool.allocate(4096,0);
+  void * b = pool.allocate(4096,0);
+  pool.deallocate(a);
+  pool.deallocate(b);
+  check(pool.get_stats().pending_bytes == 8192 && frees == 8,"pending not trimmed");
+  stream.completed = stream.submitted;
+  pool.trim(4096);
+  stats = pool.get_stats();
+  check(stats.pending_bytes == 0 && stats.cached_bytes == 4096 && frees == 9,"trim after fence");
+}
+
+int main(){
+  testBins();
+  testStats();
+  testCollect();
+  testHighWater();
+
+  //ÿʱߴ
+  const size_t sizes[] = {1000,4096,65536,300000,1 << 20,3000000};
+  const int count = sizeof(sizes) / sizeof(sizes[0]);
+  const int requests = 2000;
+
+  size_t allocs = 0,frees = 0;
+  FakeAllocator backend(&allocs,&frees,100);
+
+  //ʹû
+  auto time = std::chrono::steady_clock::now();
+  for(int i = 0;i < requests;i++){
+    void * ptrs[count];
+    for(int j = 0;j < count;j++) {backend.allocate(&ptrs[j],sizes[j],0);}
+    for(int j = 0;j < count;j++) {backend.free(ptrs[j],0);}
+  }
+  double direct = std::chrono::duration<double,std::milli>(std::chrono::steady_clock::now() - time).count();
+
+  //ʹû
+  allocs = frees = 0;
+  Pool * pool = new Pool(size_t(64) << 20,backend);
+  time = std::chrono::steady_clock::now();
+  for(int i = 0;i < requests;i++){
+    void * ptrs[count];
+    for(int j = 0;j < count;j++) {ptrs[j] = pool->allocate(sizes[j] + i % 7,0);}
+    for(int j = 0;j < count;j++) {pool->deallocate(ptrs[j]);}
+  }
+  double pooled = std::chrono::duration<double,std::milli>(std::chrono::steady_clock::now() - time).count();
+
+  auto stats = pool->get_stats();
+  printf("direct: %.2fms\n",direct);
+  printf("pooled: %.2fms\n",pooled);
+  printf("hits: %zu misses: %zu cached: %zu bytes backend allocs: %zu\n",stats.hits,stats.misses,stats.cached_bytes,allocs);
+  //i % 7 40961MBԽһλÿֳߴλ
+  check(stats.hits + stats.misses == (size_t)requests * count && allocs == stats.misses && stats.misses <= (size_t)count * 2,"benchmark hit rate");
+
+  //޼
+  pool->set_high_water(1 << 20);
+  stats = pool->get_stats();
+  printf("after high water 1MB: cached: %zu bytes trimmed: %zu\n",stats.cached_bytes,stats.trimmed);
+  check(stats.cached_bytes <= (1 << 20),"benchmark high water");
+  delete pool;
+  printf("backend frees: %zu\n",frees);
+  check(frees == allocs,"benchmark frees");
+  printf("check: %s\n",failed ? "failed" : "ok");
+  return failed ? 1 : 0;
+}
@@ -0,0 +1,18 @@
+//加载预编译工具生成的打包文件，运行时不需要调用NVRTC
+var NVRTC = require("../index.js");
+var path = require("path");
+
+var bundle = new NVRTC.CudaBundle(path.join(__dirname,"precompile/kernels.bundle"));
+console.log(bundle.list());
+
+var data = new Float32Array([1,2,3,4,5]);
+var cudaData = new NVRTC.CudaBuffer(data.byteLength);
+cudaData.writeData(data.buffer);
+
+//模块在创建启动器时才会加载
+var scale = bundle.getInstantiate("scale",["float"]);
+scale.createLauncher([1,1,1],[data.length,1,1]).bind(cudaData,data.length,2).launch();
+
+cudaData.readData(data.buffer);
+console.log(data);
+console.log("NVRTC编译次数",NVRTC.getNvrtcCompileCount());
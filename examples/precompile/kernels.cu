@@ -0,0 +1,14 @@
+//Ԥʹõĺ
+
+template <typename T>
+__global__
+void scale(T* data,int count,T factor) {
+    int i = blockIdx.x * blockDim.x + threadIdx.x;
+    if(i < count) data[i] = data[i] * factor;
+}
+
+template <typename T,int N>
+__global__
+void fill(T* data,T value) {
+    data[blockIdx.x * N + threadIdx.x] = value;
+}
@@ -0,0 +1,39 @@
+var NVRTC = require("../index.js");
+
+/**
+ * GPU计时和启动统计的例子
+ * node examples/profile.js
+ */
+
+var size = 1 << 20;
+var code = `profile_program
+__global__
+void scale_kernel(float* data, float scale, int n) {
+    for(int i = blockIdx.x * blockDim.x + threadIdx.x; i < n; i += blockDim.x * gridDim.x)
+        data[i] *= scale;
+}`;
+
+var instantiate = new NVRTC.CudaProgram(code).createKernel("scale_kernel").createInstantiate([]);
+var data = new NVRTC.CudaBuffer(size * 4);
+var stream = new NVRTC.CudaStream();
+var launcher = instantiate.createLauncher([256,1,1],[256,1,1],stream).bind(data,1.0001,size);
+
+//使用事件测量一段任务的GPU时间
+var start = new NVRTC.CudaEvent().record(stream);
+for(var i = 0;i < 100;i++){
+  launcher.launch();
+}
+var end = new NVRTC.CudaEvent().record(stream);
+end.synchronize();
+console.log(`100次启动的GPU时间: ${start.elapsedTime(end).toFixed(3)}ms`);
+
+//开启统计后每次启动都会记录GPU时间和提交耗时
+launcher.setProfiling(true);
+for(var i = 0;i < 2000;i++){
+  launcher.launch();
+}
+var stats = instantiate.getLaunchStats(true);
+console.log(`启动${stats.launches}次，GPU时间 平均${stats.gpu.mean.toFixed(1)}us p99 ${stats.gpu.p99.toFixed(1)}us，提交耗时 平均${stats.submit.mean.toFixed(2)}us p99 ${stats.submit.p99.toFixed(2)}us`);
+console.log("GPU时间分布(第i项为[2^(i-1),2^i)微秒)",stats.gpu.histogram.join(","));
+
+NVRTC.DestoryAllBuffer();
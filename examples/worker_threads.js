@@ -0,0 +1,48 @@
+var { Worker, isMainThread, parentPort, workerData } = require("worker_threads");
+var NVRTC = require("../index.js");
+
+/**
+ * 多个worker_threads共同使用显存的例子
+ * 主线程申请显存并写入数据，每个worker打开共享的显存并各自编译和运行核心，处理其中的一段数据
+ * node examples/worker_threads.js
+ */
+
+/**worker数量 */
+var workerCount = 4;
+/**每个worker处理的数据数量 */
+var count = 256;
+
+var code = `worker_program
+__global__
+void add_kernel(float* data, float value, int offset) {
+    data[offset + threadIdx.x] += value;
+}`;
+
+if(isMainThread){
+  var data = new Float32Array(workerCount * count).fill(1);
+  var cudaData = new NVRTC.CudaBuffer(data.byteLength);
+  cudaData.writeData(data.buffer);
+
+  var workers = [];
+  for(var i = 0;i < workerCount;i++){
+    //每个worker需要单独的共享编号
+    workers.push(new Promise((resolve,reject) => {
+      var worker = new Worker(__filename,{workerData:{shared:cudaData.share(),index:i}});
+      worker.on("message",resolve);
+      worker.on("error",reject);
+    }));
+  }
+  Promise.all(workers).then(() => {
+    cudaData.readData(data.buffer);
+    console.log("结果:",data[0],data[count],data[count * 2],data[count * 3]);
+  });
+}else{
+  var cudaData = NVRTC.CudaBuffer.fromShared(workerData.shared);
+  var program = new NVRTC.CudaProgram(code);
+  var instantiate = program.createKernel("add_kernel").createInstantiate();
+  var stream = new NVRTC.CudaStream();
+  var launcher = instantiate.createLauncher([1,1,1],[count,1,1],stream);
+  launcher.bind(cudaData,workerData.index + 1,workerData.index * count).launch();
+  stream.synchronize();
+  parentPort.postMessage("done");
+}
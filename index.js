@@ -1,6 +1,8 @@
 var os = require("os");
 var child_process = require("child_process");
 var process = require("process");
+var fs = require("fs");
+var path = require("path");
 var osInfo = os.platform() + ":" + os.arch();
 try{
     if(osInfo == "win32:x64"){
@@ -86,17 +88,139 @@ module.exports.cudaLimit = {
 var getDeviceProperties = addon.getDeviceProperties;
 module.exports.getDeviceProperties = getDeviceProperties;
 
+/**
+ * 获取当前进程调用NVRTC编译的总次数
+ * @type {()=>number}
+ */
+var getNvrtcCompileCount = addon.getNvrtcCompileCount;
+module.exports.getNvrtcCompileCount = getNvrtcCompileCount;
+
+/**
+ * 设置批量编译使用的线程数量，0为CPU核心数量，不会阻塞：多出的线程完成正在编译的任务后退出
+ * @type {(count:number)=>void}
+ */
+var setCompileThreads = addon.setCompileThreads;
+module.exports.setCompileThreads = setCompileThreads;
+
+/**
+ * 获取批量编译使用的线程数量
+ * @type {()=>number}
+ */
+var getCompileThreads = addon.getCompileThreads;
+module.exports.getCompileThreads = getCompileThreads;
+
+/**头文件注册表，头文件源码只在原生代码中保存一份，创建程序时直接查找，不需要回调js */
+class HeaderRegistry{
+    /**
+     * 
+     * @param {{[name:string]:string}} headers 初始的头文件，键为引入时使用的名称，值为源码(可选)
+     */
+    constructor(headers){
+        var self = this;
+        /**注册表句柄 */
+        this.registry = addon.createHeaderRegistry();
+
+        /**
+         * 写入头文件，同名的头文件会被覆盖
+         * @param {{[name:string]:string}} headers 键为引入时使用的名称，值为源码
+         */
+        this.set = function(headers){
+            addon.headerRegistrySet(self.registry,headers);
+            return self;
+        }
+
+        /**
+         * 写入目录中的所有头文件，名称为相对目录的路径
+         * @param {string} dir 目录
+         * @param {{prefix?:string,extensions?:string[]}} options prefix为名称的前缀，extensions为要写入的文件扩展名
+         */
+        this.addDirectory = function(dir,options){
+            options = options || {};
+            var extensions = options.extensions || [".h",".hpp",".cuh",".inl"];
+            var headers = {};
+            var scan = function(current,name){
+                fs.readdirSync(current,{withFileTypes:true}).forEach(v => {
+                    var file = path.join(current,v.name);
+                    if(v.isDirectory())
+                        scan(file,name + v.name + "/");
+                    else if(extensions.indexOf(path.extname(v.name)) >= 0)
+                        headers[name + v.name] = fs.readFileSync(file,"utf8");
+                });
+            }
+            scan(dir,options.prefix || "");
+            return self.set(headers);
+        }
+
+        /**
+         * 写入打包的头文件，格式见HeaderRegistry.pack
+         * @param {ArrayBuffer|Buffer} buffer 打包的头文件
+         */
+        this.addPacked = function(buffer){
+            if(!(buffer instanceof ArrayBuffer))
+                buffer = buffer.buffer.slice(buffer.byteOffset,buffer.byteOffset + buffer.byteLength);
+            addon.headerRegistrySetPacked(self.registry,buffer);
+            return self;
+        }
+
+        /**
+         * 删除头文件
+         * @param {string} name 头文件名称
+         * @returns {boolean}
+         */
+        this.remove = function(name){
+            return addon.headerRegistryRemove(self.registry,name);
+        }
+
+        /**
+         * 获取头文件数量和总字节数
+         * @returns {{count:number,bytes:number}}
+         */
+        this.getInfo = function(){
+            return addon.getHeaderRegistryInfo(self.registry);
+        }
+
+        if(headers)
+            this.set(headers);
+    }
+}
+
+/**
+ * 打包头文件，格式为连续的[名称字节数u32][名称][源码字节数u32][源码]，均为小端
+ * @param {{[name:string]:string}} headers 键为引入时使用的名称，值为源码
+ * @returns {Buffer}
+ */
+HeaderRegistry.pack = function(headers){
+    var parts = [];
+    for(var name in headers){
+        [name,headers[name]].forEach(v => {
+            var data = Buffer.from(v,"utf8");
+            var size = Buffer.alloc(4);
+            size.writeUInt32LE(data.length,0);
+            parts.push(size,data);
+        });
+    }
+    return Buffer.concat(parts);
+}
+
+module.exports.HeaderRegistry = HeaderRegistry;
+
 /**cuda程序 */
 class CudaProgram{
     /**
      * 
-     * @param {string} code cuda程序的代码
+     * @param {string|object} code cuda程序的代码 或者是已经创建好的程序句柄
      * @param {(filename:string)=>(string|null)} fileCallback 引入文件回调函数，当有include文件时会通过这个回调函数处理
+     * @param {{cacheDir?:string,cacheMaxSize?:number,headers?:HeaderRegistry}} options 程序选项，cacheDir为编译结果的磁盘缓存目录(不设置则不缓存)，cacheMaxSize为缓存目录的最大字节数(0为不限制)，headers为头文件注册表，引入的头文件优先从中查找，找不到时才调用fileCallback
      */
-    constructor(code,fileCallback){
+    constructor(code,fileCallback,options){
         var self = this;
-        /**Cuda程序句柄 */
-        this.program = addon.createProgram(code,fileCallback);
+        options = options || {};
+        if(typeof code != "string"){
+            /**Cuda程序句柄 */
+            this.program = code;
+        }else{
+            this.program = addon.createProgram(code,fileCallback,options.cacheDir,options.cacheMaxSize || 0,options.headers ? options.headers.registry : undefined);
+        }
 
         /**
          * 创建一个Cuda核心
@@ -106,9 +230,62 @@ class CudaProgram{
         this.createKernel = function(name){
             return new CudaKernel(self,name);
         }
+
+        /**
+         * 批量创建运算实例，所有实例在一次NVRTC编译中生成并共享同一个模块
+         * @param {{name:string,templates?:[]}[]} list 要创建的核心名称和模板参数列表
+         * @returns {CudaInstantiate[]}
+         */
+        this.instantiateMany = function(list){
+            list = list.map(v => ({name:v.name,templates:(v.templates || []).map(t => (t + ""))}));
+            var handles = addon.instantiateMany(self.program,list);
+            var kernels = {};
+            return list.map((v,i) => {
+                if(kernels[v.name] == null)
+                    kernels[v.name] = new CudaKernel(self,v.name);
+                return new CudaInstantiate(kernels[v.name],v.templates,handles[i]);
+            });
+        }
+
+        /**
+         * 在编译线程池中并行创建运算实例，程序、选项、核心和模板参数相同的实例只编译一次，其它批次正在编译的实例会直接等待那次的结果
+         * @param {{name:string,templates?:[],priority?:number}[]} list 要创建的核心名称、模板参数和优先级列表，优先级大于0的实例会先编译
+         * @param {{onProgress?:(done:number,total:number,info:{index:number,time:number,error?:string})=>void}} options onProgress为每个编译任务完成时的回调，time为编译耗时(毫秒)
+         * @returns {Promise<CudaInstantiate[]>}
+         */
+        this.compileBatch = function(list,options){
+            options = options || {};
+            list = list.map(v => ({name:v.name,templates:(v.templates || []).map(t => (t + "")),priority:v.priority || 0}));
+            var kernels = {};
+            var jobs = list.map(v => {
+                if(kernels[v.name] == null)
+                    kernels[v.name] = new CudaKernel(self,v.name);
+                return {kernel:kernels[v.name].kernel,templates:v.templates,priority:v.priority};
+            });
+            return addon.compileBatch(jobs,options.onProgress).then(results => list.map((v,i) => {
+                if(results[i].error != null)
+                    throw new Error(v.name + "<" + v.templates.join(",") + ">:" + results[i].error);
+                var instantiate = new CudaInstantiate(kernels[v.name],v.templates,results[i].instance);
+                /**编译耗时(毫秒) */
+                instantiate.compileTime = results[i].time;
+                return instantiate;
+            }));
+        }
     }
 }
 
+/**
+ * 异步创建cuda程序，编译在线程池中进行不会阻塞事件循环
+ * @param {string} code cuda程序的代码
+ * @param {(filename:string)=>(string|null)} fileCallback 引入文件回调函数，会在主线程中调用
+ * @param {{cacheDir?:string,cacheMaxSize?:number,headers?:HeaderRegistry}} options 程序选项，同构造函数
+ * @returns {Promise<CudaProgram>}
+ */
+CudaProgram.compileAsync = function(code,fileCallback,options){
+    options = options || {};
+    return addon.createProgramAsync(code,fileCallback,options.cacheDir,options.cacheMaxSize || 0,options.headers ? options.headers.registry : undefined).then(program => new CudaProgram(program));
+}
+
 module.exports.CudaProgram = CudaProgram;
 
 
@@ -137,6 +314,16 @@ class CudaKernel{
         this.createInstantiate = function(templates){
             return new CudaInstantiate(self,templates);
         }
+
+        /**
+         * 异步创建一个运算实例，编译在线程池中进行不会阻塞事件循环
+         * @param {[]} templates 要创建实例的模板参数
+         * @returns {Promise<CudaInstantiate>}
+         */
+        this.createInstantiateAsync = function(templates){
+            templates = (templates || []).map(v => (v + ""));
+            return addon.createInstanceAsync.apply(addon,[self.kernel,...templates]).then(instantiate => new CudaInstantiate(self,templates,instantiate));
+        }
     }
 }
 
@@ -149,8 +336,9 @@ class CudaInstantiate{
      * 
      * @param {CudaKernel|{ptx:string,link_files:[],link_paths:[]}} kernel 实例所属的核心 或者是 PTX数据
      * @param {[]} templates 实例的模板参数
+     * @param {object} instantiate 已经创建好的实例句柄(可选)
      */
-    constructor(kernel,templates){
+    constructor(kernel,templates,instantiate){
         var self = this;
         //如果是kernel初始化
         if(kernel instanceof CudaKernel){
@@ -161,20 +349,84 @@ class CudaInstantiate{
             this.templates = this.templates.map(v => (v + ""));
             var temps = [kernel.kernel,...this.templates];
             /**实例句柄 */
-            this.instantiate = addon.createInstance.apply(addon,temps);
+            this.instantiate = instantiate != null ? instantiate : addon.createInstance.apply(addon,temps);
         }else if(kernel instanceof ArrayBuffer){
             //使用序列化字符串初始化
             this.instantiate = addon.deserializeInstance(kernel);
+        }else if(kernel instanceof CudaBundle){
+            //从打包文件初始化，第一次使用实例句柄时才读取数据并加载模块
+            this.bundle = kernel;
+            this.templates = (templates || []).map(v => (v + ""));
+            var handle = null;
+            Object.defineProperty(this,"instantiate",{
+                enumerable:true,
+                get:function(){
+                    if(handle == null){
+                        handle = kernel.load(self.name,self.templates);
+                    }
+                    return handle;
+                }
+            });
+            /**实例在打包文件中的核心名称 */
+            this.name = instantiate;
         }
 
         /**
          * 创建启动器
          * @param {*} grid_size 启动器组尺寸
          * @param {*} block_size 块尺寸
+         * @param {CudaStream} stream 启动使用的流(可选，默认为默认流)
          * @returns 
          */
-        this.createLauncher = function(grid_size,block_size){
-            return new CudaLauncher(self,grid_size,block_size);
+        this.createLauncher = function(grid_size,block_size,stream){
+            return new CudaLauncher(self,grid_size,block_size,stream);
+        }
+
+        /**各个共享内存和块尺寸上限下的最大占用率 */
+        var occupancyCache = new Map();
+        /**各个元素数量分桶的启动尺寸 */
+        var autoConfigs = new Map();
+
+        /**
+         * 根据占用率计算一维的启动尺寸，块尺寸取占用率最高的值，组尺寸按元素数量计算但不超过占满设备需要的块数，
+         * 核心需要使用网格跨步循环(grid-stride loop)处理超出线程数的元素。
+         * 元素数量按2的幂分桶，同一个桶内使用相同的尺寸，结果按实例缓存，每次返回新的对象
+         * @param {number} n 元素数量
+         * @param {{smemPerThread?:number,maxBlock?:number}} options smemPerThread为每个线程使用的动态共享内存字节数，maxBlock为块尺寸上限(0为不限制)
+         * @returns {{grid_size:number[],block_size:number[],smem:number}} smem为每个块的动态共享内存字节数
+         */
+        this.getAutoConfig = function(n,options){
+            options = options || {};
+            var smemPerThread = options.smemPerThread || 0;
+            var maxBlock = options.maxBlock || 0;
+            var bucket = n <= 1 ? 1 : Math.pow(2,Math.ceil(Math.log2(n)));
+            var key = bucket + ":" + smemPerThread + ":" + maxBlock;
+            var config = autoConfigs.get(key);
+            if(config == null){
+                var occupancyKey = smemPerThread + ":" + maxBlock;
+                var occupancy = occupancyCache.get(occupancyKey);
+                if(occupancy == null){
+                    occupancy = addon.getMaxOccupancy(self.instantiate,smemPerThread,maxBlock);
+                    occupancyCache.set(occupancyKey,occupancy);
+                }
+                var grid = Math.max(1,Math.min(Math.ceil(bucket / occupancy.block),occupancy.grid));
+                config = {grid_size:[grid,1,1],block_size:[occupancy.block,1,1],smem:occupancy.smem};
+                autoConfigs.set(key,config);
+            }
+            //返回副本，调用者修改尺寸不会影响缓存中同一个桶之后的结果
+            return {grid_size:config.grid_size.slice(0),block_size:config.block_size.slice(0),smem:config.smem};
+        }
+
+        /**
+         * 创建按占用率自动选择尺寸的启动器，尺寸见getAutoConfig
+         * @param {number} n 元素数量
+         * @param {{smemPerThread?:number,maxBlock?:number,stream?:CudaStream}} options stream为启动使用的流(可选，默认为默认流)
+         * @returns {CudaLauncher}
+         */
+        this.createAutoLauncher = function(n,options){
+            options = options || {};
+            var config = self.getAutoConfig(n,options);
+            return new CudaLauncher(self,config.grid_size,config.block_size,options.stream,config.smem);
         }
 
         /**
@@ -185,16 +437,169 @@ class CudaInstantiate{
             return addon.getInstancePTX(this.instantiate);
         }
 
-        /** 序列化PTX */
+        /** 序列化PTX和链接好的cubin，在相同架构的设备上反序列化时直接加载cubin，不需要重新编译PTX */
         this.serialize = function(){
             return addon.serializeInstance(this.instantiate);
         }
+
+        /**启动统计的原生对象，第一次开启统计的启动器启动时创建 */
+        var profile = null;
+
+        /**
+         * 获取启动统计的原生对象，实例的所有启动器共用
+         * @returns {object}
+         */
+        this.getProfile = function(){
+            if(profile == null){
+                profile = addon.createLaunchProfile();
+            }
+            return profile;
+        }
+
+        /**
+         * 获取开启了统计的启动器的启动统计，时间单位为微秒
+         * gpu为GPU执行时间，submit为提交启动的CPU耗时，都是最近1024次启动的分布，histogram的第i项为[2^(i-1),2^i)微秒的次数
+         * @param {boolean} wait 是否等待所有启动完成，默认只统计已经完成的启动
+         * @returns {{launches:number,measured:number,pending:number,totalGpuTime:number,totalSubmitTime:number,gpu:{mean:number,p50:number,p90:number,p99:number,max:number,histogram:number[]},submit:{mean:number,p50:number,p90:number,p99:number,max:number,histogram:number[]}}}
+         */
+        this.getLaunchStats = function(wait){
+            return addon.getLaunchProfile(self.getProfile(),!!wait);
+        }
+
+        /**
+         * 清空启动统计
+         */
+        this.resetLaunchStats = function(){
+            addon.resetLaunchProfile(self.getProfile());
+        }
     }
 }
 
 module.exports.CudaInstantiate = CudaInstantiate;
 
 
+/**多核心打包文件，通过mmap打开，其中的实例在第一次启动时才会加载 */
+class CudaBundle{
+    /**
+     * 
+     * @param {string} file 打包文件路径
+     */
+    constructor(file){
+        var self = this;
+        /**打包文件路径 */
+        this.file = file;
+        /**打包文件句柄 */
+        this.bundle = addon.openBundle(file);
+
+        /**
+         * 获取打包文件中的实例列表
+         * @returns {{name:string,templates:string[],arch:string}[]}
+         */
+        this.list = function(){
+            return addon.getBundleList(self.bundle);
+        }
+
+        /**
+         * 获取一个实例，实例的模块在第一次创建启动器时才会加载
+         * @param {string} name 核心名称
+         * @param {[]} templates 模板参数
+         * @returns {CudaInstantiate}
+         */
+        this.getInstantiate = function(name,templates){
+            return new CudaInstantiate(self,templates,name);
+        }
+
+        /**
+         * 立即加载实例，优先使用当前设备架构的cubin
+         * @param {string} name 核心名称
+         * @param {[]} templates 模板参数
+         * @returns {object} 实例句柄
+         */
+        this.load = function(name,templates){
+            var handle = addon.loadBundleInstance(self.bundle,name,(templates || []).map(v => (v + "")));
+            if(handle == null){
+                throw new Error(`打包文件${self.file}中没有实例${name}<${(templates || []).join(",")}>`);
+            }
+            return handle;
+        }
+
+        /** 关闭打包文件，已经加载的实例不受影响 */
+        this.close = function(){
+            addon.closeBundle(self.bundle);
+        }
+    }
+}
+
+/**
+ * 把实例写入打包文件，每个实例的PTX和已经链接的cubin都会写入
+ * @param {string} file 打包文件路径
+ * @param {(CudaInstantiate|{instantiate:CudaInstantiate,name:string,templates?:[]})[]} list 要写入的实例，需要包含核心名称和模板参数，
+ * 反序列化创建的实例没有核心名称，需要使用{instantiate,name,templates}的形式写入
+ */
+CudaBundle.write = function(file,list){
+    addon.writeBundle(file,list.map((v,i) => {
+        var instance = v instanceof CudaInstantiate ? v : v.instantiate;
+        var name = v.name != null ? v.name : (instance && instance.kernel ? instance.kernel.name : instance && instance.name);
+        var templates = v.templates || (instance && instance.templates) || [];
+        if(!(instance instanceof CudaInstantiate) || instance.instantiate == null){
+            throw new TypeError(`第${i}项不是有效的实例`);
+        }
+        if(typeof name != "string"){
+            throw new TypeError(`第${i}项没有核心名称，反序列化的实例需要使用{instantiate,name,templates}的形式写入`);
+        }
+        return {name:name,templates:templates.map(t => (t + "")),instance:instance.instantiate};
+    }));
+}
+
+module.exports.CudaBundle = CudaBundle;
+
+
+/**
+ * 把一个参数按参数签名写入参数块
+ * @param {ArrayBuffer} params 参数块
+ * @param {DataView} view 参数块的DataView
+ * @param {{type:string,size:number,offset:number}} param 参数签名
+ * @param {number} index 参数序号，用于错误信息
+ * @param {CudaBuffer|number|bigint|ArrayBuffer|ArrayBufferView} arg 参数
+ */
+function packParam(params,view,param,index,arg){
+    if(arg instanceof ArrayBuffer || ArrayBuffer.isView(arg)){
+        var bytes = arg instanceof ArrayBuffer ? new Uint8Array(arg) : new Uint8Array(arg.buffer,arg.byteOffset,arg.byteLength);
+        if(bytes.byteLength != param.size){
+            throw new Error(`第${index}个参数的字节数错误，需要${param.size}字节，传入了${bytes.byteLength}字节`);
+        }
+        new Uint8Array(params,param.offset,param.size).set(bytes);
+        return;
+    }
+    //cuda指针
+    if(typeof arg == "object"){
+        arg = arg.buffer;
+    }
+    var type = param.type[0];
+    switch(param.size){
+        case 8:
+            if(type == "f")
+                view.setFloat64(param.offset,Number(arg),true);
+            else
+                view.setBigUint64(param.offset,BigInt.asUintN(64,BigInt(arg)),true);
+            break;
+        case 4:
+            if(type == "f")
+                view.setFloat32(param.offset,Number(arg),true);
+            else
+                view.setUint32(param.offset,Number(arg) >>> 0,true);
+            break;
+        case 2:
+            view.setUint16(param.offset,Number(arg) & 0xffff,true);
+            break;
+        case 1:
+            view.setUint8(param.offset,Number(arg) & 0xff);
+            break;
+        default:
+            throw new Error(`第${index}个参数为${param.size}字节的结构体，需要传入ArrayBuffer`);
+    }
+}
+
 /**Cuda启动器 */
 class CudaLauncher{
     /**
@@ -202,84 +607,998 @@ class CudaLauncher{
      * @param {CudaInstantiate} instantiate 启动器所属的实例
      * @param {*} grid_size 启动器组的尺寸
      * @param {*} block_size 启动器块的尺寸
+     * @param {CudaStream} stream 启动使用的流(可选，默认为默认流)
+     * @param {number} smem 每个块的动态共享内存字节数(可选，默认为0)
      */
-    constructor(instantiate,grid_size,block_size){
+    constructor(instantiate,grid_size,block_size,stream,smem){
         var self = this;
         /**启动器所属的实例 */
         this.instantiate = instantiate;
-        /**启动器的分组尺寸 */
-        this.grid_size = grid_size || [1,1,1];
-        /**启动器区块的尺寸 */
-        this.block_size = block_size || [1,1,1];
-        /**启动器实例 */
-        this.launcher = addon.createLauncher(instantiate.instantiate,grid_size,block_size);
+        /**是否开启启动统计 */
+        this.profiling = false;
+
+        /**
+         * 重新配置启动器的尺寸和流
+         * @param {*} grid_size 启动器组的尺寸
+         * @param {*} block_size 启动器块的尺寸
+         * @param {CudaStream} stream 启动使用的流(可选，默认为默认流)
+         * @param {number} smem 每个块的动态共享内存字节数(可选，默认为0)
+         * @returns {CudaLauncher}
+         */
+        this.configure = function(grid_size,block_size,stream,smem){
+            /**启动器的分组尺寸 */
+            self.grid_size = grid_size || [1,1,1];
+            /**启动器区块的尺寸 */
+            self.block_size = block_size || [1,1,1];
+            /**启动使用的流 */
+            self.stream = stream || null;
+            /**每个块的动态共享内存字节数 */
+            self.smem = smem || 0;
+            /**启动器实例 */
+            self.launcher = addon.createLauncher(instantiate.instantiate,self.grid_size,self.block_size,streamOf(self.stream),self.smem);
+            //需要重新创建参数块
+            packed = null;
+            return self;
+        }
 
         /**
          * 运行程序
          * @param  {...CudaBuffer} args 要运行的参数
          */
         this.run = function(...args){
-            args = args.map(val=>val.buffer);
-            var re = addon.runLauncher(self.launcher,args);
+            //开启统计时使用参数块启动，以便在原生代码中记录事件
+            if(self.profiling && !deferredSubmission.enabled){
+                self.bind(...args).launch();
+                return;
+            }
+            //延迟提交模式下把参数和启动加入队列，参数块在提交时才会被修改，之后重新configure不影响已经排入的启动
+            if(deferredSubmission.enabled){
+                createPacked(args.length);
+                var current = packed;
+                var target = {getPacked:() => current,stream:self.stream};
+                deferredPush(self.stream,true,commands => {
+                    for(var i = 0;i < args.length;i++){
+                        commands.setArg(target,i,args[i]);
+                    }
+                    commands.launch(target);
+                });
+                boundArgs = [];
+                return;
+            }
+            streamOf(self.stream);
+            var pointers = args.map(val=>val.buffer);
+            var re = addon.runLauncher(self.launcher,pointers);
             if(re.code != 0){
                 throw new Error(re.err);
             }
+            //在捕获中的流里启动时记录为图的核心节点，每个参数按8字节指针处理，节点保存原始参数使显存在图存活期间不被回收
+            if(self.stream && self.stream.capture){
+                var params = new BigUint64Array(pointers.map(v => BigInt.asUintN(64,BigInt(v)))).buffer;
+                var layout = pointers.map((v,i) => ({type:"u64",size:8,offset:i * 8}));
+                self.stream.capture({type:"kernel",launcher:self,grid_size:self.grid_size,block_size:self.block_size,layout:layout,params:params,args:args});
+            }
+        }
+
+        /** 预打包的参数块，调用bind后创建 */
+        var packed = null;
+        /** 当前已经绑定到参数块中的参数 */
+        var boundArgs = [];
+
+        this.configure(grid_size,block_size,stream,smem);
+
+        /**
+         * 绑定参数到预打包的参数块中，之后可以反复调用launch
+         * 参数块按照核心PTX中的参数签名排布，参数可以是CudaBuffer(传入指针)、number、bigint，
+         * 或者是按值传入结构体时的ArrayBuffer/TypedArray(字节数需要和参数一致)
+         * @param  {...(CudaBuffer|number|bigint|ArrayBuffer|ArrayBufferView)} args 要绑定的参数
+         * @returns {CudaLauncher}
+         */
+        this.bind = function(...args){
+            createPacked(args.length);
+            for(var i = 0;i < args.length;i++){
+                self.setArg(i,args[i]);
+            }
+            return self;
+        }
+
+        /**
+         * 创建参数块，已经创建时只检查参数数量
+         * @param {number} count 参数数量
+         */
+        function createPacked(count){
+            if(packed == null){
+                var re = addon.createPackedLauncher(self.instantiate.instantiate,self.grid_size,self.block_size,count,streamOf(self.stream),self.smem);
+                packed = {handle:re.handle,params:re.params,layout:re.layout,view:new DataView(re.params)};
+                boundArgs = [];
+            }
+            if(count != packed.layout.length){
+                throw new Error(`参数数量错误，需要${packed.layout.length}个参数，传入了${count}个`);
+            }
+        }
+
+        /**
+         * 修改参数块中的一个参数，参数未变化时不做任何操作
+         * @param {number} index 参数序号
+         * @param {CudaBuffer|number|bigint|ArrayBuffer|ArrayBufferView} arg 新的参数
+         */
+        this.setArg = function(index,arg){
+            //按值传入的结构体每次都重新拷贝，内容可能已经改变
+            if(arg instanceof ArrayBuffer || ArrayBuffer.isView(arg)){
+                packParam(packed.params,packed.view,packed.layout[index],index,arg);
+                boundArgs[index] = null;
+                return;
+            }
+            if(boundArgs[index] === arg){
+                return;
+            }
+            boundArgs[index] = arg;
+            packParam(packed.params,packed.view,packed.layout[index],index,arg);
+        }
+
+        /**
+         * 开启或关闭启动统计，开启后每次启动前后在流中记录一对事件，统计结果通过实例的getLaunchStats读取
+         * 延迟提交和批量提交中的启动不统计
+         * @param {boolean} enabled 是否开启
+         * @returns {CudaLauncher}
+         */
+        this.setProfiling = function(enabled){
+            self.profiling = !!enabled;
+            return self;
+        }
+
+        /**
+         * 获取预打包的参数块，需要先调用bind
+         * @returns {{handle:number,params:ArrayBuffer,layout:{type:string,size:number,offset:number}[]}}
+         */
+        this.getPacked = function(){
+            if(packed == null){
+                throw new Error("启动器还没有绑定参数");
+            }
+            return packed;
+        }
+
+        /**
+         * 使用绑定好的参数块运行程序，运行失败时抛出异常
+         */
+        this.launch = function(){
+            streamOf(self.stream);
+            //捕获中的启动不统计，事件会被记录到图中
+            if(self.profiling && !(self.stream && self.stream.capture))
+                addon.launchPackedProfiled(packed.handle,self.instantiate.getProfile());
+            else
+                addon.launchPacked(packed.handle);
+            //在捕获中的流里启动时记录为图的核心节点，保存当前参数块的副本和绑定的参数
+            if(self.stream && self.stream.capture){
+                self.stream.capture({type:"kernel",launcher:self,grid_size:self.grid_size,block_size:self.block_size,layout:packed.layout,params:packed.params.slice(0),args:boundArgs.slice(0)});
+            }
         }
     }
 }
 
 module.exports.CudaLauncher = CudaLauncher;
 
-/** @type {CudaBuffer[]} 全局保存的cudaBuffer列表 */
-const globalBufferList = [];
+/**
+ * 批量提交的命令缓冲区，把一串启动、参数修改和拷贝编码为二进制命令，submit时一次原生调用按顺序全部执行
+ * 格式见cuda_batch.hpp，启动器需要先调用bind。编码好的命令可以反复提交，clear后重新编码
+ * 命令引用的参数块、显存、流和主机缓冲区在clear前都会保持存活，启动器之后重新configure时命令仍然使用编码时的参数块
+ */
+class CudaCommandBuffer{
+    constructor(){
+        var self = this;
+        /**已编码的字数 */
+        var length = 0;
+        /**命令数据 */
+        var words = new Uint32Array(256);
+        /**@type {Map<CudaStream,number>} 流在提交列表中的序号 */
+        var streamIndex = new Map();
+        /**@type {Map<ArrayBuffer,number>} 主机缓冲区在提交列表中的序号 */
+        var hostIndex = new Map();
+        /**提交时传入的流列表 */
+        var streams = [];
+        /**提交时传入的主机缓冲区列表 */
+        var hosts = [];
+        /**命令引用的对象，clear前不会被回收 */
+        var refs = new Set();
+        /**编码参数值使用的临时空间 */
+        var scratch = new ArrayBuffer(8);
+        var scratchView = new DataView(scratch);
+        var scratchWords = new Uint32Array(scratch);
+
+        /**命令数量 */
+        this.count = 0;
+
+        function push(){
+            if(length + arguments.length > words.length){
+                var grown = new Uint32Array(words.length * 2 + arguments.length);
+                grown.set(words);
+                words = grown;
+            }
+            for(var i = 0;i < arguments.length;i++){
+                words[length++] = arguments[i];
+            }
+        }
+        function header(op,size){
+            push(op | (size << 8));
+            self.count++;
+        }
+        function pushU64(value){
+            push(value >>> 0,Math.floor(value / 4294967296) >>> 0);
+        }
+        function streamRef(stream){
+            if(!stream){
+                return CudaCommandBuffer.DEFAULT_STREAM;
+            }
+            if(!streamIndex.has(stream)){
+                refs.add(stream);
+                streamIndex.set(stream,streams.length);
+                streams.push(stream);
+            }
+            return streamIndex.get(stream);
+        }
+        function pushAddress(buffer){
+            if(buffer instanceof CudaBuffer){
+                refs.add(buffer);
+                push(0);
+                pushU64(buffer.buffer);
+                return;
+            }
+            buffer = hostArrayBuffer(buffer);
+            if(!hostIndex.has(buffer)){
+                hostIndex.set(buffer,hosts.length);
+                hosts.push(buffer);
+            }
+            push(1,hostIndex.get(buffer),0);
+        }
+        function pushCopy(dst,src,size,stream){
+            header(4,10);
+            pushAddress(dst);
+            pushAddress(src);
+            pushU64(size);
+            push(streamRef(stream));
+        }
+
+        /**
+         * 启动，使用执行到这条命令时启动器的参数块
+         * @param {CudaLauncher} launcher 已经bind的启动器
+         * @param {{grid_size?:number[],block_size?:number[],stream?:CudaStream}} options 只覆盖这次启动的尺寸和流(可选)
+         * @returns {CudaCommandBuffer}
+         */
+        this.launch = function(launcher,options){
+            var packed = launcher.getPacked();
+            var handle = packed.handle;
+            //参数块在原生代码中持有实例，启动器持有它配置的流
+            refs.add(packed);
+            refs.add(launcher);
+            options = options || {};
+            if(options.grid_size || options.block_size){
+                var grid = options.grid_size || launcher.grid_size;
+                var block = options.block_size || launcher.block_size;
+                header(2,10);
+                pushU64(handle);
+                push(options.stream ? streamRef(options.stream) : CudaCommandBuffer.DEFAULT_STREAM,grid[0],grid[1],grid[2],block[0],block[1],block[2]);
+            }else{
+                header(1,4);
+                pushU64(handle);
+                push(options.stream ? streamRef(options.stream) : CudaCommandBuffer.DEFAULT_STREAM);
+            }
+            return self;
+        }
+
+        /**
+         * 修改启动器参数块中的一个参数，对之后的启动生效，只支持8字节以内的参数
+         * @param {CudaLauncher} launcher 已经bind的启动器
+         * @param {number} index 参数序号
+         * @param {CudaBuffer|number|bigint|ArrayBuffer|ArrayBufferView} arg 新的参数
+         * @returns {CudaCommandBuffer}
+         */
+        this.setArg = function(launcher,index,arg){
+            var packed = launcher.getPacked();
+            var param = packed.layout[index];
+            if(!param || param.size > 8){
+                throw new Error(`第${index}个参数不存在或者超过8字节`);
+            }
+            scratchWords[0] = scratchWords[1] = 0;
+            packParam(scratch,scratchView,{type:param.type,size:param.size,offset:0},index,arg);
+            refs.add(packed);
+            refs.add(launcher);
+            if(arg instanceof CudaBuffer){
+                refs.add(arg);
+            }
+            header(3,6);
+            pushU64(packed.handle);
+            push(index,scratchWords[0],scratchWords[1]);
+            return self;
+        }
+
+        /**
+         * 写入数据，执行完成前不能修改data
+         * @param {CudaBuffer} buffer 目标显存
+         * @param {ArrayBuffer|CudaHostBuffer} data 要写入的数据
+         * @param {CudaStream} stream 使用的流(可选，默认为默认流)
+         * @returns {CudaCommandBuffer}
+         */
+        this.write = function(buffer,data,stream){
+            pushCopy(buffer,data,hostArrayBuffer(data).byteLength,stream);
+            return self;
+        }
+
+        /**
+         * 读取数据
+         * @param {CudaBuffer} buffer 来源显存
+         * @param {ArrayBuffer|CudaHostBuffer} data 存储读取的数据的buffer
+         * @param {CudaStream} stream 使用的流(可选，默认为默认流)
+         * @returns {CudaCommandBuffer}
+         */
+        this.read = function(buffer,data,stream){
+            pushCopy(data,buffer,hostArrayBuffer(data).byteLength,stream);
+            return self;
+        }
+
+        /**
+         * 显存之间的拷贝
+         * @param {CudaBuffer} dst 目标
+         * @param {CudaBuffer} src 来源
+         * @param {number} size 字节数(可选，默认为两者中较小的尺寸)
+         * @param {CudaStream} stream 使用的流(可选，默认为默认流)
+         * @returns {CudaCommandBuffer}
+         */
+        this.copy = function(dst,src,size,stream){
+            pushCopy(dst,src,size != null ? size : Math.min(dst.size,src.size),stream);
+            return self;
+        }
+
+        /**
+         * 执行所有命令，只有一次原生调用，出错时抛出异常
+         * @returns {number} 执行的命令数量
+         */
+        this.submit = function(){
+            //提交时才取流句柄，编码之后释放的流会在这里报错
+            return addon.submitBatch(words.subarray(0,length),streams.map(streamOf),hosts);
+        }
+
+        /**
+         * 清空命令
+         * @returns {CudaCommandBuffer}
+         */
+        this.clear = function(){
+            length = 0;
+            self.count = 0;
+            streamIndex.clear();
+            hostIndex.clear();
+            streams = [];
+            hosts = [];
+            refs.clear();
+            return self;
+        }
+    }
+}
+
+/**使用启动器配置的流，拷贝为默认流 */
+CudaCommandBuffer.DEFAULT_STREAM = 0xFFFFFFFF;
+
+module.exports.CudaCommandBuffer = CudaCommandBuffer;
+
+
+/**
+ * 获取流句柄，没有传入时为默认流，流已经释放时抛出异常
+ * @param {CudaStream|null|undefined} stream
+ * @returns {number}
+ */
+function streamOf(stream){
+    if(stream == null) {return 0;}
+    if(!(stream instanceof CudaStream)) {throw new TypeError("需要传入CudaStream");}
+    if(stream.stream === null) {throw new Error("流已经释放");}
+    return stream.stream;
+}
+
+/**Cuda流，同一个流中的拷贝和运算按顺序执行，不同流之间可以并行 */
+class CudaStream{
+    constructor(){
+        var self = this;
+        var re = addon.createStream();
+        /**流的原生对象，被回收时释放流 */
+        this.handle = re.handle;
+        /**流句柄，释放后为null */
+        this.stream = re.stream;
+        /**@type {((node:object)=>void)|null} 被CudaGraph捕获时用于记录节点的回调 */
+        this.capture = null;
+
+        /**
+         * 等待流中当前所有的任务完成，会阻塞主线程
+         */
+        this.synchronize = function(){
+            addon.streamSynchronize(streamOf(self));
+        }
+
+        /**
+         * 获取一个在流中当前所有任务完成后resolve的Promise，不会阻塞主线程
+         * @returns {Promise<void>}
+         */
+        this.finish = function(){
+            return addon.streamPromise(streamOf(self),self);
+        }
+
+        /**
+         * 释放流，之后不能再使用，重复调用不会出错
+         */
+        this.destory = function(){
+            if(self.handle === null) {return;}
+            addon.destroyStream(self.handle);
+            self.handle = null;
+            self.stream = null;
+        }
+    }
+}
+
+module.exports.CudaStream = CudaStream;
+
+/**
+ * 获取事件句柄，事件已经释放时抛出异常
+ * @param {CudaEvent} e
+ * @returns {number}
+ */
+function eventOf(e){
+    if(!(e instanceof CudaEvent)) {throw new TypeError("需要传入CudaEvent");}
+    if(e.event === null) {throw new Error("事件已经释放");}
+    return e.event;
+}
+
+/**Cuda事件，在流中记录后可以查询之前的任务是否完成，以及两个事件之间的GPU时间 */
+class CudaEvent{
+    /**
+     * @param {{disableTiming?:boolean,blockingSync?:boolean}} options disableTiming为true时不记录时间(开销更小，只用于同步)，blockingSync为true时synchronize让出CPU而不是自旋等待
+     */
+    constructor(options){
+        var self = this;
+        options = options || {};
+        var re = addon.createEvent(!!options.disableTiming,!!options.blockingSync);
+        /**事件的原生对象，被回收时释放事件 */
+        this.handle = re.handle;
+        /**事件句柄，释放后为null */
+        this.event = re.event;
+
+        /**
+         * 在流中当前所有任务之后记录事件
+         * @param {CudaStream} stream 使用的流(可选，默认为默认流)
+         * @returns {CudaEvent}
+         */
+        this.record = function(stream){
+            addon.eventRecord(eventOf(self),streamOf(stream));
+            return self;
+        }
+
+        /**
+         * 事件之前的任务是否都已经完成，不会阻塞
+         * @returns {boolean}
+         */
+        this.query = function(){
+            return addon.eventQuery(eventOf(self));
+        }
+
+        /**
+         * 等待事件之前的任务完成，会阻塞主线程
+         */
+        this.synchronize = function(){
+            addon.eventSynchronize(eventOf(self));
+        }
+
+        /**
+         * 获取从这个事件到end之间的GPU时间，两个事件都需要已经完成
+         * @param {CudaEvent} end 结束的事件
+         * @returns {number} 毫秒
+         */
+        this.elapsedTime = function(end){
+            return addon.eventElapsedTime(eventOf(self),eventOf(end));
+        }
+
+        /**
+         * 释放事件，之后不能再使用，重复调用不会出错
+         */
+        this.destory = function(){
+            if(self.handle === null) {return;}
+            addon.destroyEvent(self.handle);
+            self.handle = null;
+            self.event = null;
+        }
+    }
+}
+
+module.exports.CudaEvent = CudaEvent;
+
+/**
+ * 获取拷贝使用的地址，CudaBuffer为显存指针，CudaHostBuffer为锁定内存的ArrayBuffer
+ * @param {CudaBuffer|CudaHostBuffer} buffer
+ * @returns {number|ArrayBuffer}
+ */
+function copyPointer(buffer){
+    if(buffer instanceof CudaBuffer)
+        return buffer.buffer;
+    if(buffer instanceof CudaHostBuffer)
+        return buffer.arrayBuffer;
+    throw new Error("图中的拷贝只支持CudaBuffer和CudaHostBuffer");
+}
+
+/**
+ * 在捕获中的流里排入拷贝并记录为图的拷贝节点
+ * 图在之后每次重放时都会重新拷贝，所以主机端需要是地址固定的锁定内存(CudaHostBuffer)
+ * @param {CudaStream} stream 捕获中的流
+ * @param {CudaBuffer|CudaHostBuffer} dst
+ * @param {CudaBuffer|CudaHostBuffer} src
+ * @param {number} size 字节数
+ * @returns {Promise<void>} 捕获时不会执行拷贝，直接resolve
+ */
+function captureCopy(stream,dst,src,size){
+    addon.memcpyAsync(copyPointer(dst),copyPointer(src),size,streamOf(stream));
+    stream.capture({type:"memcpy",dst:dst,src:src,size:size});
+    return Promise.resolve();
+}
+
+/**
+ * CUDA图，把排入捕获流中的一串启动和拷贝记录下来，实例化一次之后每次只需要一次原生调用就能重放整个序列
+ * 要记录的CudaLauncher需要使用graph.stream作为流，拷贝使用CudaBuffer的writeDataAsync/readDataAsync并传入graph.stream，
+ * 主机端需要使用CudaHostBuffer。捕获期间的操作只被记录而不会执行
+ */
+class CudaGraph{
+    constructor(){
+        var self = this;
+        /**捕获使用的流，也是launch默认使用的流 */
+        this.stream = new CudaStream();
+        /**图的原生对象，被回收时释放图 */
+        this.handle = null;
+        /**
+         * 按执行顺序排列的节点，核心节点保存启动器、尺寸、参数块和参数，拷贝节点保存拷贝的缓冲区，节点同时保持这些对象存活
+         * @type {{type:string,launcher?:CudaLauncher,grid_size?:number[],block_size?:number[],layout?:{type:string,size:number,offset:number}[],params?:ArrayBuffer,args?:any[],dst?:object,src?:object,size?:number}[]}
+         */
+        this.nodes = [];
+        /**捕获中记录的节点 */
+        var records = null;
+
+        /**
+         * 开始捕获，之后排入graph.stream的启动和拷贝都记录到图中
+         * @returns {CudaStream} 捕获使用的流
+         */
+        this.begin = function(){
+            if(records){
+                throw new Error("图已经在捕获中");
+            }
+            addon.graphBeginCapture(streamOf(self.stream));
+            records = [];
+            self.stream.capture = node => records.push(node);
+            return self.stream;
+        }
+
+        /**
+         * 结束捕获并实例化图，之前的图会被释放
+         * @returns {CudaGraph}
+         */
+        this.end = function(){
+            if(!records){
+                throw new Error("图没有在捕获中");
+            }
+            var list = records;
+            records = null;
+            self.stream.capture = null;
+            var re = addon.graphEndCapture(streamOf(self.stream));
+            if(self.handle){
+                addon.graphDestroy(self.handle);
+            }
+            self.handle = re.handle;
+            //捕获到的节点和记录的节点一一对应时使用记录的信息，否则(如在流中排入了其它操作)只能修改尺寸
+            var matched = re.nodes.length == list.length && list.every((v,i) => v.type == re.nodes[i]);
+            self.nodes = matched ? list : re.nodes.map(type => ({type:type}));
+            return self;
+        }
+
+        /**
+         * 捕获fn中排入的操作，fn执行完或者抛出异常时结束捕获
+         * @param {(stream:CudaStream)=>void} fn 在捕获流中排入操作的函数
+         * @returns {CudaGraph}
+         */
+        this.capture = function(fn){
+            var stream = self.begin();
+            try{
+                fn(stream);
+            }finally{
+                self.end();
+            }
+            return self;
+        }
+
+        /**
+         * 在流中重放整个图，不会阻塞，使用stream.finish()等待完成
+         * @param {CudaStream} stream 使用的流(可选，默认为graph.stream)
+         */
+        this.launch = function(stream){
+            addon.graphLaunch(self.handle,streamOf(stream || self.stream));
+        }
+
+        /**
+         * 修改核心节点的尺寸和参数，之后的重放使用新的值，不需要重新捕获
+         * @param {number} index 节点序号
+         * @param {{grid_size?:number[],block_size?:number[],args?:(CudaBuffer|number|bigint|ArrayBuffer|ArrayBufferView)[]}} options 要修改的内容，args中为undefined的参数保持不变
+         * @returns {CudaGraph}
+         */
+        this.setKernel = function(index,options){
+            var node = self.nodes[index];
+            if(!node || node.type != "kernel"){
+                throw new Error(`第${index}个节点不是核心节点`);
+            }
+            var args = options.args;
+            if(args && !node.layout){
+                throw new Error(`第${index}个节点没有参数签名，只能修改尺寸`);
+            }
+            if(args){
+                var view = new DataView(node.params);
+                for(var i = 0;i < args.length;i++){
+                    if(args[i] !== undefined){
+                        packParam(node.params,view,node.layout[i],i,args[i]);
+                    }
+                }
+            }
+            addon.graphSetKernelNode(self.handle,index,options.grid_size || null,options.block_size || null,args ? node.params : null,args ? node.layout.map(v => v.offset) : null);
+            if(options.grid_size) node.grid_size = options.grid_size;
+            if(options.block_size) node.block_size = options.block_size;
+            //替换保存的参数，之前的显存不再被图引用
+            if(args){
+                node.args = node.args || [];
+                for(var i = 0;i < args.length;i++){
+                    if(args[i] !== undefined){
+                        node.args[i] = args[i];
+                    }
+                }
+            }
+            return self;
+        }
+
+        /**
+         * 修改拷贝节点的缓冲区，需要CUDA 11.1以上
+         * @param {number} index 节点序号
+         * @param {CudaBuffer|CudaHostBuffer} dst 目标
+         * @param {CudaBuffer|CudaHostBuffer} src 来源
+         * @param {number} size 字节数
+         * @returns {CudaGraph}
+         */
+        this.setCopy = function(index,dst,src,size){
+            var node = self.nodes[index];
+            if(!node || node.type != "memcpy"){
+                throw new Error(`第${index}个节点不是拷贝节点`);
+            }
+            addon.graphSetMemcpyNode(self.handle,index,copyPointer(dst),copyPointer(src),size);
+            node.dst = dst;
+            node.src = src;
+            node.size = size;
+            return self;
+        }
+
+        /**
+         * 释放图和捕获使用的流
+         */
+        this.destory = function(){
+            if(self.handle){
+                addon.graphDestroy(self.handle);
+                self.handle = null;
+            }
+            self.nodes = [];
+            self.stream.destory();
+        }
+    }
+}
+
+module.exports.CudaGraph = CudaGraph;
+
+/**
+ * 获取读写方法使用的ArrayBuffer，CudaHostBuffer使用其锁定内存
+ * @param {ArrayBuffer|CudaHostBuffer} buffer
+ * @returns {ArrayBuffer}
+ */
+function hostArrayBuffer(buffer){
+    return buffer instanceof CudaHostBuffer ? buffer.arrayBuffer : buffer;
+}
+
+/** @type {Set<WeakRef<CudaBuffer>>} 全局的cudaBuffer列表，只保存弱引用，不会阻止buffer被回收 */
+const globalBufferList = new Set();
+/** buffer被回收后从列表中移除 */
+const globalBufferRegistry = new FinalizationRegistry(ref => globalBufferList.delete(ref));
 /**Cuda缓冲区 */
 class CudaBuffer{
-    constructor(size){
+    /**
+     * @param {number} size 缓冲区字节数
+     * @param {{pool?:boolean,shared?:number}} options pool为false时不使用显存缓存池，直接申请和释放显存，shared为其它worker中share()返回的编号，设置时打开共享的显存而不是申请新的显存
+     */
+    constructor(size,options){
         var self = this;
+        options = options || {};
+        var re = options.shared != null ? addon.openSharedBuffer(options.shared) : addon.createBuffer(size,options.pool != null ? !!options.pool : bufferPool.enabled);
+        /**是否从显存缓存池中申请 */
+        this.pooled = re.pooled;
+        /**显存的原生对象，被回收时释放显存(共享的显存在所有worker中都被回收后才释放) */
+        this.handle = re.handle;
         /**缓冲区指针 */
-        this.buffer = addon.createBuffer(size);
+        this.buffer = re.ptr;
         /**缓冲区尺寸 */
-        this.size = size;
+        this.size = re.size;
         //加入到全局
-        globalBufferList.push(this);
+        var ref = new WeakRef(this);
+        globalBufferList.add(ref);
+        globalBufferRegistry.register(this,ref,ref);
 
         /**
          * 写入数据
-         * @param {ArrayBuffer} buffer 要写入的buffer
+         * @param {ArrayBuffer|CudaHostBuffer} buffer 要写入的buffer
          */
         this.writeData = function(buffer){
+            buffer = hostArrayBuffer(buffer);
+            //延迟提交模式下写入数据的副本，返回后修改buffer不会影响写入的内容
+            if(deferredSubmission.enabled){
+                var copy = buffer.slice(0);
+                deferredPush(null,false,(commands,stream) => commands.write(self,copy,stream));
+                return;
+            }
             //写入buffer
             addon.writeBuffer(self.buffer,buffer,buffer.byteLength);
         }
 
         /**
-         * 读取数据
-         * @param {ArrayBuffer} buffer 要存储读取的数据的buffer
+         * 读取数据，延迟提交模式下返回提交并读取完成后resolve的Promise
+         * @param {ArrayBuffer|CudaHostBuffer} buffer 要存储读取的数据的buffer
+         * @returns {void|Promise<void>}
          */
         this.readData = function(buffer){
+            buffer = hostArrayBuffer(buffer);
+            if(deferredSubmission.enabled){
+                deferredPush(null,false,(commands,stream) => commands.read(self,buffer,stream));
+                return new Promise((resolve,reject) => deferredQueue.reads.push({resolve:resolve,reject:reject}));
+            }
             //读取buffer
             addon.readBuffer(self.buffer,buffer,buffer.byteLength);
         }
 
+        /**
+         * 在流中异步写入数据，完成前不能修改buffer
+         * @param {ArrayBuffer|CudaHostBuffer} buffer 要写入的buffer
+         * @param {CudaStream} stream 使用的流
+         * @returns {Promise<void>} 写入完成后resolve
+         */
+        this.writeDataAsync = function(buffer,stream){
+            if(stream.capture){
+                return captureCopy(stream,self,buffer,hostArrayBuffer(buffer).byteLength);
+            }
+            buffer = hostArrayBuffer(buffer);
+            return addon.writeBufferAsync(self.buffer,buffer,buffer.byteLength,streamOf(stream),stream,self);
+        }
+
+        /**
+         * 在流中异步读取数据
+         * @param {ArrayBuffer|CudaHostBuffer} buffer 要存储读取的数据的buffer
+         * @param {CudaStream} stream 使用的流
+         * @returns {Promise<void>} 读取完成后resolve
+         */
+        this.readDataAsync = function(buffer,stream){
+            if(stream.capture){
+                return captureCopy(stream,buffer,self,hostArrayBuffer(buffer).byteLength);
+            }
+            buffer = hostArrayBuffer(buffer);
+            return addon.readBufferAsync(self.buffer,buffer,buffer.byteLength,streamOf(stream),stream,self);
+        }
+
+        /**
+         * 共享给其它worker，返回的编号通过postMessage发送后使用CudaBuffer.fromShared打开，每个编号只能打开一次
+         * 编号在被打开之前会一直持有显存，不再需要时使用CudaBuffer.revokeShared撤销，当前worker退出时也会自动撤销
+         * @returns {number}
+         */
+        this.share = function(){
+            return addon.shareBuffer(self.handle);
+        }
+
         /**
          * 释放显存
          */
         this.destory = function(){
-            globalBufferList.splice(globalBufferList.indexOf(this),1);
-            addon.freeBuffer(this.buffer);
+            globalBufferList.delete(ref);
+            globalBufferRegistry.unregister(ref);
+            addon.freeBuffer(self.handle);
         }
     }
 }
 
+/**
+ * 打开其它worker共享的显存
+ * @param {number} shared 其它worker中share()返回的编号
+ * @returns {CudaBuffer}
+ */
+CudaBuffer.fromShared = function(shared){
+    return new CudaBuffer(0,{shared:shared});
+}
+
+/**
+ * 撤销还没有被打开的共享编号，释放它持有的显存引用，只能在调用share()的worker中撤销
+ * @param {number} shared share()返回的编号
+ * @returns {boolean} 是否撤销成功，编号已经被打开或者不存在时返回false
+ */
+CudaBuffer.revokeShared = function(shared){
+    return addon.revokeSharedBuffer(shared);
+}
+
 /** 释放所有的buffer */
 module.exports.DestoryAllBuffer = function(){
-    for(var i = globalBufferList.length - 1;i >= 0;i--){
-        globalBufferList[i].destory();
+    for(var ref of [...globalBufferList]){
+        var buffer = ref.deref();
+        if(buffer){
+            buffer.destory();
+        }else{
+            globalBufferList.delete(ref);
+        }
     }
 }
 
 module.exports.CudaBuffer = CudaBuffer;
 
+/**显存缓存池，CudaBuffer释放后显存会缓存起来供之后相近尺寸的申请复用，释放前已经排入流中的任务完成后才会复用(pendingBytes为等待中的字节数) */
+var bufferPool = {
+    /**新建的CudaBuffer是否默认使用缓存池 */
+    enabled:true,
+    /**
+     * 获取缓存池统计信息
+     * @returns {{hits:number,misses:number,cachedBytes:number,inUseBytes:number,requestedBytes:number,fragmentationBytes:number,trimmed:number,pendingBytes:number,highWater:number}}
+     */
+    getStats:function(){
+        return addon.getBufferPoolStats();
+    },
+    /**
+     * 设置缓存的空闲显存上限，超出后释放多余的缓存
+     * @param {number} bytes 上限字节数，0为不限制
+     */
+    setHighWater:function(bytes){
+        addon.setBufferPoolHighWater(bytes);
+    },
+    /**
+     * 释放缓存的空闲显存
+     * @param {number} bytes 保留的字节数，默认全部释放
+     */
+    trim:function(bytes){
+        addon.trimBufferPool(bytes || 0);
+    }
+};
+module.exports.bufferPool = bufferPool;
+
+/**延迟提交的队列 */
+var deferredQueue = {
+    /**@type {CudaCommandBuffer} 提交时用来编码的命令缓冲区 */
+    commands:null,
+    /**@type {{stream:CudaStream,launch:boolean,encode:(commands:CudaCommandBuffer,stream:CudaStream)=>void}[]} 当前事件循环中排入的操作 */
+    ops:[],
+    /**等待提交完成的读取 */
+    reads:[],
+    /**是否已经安排了提交的微任务 */
+    scheduled:false
+};
+
+/**
+ * 把一个操作加入延迟提交的队列，并安排在当前事件循环的微任务中提交
+ * @param {CudaStream} stream 启动使用的流，拷贝传入null，提交时使用相邻启动的流
+ * @param {boolean} launch 是否为启动
+ * @param {(commands:CudaCommandBuffer,stream:CudaStream)=>void} encode 提交时编码命令的函数
+ */
+function deferredPush(stream,launch,encode){
+    if(!deferredQueue.scheduled){
+        deferredQueue.scheduled = true;
+        queueMicrotask(flushScheduled);
+    }
+    deferredQueue.ops.push({stream:stream,launch:launch,encode:encode});
+}
+
+/**
+ * 通过一次submitBatch提交队列中的所有命令，有读取时等待用到的所有流完成后resolve，出错时reject所有的读取
+ * 拷贝排入之前最近一次启动的流中(之前没有启动时使用之后第一次启动的流)，保证和启动的先后顺序
+ * @returns {Error} 提交出错时返回错误，否则返回null
+ */
+function flushDeferred(){
+    deferredQueue.scheduled = false;
+    var ops = deferredQueue.ops;
+    var reads = deferredQueue.reads;
+    deferredQueue.ops = [];
+    deferredQueue.reads = [];
+    if(ops.length == 0){
+        return null;
+    }
+    if(deferredQueue.commands == null)
+        deferredQueue.commands = new CudaCommandBuffer();
+    var commands = deferredQueue.commands;
+    var error = null;
+    try{
+        var first = ops.find(v => v.launch);
+        var stream = first ? first.stream : null;
+        var streams = new Set();
+        for(var op of ops){
+            if(op.launch){
+                stream = op.stream;
+            }
+            streams.add(stream);
+            op.encode(commands,stream);
+        }
+        commands.submit();
+        if(reads.length){
+            streams.forEach(v => addon.streamSynchronize(streamOf(v)));
+        }
+    }catch(e){
+        error = e;
+    }finally{
+        commands.clear();
+    }
+    reads.forEach(v => error ? v.reject(error) : v.resolve());
+    return error;
+}
+
+/**
+ * 微任务中的提交，出错且没有读取接收错误时交给onError，没有设置时输出到控制台，不抛出未捕获的异常
+ */
+function flushScheduled(){
+    var reads = deferredQueue.reads.length;
+    var error = flushDeferred();
+    if(error && !reads){
+        if(deferredSubmission.onError)
+            deferredSubmission.onError(error);
+        else
+            console.error(error);
+    }
+}
+
+/**
+ * 延迟提交模式，开启后CudaLauncher.run、CudaBuffer.writeData、readData不会立即执行，
+ * 而是加入当前事件循环的队列，在微任务中通过一次原生调用按顺序全部提交，原有的调用代码不需要修改就能批量提交。
+ * 这时readData返回Promise，队列提交前不能释放其中用到的CudaBuffer。拷贝和相邻的启动使用同一个流。
+ * 其它方法(如launch、writeDataAsync)不经过队列，和队列混用时需要先调用flush
+ */
+var deferredSubmission = {
+    /**是否开启 */
+    enabled:false,
+    /**
+     * 提交出错且队列中没有读取时的回调(可选)，没有设置时输出到控制台
+     * @type {(error:Error)=>void}
+     */
+    onError:null,
+    /**
+     * 开启延迟提交
+     */
+    enable:function(){
+        deferredSubmission.enabled = true;
+    },
+    /**
+     * 提交队列中的命令并关闭延迟提交，出错时和微任务中的提交一样交给onError
+     */
+    disable:function(){
+        flushScheduled();
+        deferredSubmission.enabled = false;
+    },
+    /**
+     * 立即提交队列中的命令
+     * @returns {Promise<void>} 提交成功后resolve，出错时reject
+     */
+    flush:function(){
+        var error = flushDeferred();
+        return error ? Promise.reject(error) : Promise.resolve();
+    }
+};
+module.exports.deferredSubmission = deferredSubmission;
+
+
+/**锁定内存缓冲区，内存直接作为ArrayBuffer使用，拷贝到显存时不需要经过驱动的中转缓冲区，异步拷贝也不会阻塞 */
+class CudaHostBuffer{
+    /**
+     * @param {number} size 缓冲区字节数
+     * @param {{writeCombined?:boolean}} options writeCombined为true时使用写合并内存，上传更快但js读取很慢，只适合用于上传
+     */
+    constructor(size,options){
+        options = options || {};
+        /**锁定内存的ArrayBuffer，被回收时自动释放锁定内存，可以直接传给CudaBuffer的读写方法 */
+        this.arrayBuffer = addon.createHostArrayBuffer(size,!!options.writeCombined);
+        /**缓冲区尺寸 */
+        this.size = size;
+    }
+}
+
+module.exports.CudaHostBuffer = CudaHostBuffer;
+
 
 /**Cuda三维缓冲区 */
 class CudaBuffer3D{
@@ -292,15 +1611,19 @@ class CudaBuffer3D{
         /**缓冲区指针 */
         this.instance = addon.createBuffer3D(size.x * unitSize,size.y,size.z);
         
-        var ptrBuffer = new CudaBuffer(4 * 8);
-        ptrBuffer.writeData(new BigUint64Array([
+        /**按值传入核心的指针结构体{ptr,pitch,xsize,ysize,depth}，可以直接作为CudaLauncher.bind的参数 */
+        this.pitchedPtr = new BigUint64Array([
             BigInt(this.instance.ptr),
             BigInt(this.instance.pitch),
             BigInt(this.instance.xsize),
             BigInt(this.instance.ysize),
             BigInt(size.z)
-        ]).buffer);
+        ]).buffer;
+        var ptrBuffer = new CudaBuffer(5 * 8);
+        ptrBuffer.writeData(this.pitchedPtr);
 
+        /**保存指针结构体的显存，需要和三维缓冲区一起保留 */
+        this.ptrBuffer = ptrBuffer;
         this.buffer = ptrBuffer.buffer;
         /**缓冲区尺寸 */
         this.size = size;
@@ -309,21 +1632,45 @@ class CudaBuffer3D{
 
         /**
          * 写入数据
-         * @param {ArrayBuffer} buffer 要写入的buffer
+         * @param {ArrayBuffer|CudaHostBuffer} buffer 要写入的buffer
          */
         this.writeData = function(buffer){
+            buffer = hostArrayBuffer(buffer);
             //写入buffer
             addon.writeBuffer3D(self.instance.index,buffer,size.x * unitSize,size.y,size.z,size.x);
         }
 
         /**
          * 读取数据
-         * @param {ArrayBuffer} buffer 要存储读取的数据的buffer
+         * @param {ArrayBuffer|CudaHostBuffer} buffer 要存储读取的数据的buffer
          */
         this.readData = function(buffer){
+            buffer = hostArrayBuffer(buffer);
             //读取buffer
             addon.readBuffer3D(self.instance.index,buffer,size.x * unitSize,size.y,size.z,size.x);
         }
+
+        /**
+         * 在流中异步写入数据，完成前不能修改buffer
+         * @param {ArrayBuffer|CudaHostBuffer} buffer 要写入的buffer
+         * @param {CudaStream} stream 使用的流
+         * @returns {Promise<void>} 写入完成后resolve
+         */
+        this.writeDataAsync = function(buffer,stream){
+            buffer = hostArrayBuffer(buffer);
+            return addon.writeBuffer3DAsync(self.instance.index,buffer,size.x * unitSize,size.y,size.z,size.x,streamOf(stream),stream,self);
+        }
+
+        /**
+         * 在流中异步读取数据
+         * @param {ArrayBuffer|CudaHostBuffer} buffer 要存储读取的数据的buffer
+         * @param {CudaStream} stream 使用的流
+         * @returns {Promise<void>} 读取完成后resolve
+         */
+        this.readDataAsync = function(buffer,stream){
+            buffer = hostArrayBuffer(buffer);
+            return addon.readBuffer3DAsync(self.instance.index,buffer,size.x * unitSize,size.y,size.z,size.x,streamOf(stream),stream,self);
+        }
     }
 }
 
@@ -341,8 +1688,11 @@ class CudaBufferTexture3D{
         this.cudaBuffer = cudaBuffer;
         /**显存占用的字节数 */
         this.length = cudaBuffer.instance.pitch * cudaBuffer.size.y * cudaBuffer.size.z;
+        var re = addon.createTexture3D(this.cudaBuffer.buffer,this.length);
+        /**贴图的原生对象，被回收时释放贴图 */
+        this.handle = re.handle;
         /**贴图指针 */
-        this.buffer = addon.createTexture3D(this.cudaBuffer.buffer,this.length);
+        this.buffer = re.texture;
     }
 }
 
@@ -361,8 +1711,11 @@ class CudaTexutre3D{
         this.cudaBuffer = cudaBuffer;
         /**贴图尺寸 */
         this.size = size;
+        var re = addon.createTexture3D(this.cudaBuffer.buffer,this.cudaBuffer.size,size.x,size.y,size.z);
+        /**贴图的原生对象，被回收时释放贴图 */
+        this.handle = re.handle;
         /**贴图指针 */
-        this.buffer = addon.createTexture3D(this.cudaBuffer.buffer,this.cudaBuffer.size,size.x,size.y,size.z);
+        this.buffer = re.texture;
     }
 }
 
@@ -376,25 +1729,27 @@ class CudaArray3D{
      */
     constructor(size){
         var self = this;
-        /**数组指针 */
+        /**数组的原生对象，被回收时释放数组 */
         this.buffer = addon.createArray3D(size.x,size.y,size.z);
         /**缓冲区尺寸 */
         this.size = size;
 
         /**
          * 写入数据
-         * @param {ArrayBuffer} buffer 要写入的buffer
+         * @param {ArrayBuffer|CudaHostBuffer} buffer 要写入的buffer
          */
         this.writeData = function(buffer){
+            buffer = hostArrayBuffer(buffer);
             //写入buffer
             addon.writeArray3D(self.buffer,buffer,size.x,size.y,size.z);
         }
 
         /**
          * 读取数据
-         * @param {ArrayBuffer} buffer 要存储读取的数据的buffer
+         * @param {ArrayBuffer|CudaHostBuffer} buffer 要存储读取的数据的buffer
          */
         this.readData = function(buffer){
+            buffer = hostArrayBuffer(buffer);
             //读取buffer
             addon.readArray3D(self.buffer,buffer,size.x,size.y,size.z);
         }
@@ -85,15 +85,26 @@
 #define JITIFY_THREAD_SAFE 1
 #endif
 
+// When the current device has no explicit -arch option, compile straight to
+// a cubin for its real architecture (sm_XX) where NVRTC supports it (CUDA
+// 11.1+), instead of to PTX that the driver must JIT compile on load. This can
+// also be disabled at runtime by setting the environment variable
+// JITIFY_NATIVE_CUBIN=0, or per program by passing an explicit -arch option.
+#ifndef JITIFY_NATIVE_CUBIN
+#define JITIFY_NATIVE_CUBIN 1
+#endif
+
 #if JITIFY_ENABLE_EMBEDDED_FILES
 #include <dlfcn.h>
 #endif
 #include <stdint.h>
 #include <algorithm>
+#include <atomic>
 #include <cctype>
 #include <cstring>  // For strtok_r etc.
 #include <deque>
 #include <fstream>
+#include <functional>
 #include <iomanip>
 #include <iostream>
 #include <map>
@@ -106,6 +117,7 @@
 #include <unordered_set>
 #include <vector>
 #if JITIFY_THREAD_SAFE
+#include <future>
 #include <mutex>
 #endif
 
@@ -129,6 +141,20 @@
 #error "Unsupported platform"
 #endif
 
+// For use by experimental::KernelDiskCache.
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <cstdio>  // For std::rename, std::remove
+#ifdef __linux__
+#include <dirent.h>
+#include <unistd.h>
+#include <utime.h>
+#elif defined(_WIN32) || defined(_WIN64)
+#include <direct.h>
+#include <process.h>
+#include <sys/utime.h>
+#endif
+
 #ifdef _MSC_VER       // MSVC compiler
 #include <dbghelp.h>  // For UnDecorateSymbolName
 #else
@@ -201,7 +227,21 @@ typedef std::istream* (*file_callback_type)(std::string filename,
 
 class JitCache;
 
-// Simple cache using LRU discard policy
+// Counters reported by ObjectCache::stats()
+struct ObjectCacheStats {
+  size_t hits;       // Calls to get()
+  size_t misses;     // Calls to insert() or emplace()
+  size_t evictions;  // Entries discarded to stay within capacity
+  size_t size;       // Number of entries
+  size_t bytes;      // Sum of entry weights
+};
+
+// Simple cache using LRU discard policy. Entries live in a hash map and are
+// ranked by an intrusive doubly linked list, so lookup, touch and discard are
+// all O(1). In addition to the entry count, the cache can be bounded by the
+// sum of per-entry byte weights (see set_weight).
+// Note: References returned by get/insert/emplace remain valid until the
+//         entry is discarded.
 template <typename KeyType, typename ValueType>
 class ObjectCache {
  public:
@@ -209,67 +249,271 @@ class ObjectCache {
   typedef ValueType value_type;
 
  private:
-  typedef std::map<key_type, value_type> object_map;
-  typedef std::deque<key_type> key_rank;
-  typedef typename key_rank::iterator rank_iterator;
+  struct Entry {
+    key_type key;
+    value_type value;
+    size_t weight;
+    Entry* prev;  // Towards the most-recently-used end
+    Entry* next;  // Towards the least-recently-used end
+    template <typename... Args>
+    Entry(const key_type& k, Args&&... args)
+        : key(k),
+          value(std::forward<Args>(args)...),
+          weight(0),
+          prev(nullptr),
+          next(nullptr) {}
+  };
+  typedef std::unordered_map<key_type, std::unique_ptr<Entry> > object_map;
   object_map _objects;
-  key_rank _ranked_keys;
+  Entry* _head;  // Most recently used
+  Entry* _tail;  // Least recently used
   size_t _capacity;
-
+  size_t _byte_capacity;
+  size_t _bytes;
+  size_t _hits;
+  size_t _misses;
+  size_t _evictions;
+
+  inline void unlink(Entry* e) {
+    (e->prev ? e->prev->next : _head) = e->next;
+    (e->next ? e->next->prev : _tail) = e->prev;
+    e->prev = e->next = nullptr;
+  }
+  inline void link_front(Entry* e) {
+    e->prev = nullptr;
+    e->next = _head;
+    (_head ? _head->prev : _tail) = e;
+    _head = e;
+  }
+  inline Entry* find(const key_type& k) const {
+    auto iter = _objects.find(k);
+    if (iter == _objects.end()) {
+      throw std::runtime_error("Key not found in cache");
+    }
+    return iter->second.get();
+  }
+  inline bool over_budget(size_t n) const {
+    return _objects.size() + n > _capacity ||
+           (_byte_capacity && _bytes > _byte_capacity);
+  }
+  // Discards least-recently-used entries until n more entries fit. The
+  // most-recently-used entry is never discarded to satisfy the byte budget,
+  // so that a single oversized entry can still be cached.
   inline void discard_old(size_t n = 0) {
     if (n > _capacity) {
       throw std::runtime_error("Insufficient capacity in cache");
     }
-    while (_objects.size() > _capacity - n) {
-      key_type discard_key = _ranked_keys.back();
-      _ranked_keys.pop_back();
-      _objects.erase(discard_key);
+    while (_tail && over_budget(n)) {
+      if (_tail == _head && _objects.size() + n <= _capacity) break;
+      Entry* discard = _tail;
+      unlink(discard);
+      _bytes -= discard->weight;
+      ++_evictions;
+      _objects.erase(discard->key);
+    }
+  }
+  template <typename... Args>
+  inline value_type& emplace_entry(const key_type& k, Args&&... args) {
+    this->discard_old(1);
+    std::unique_ptr<Entry> entry(new Entry(k, std::forward<Args>(args)...));
+    Entry* e = entry.get();
+    auto iter = _objects.find(k);
+    if (iter != _objects.end()) {
+      // Replace an existing entry.
+      unlink(iter->second.get());
+      _bytes -= iter->second->weight;
+      iter->second = std::move(entry);
+    } else {
+      _objects.emplace(k, std::move(entry));
     }
+    link_front(e);
+    ++_misses;
+    return e->value;
   }
 
  public:
-  inline ObjectCache(size_t capacity = 8) : _capacity(capacity) {}
+  inline ObjectCache(size_t capacity = 8, size_t byte_capacity = 0)
+      : _head(nullptr),
+        _tail(nullptr),
+        _capacity(capacity),
+        _byte_capacity(byte_capacity),
+        _bytes(0),
+        _hits(0),
+        _misses(0),
+        _evictions(0) {}
+  inline ObjectCache(ObjectCache const&) = delete;
+  inline ObjectCache& operator=(ObjectCache const&) = delete;
   inline void resize(size_t capacity) {
     _capacity = capacity;
     this->discard_old();
   }
+  // Sets the maximum sum of entry weights (0 means unlimited).
+  inline void resize_bytes(size_t byte_capacity) {
+    _byte_capacity = byte_capacity;
+    this->discard_old();
+  }
   inline bool contains(const key_type& k) const {
     return (bool)_objects.count(k);
   }
   inline void touch(const key_type& k) {
-    if (!this->contains(k)) {
-      throw std::runtime_error("Key not found in cache");
-    }
-    rank_iterator rank = std::find(_ranked_keys.begin(), _ranked_keys.end(), k);
-    if (rank != _ranked_keys.begin()) {
+    Entry* e = this->find(k);
+    if (e != _head) {
       // Move key to front of ranks
-      _ranked_keys.erase(rank);
-      _ranked_keys.push_front(k);
+      unlink(e);
+      link_front(e);
     }
   }
   inline value_type& get(const key_type& k) {
-    if (!this->contains(k)) {
-      throw std::runtime_error("Key not found in cache");
-    }
     this->touch(k);
-    return _objects[k];
+    ++_hits;
+    return _head->value;
+  }
+  // Sets the byte weight of an entry (e.g., once its size is known) and
+  // discards older entries as needed to stay within the byte budget.
+  inline void set_weight(const key_type& k, size_t weight) {
+    Entry* e = this->find(k);
+    _bytes = _bytes - e->weight + weight;
+    e->weight = weight;
+    this->touch(k);
+    this->discard_old();
   }
   inline value_type& insert(const key_type& k,
                             const value_type& v = value_type()) {
-    this->discard_old(1);
-    _ranked_keys.push_front(k);
-    return _objects.insert(std::make_pair(k, v)).first->second;
+    return this->emplace_entry(k, v);
   }
   template <typename... Args>
   inline value_type& emplace(const key_type& k, Args&&... args) {
-    this->discard_old(1);
-    // Note: Use of piecewise_construct allows non-movable non-copyable types
-    auto iter = _objects
-                    .emplace(std::piecewise_construct, std::forward_as_tuple(k),
-                             std::forward_as_tuple(args...))
-                    .first;
-    _ranked_keys.push_front(iter->first);
-    return iter->second;
+    // Note: Constructing in place allows non-movable non-copyable types
+    return this->emplace_entry(k, std::forward<Args>(args)...);
+  }
+  inline void erase(const key_type& k) {
+    auto iter = _objects.find(k);
+    if (iter != _objects.end()) {
+      unlink(iter->second.get());
+      _bytes -= iter->second->weight;
+      _objects.erase(iter);
+    }
+  }
+  inline size_t size() const { return _objects.size(); }
+  inline size_t bytes() const { return _bytes; }
+  inline ObjectCacheStats stats() const {
+    ObjectCacheStats s;
+    s.hits = _hits;
+    s.misses = _misses;
+    s.evictions = _evictions;
+    s.size = _objects.size();
+    s.bytes = _bytes;
+    return s;
+  }
+};
+
+// Cache of shared objects that are expensive to build (e.g., compiled
+// kernels). Keys are spread over independently locked shards, each with its
+// own LRU discard policy, and an object is built outside of any lock by the
+// first thread that requests it. Concurrent requests for the same key wait
+// for that build (and see its exception if it fails), while different keys
+// are built in parallel. Objects are held by shared_ptr so that discarding an
+// entry does not invalidate objects that are still in use.
+template <typename KeyType, typename ValueType>
+class SharedObjectCache {
+ public:
+  typedef KeyType key_type;
+  typedef ValueType value_type;
+  typedef std::shared_ptr<value_type> pointer;
+  enum { DEFAULT_SHARDS = 16 };
+
+ private:
+#if JITIFY_THREAD_SAFE
+  typedef std::shared_future<pointer> slot_type;
+#else
+  typedef pointer slot_type;
+#endif
+  struct Shard {
+    ObjectCache<key_type, slot_type> objects;
+#if JITIFY_THREAD_SAFE
+    std::mutex mutex;
+#endif
+    Shard(size_t capacity, size_t byte_capacity)
+        : objects(capacity, byte_capacity) {}
+  };
+  std::vector<std::unique_ptr<Shard> > _shards;
+
+  inline Shard& shard(const key_type& k) const {
+    return *_shards[std::hash<key_type>()(k) % _shards.size()];
+  }
+
+ public:
+  // Note: capacity and byte_capacity are divided evenly between the shards,
+  //         so discarding is only approximately LRU across the whole cache.
+  inline SharedObjectCache(size_t capacity, size_t byte_capacity = 0,
+                           size_t num_shards = DEFAULT_SHARDS) {
+#if !JITIFY_THREAD_SAFE
+    num_shards = 1;
+#endif
+    num_shards = std::max(std::min(num_shards, capacity), size_t(1));
+    size_t shard_capacity = (capacity + num_shards - 1) / num_shards;
+    size_t shard_bytes = (byte_capacity + num_shards - 1) / num_shards;
+    for (size_t i = 0; i < num_shards; ++i) {
+      _shards.emplace_back(new Shard(shard_capacity, shard_bytes));
+    }
+  }
+  // Returns the object for k, calling build(&weight) to create it (and set
+  // its byte weight) if it is not already cached or being built.
+  template <typename BuildFunc>
+  inline pointer get_or_build(const key_type& k, BuildFunc build) {
+    Shard& s = this->shard(k);
+    size_t weight = 0;
+    pointer value;
+#if JITIFY_THREAD_SAFE
+    std::promise<pointer> promise;
+    std::unique_lock<std::mutex> lock(s.mutex);
+    if (s.objects.contains(k)) {
+      slot_type slot = s.objects.get(k);
+      // Wait (without holding the lock) for any build that is in flight.
+      lock.unlock();
+      return slot.get();
+    }
+    s.objects.insert(k, promise.get_future().share());
+    lock.unlock();
+    try {
+      value = build(&weight);
+    } catch (...) {
+      // Do not cache failures; waiting requesters see the same exception.
+      lock.lock();
+      s.objects.erase(k);
+      lock.unlock();
+      promise.set_exception(std::current_exception());
+      throw;
+    }
+    promise.set_value(value);
+    lock.lock();
+    if (s.objects.contains(k)) {
+      s.objects.set_weight(k, weight);
+    }
+#else
+    if (s.objects.contains(k)) {
+      return s.objects.get(k);
+    }
+    value = build(&weight);
+    s.objects.insert(k, value);
+    s.objects.set_weight(k, weight);
+#endif
+    return value;
+  }
+  inline ObjectCacheStats stats() const {
+    ObjectCacheStats total = ObjectCacheStats();
+    for (size_t i = 0; i < _shards.size(); ++i) {
+#if JITIFY_THREAD_SAFE
+      std::lock_guard<std::mutex> lock(_shards[i]->mutex);
+#endif
+      ObjectCacheStats s = _shards[i]->objects.stats();
+      total.hits += s.hits;
+      total.misses += s.misses;
+      total.evictions += s.evictions;
+      total.size += s.size;
+      total.bytes += s.bytes;
+    }
+    return total;
   }
 };
 
@@ -439,6 +683,75 @@ inline uint64_t hash_combine(uint64_t a, uint64_t b) {
   return a ^ (0x9E3779B97F4A7C17ull + b + (b >> 2) + (a << 6));
 }
 
+// SHA-256 digest of data as a lowercase hex string. Used where a collision-
+// resistant key is required (e.g., for content-addressed on-disk caching).
+inline std::string sha256_hex(std::string const& data) {
+  static const uint32_t k[64] = {
+      0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1,
+      0x923f82a4, 0xab1c5ed5, 0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3,
+      0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174, 0xe49b69c1, 0xefbe4786,
+      0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+      0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147,
+      0x06ca6351, 0x14292967, 0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13,
+      0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85, 0xa2bfe8a1, 0xa81a664b,
+      0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+      0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a,
+      0x5b9cca4f, 0x682e6ff3, 0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208,
+      0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2};
+  uint32_t h[8] = {0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+                   0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19};
+  auto rotr = [](uint32_t x, int n) { return (x >> n) | (x << (32 - n)); };
+  std::string msg = data;
+  uint64_t bit_len = (uint64_t)data.size() * 8;
+  msg += (char)0x80;
+  while (msg.size() % 64 != 56) msg += (char)0;
+  for (int i = 7; i >= 0; --i) msg += (char)(bit_len >> (i * 8));
+  for (size_t chunk = 0; chunk < msg.size(); chunk += 64) {
+    uint32_t w[64];
+    for (int i = 0; i < 16; ++i) {
+      const unsigned char* b = (const unsigned char*)&msg[chunk + i * 4];
+      w[i] = (uint32_t(b[0]) << 24) | (uint32_t(b[1]) << 16) |
+             (uint32_t(b[2]) << 8) | uint32_t(b[3]);
+    }
+    for (int i = 16; i < 64; ++i) {
+      uint32_t s0 = rotr(w[i - 15], 7) ^ rotr(w[i - 15], 18) ^ (w[i - 15] >> 3);
+      uint32_t s1 = rotr(w[i - 2], 17) ^ rotr(w[i - 2], 19) ^ (w[i - 2] >> 10);
+      w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+    }
+    uint32_t a = h[0], b = h[1], c = h[2], d = h[3];
+    uint32_t e = h[4], f = h[5], g = h[6], hh = h[7];
+    for (int i = 0; i < 64; ++i) {
+      uint32_t s1 = rotr(e, 6) ^ rotr(e, 11) ^ rotr(e, 25);
+      uint32_t ch = (e & f) ^ (~e & g);
+      uint32_t t1 = hh + s1 + ch + k[i] + w[i];
+      uint32_t s0 = rotr(a, 2) ^ rotr(a, 13) ^ rotr(a, 22);
+      uint32_t maj = (a & b) ^ (a & c) ^ (b & c);
+      uint32_t t2 = s0 + maj;
+      hh = g;
+      g = f;
+      f = e;
+      e = d + t1;
+      d = c;
+      c = b;
+      b = a;
+      a = t1 + t2;
+    }
+    h[0] += a;
+    h[1] += b;
+    h[2] += c;
+    h[3] += d;
+    h[4] += e;
+    h[5] += f;
+    h[6] += g;
+    h[7] += hh;
+  }
+  std::stringstream ss;
+  for (int i = 0; i < 8; ++i) {
+    ss << std::hex << std::setw(8) << std::setfill('0') << h[i];
+  }
+  return ss.str();
+}
+
 inline bool extract_include_info_from_compile_error(std::string log,
                                                     std::string& name,
                                                     std::string& parent,
@@ -707,6 +1020,435 @@ inline bool load_source(
   return true;
 }
 
+// Static #include discovery. The sources are scanned with a small
+// preprocessor-like pass (block comments, line continuations and conditional
+// blocks are honoured) so that the whole header closure can be loaded before
+// the first call to NVRTC. Conditions that cannot be decided statically (e.g.,
+// macros predefined by NVRTC) are treated as possibly-true, so both branches
+// are scanned. Headers that cannot be found are simply skipped here; the
+// compile-and-retry loop in load_program remains as the fallback for them.
+
+enum ScanTruth { SCAN_FALSE = 0, SCAN_TRUE = 1, SCAN_MAYBE = 2 };
+
+inline ScanTruth scan_not(ScanTruth a) {
+  return a == SCAN_MAYBE ? SCAN_MAYBE : (a == SCAN_TRUE ? SCAN_FALSE : SCAN_TRUE);
+}
+inline ScanTruth scan_and(ScanTruth a, ScanTruth b) {
+  if (a == SCAN_FALSE || b == SCAN_FALSE) return SCAN_FALSE;
+  if (a == SCAN_TRUE && b == SCAN_TRUE) return SCAN_TRUE;
+  return SCAN_MAYBE;
+}
+inline ScanTruth scan_or(ScanTruth a, ScanTruth b) {
+  if (a == SCAN_TRUE || b == SCAN_TRUE) return SCAN_TRUE;
+  if (a == SCAN_FALSE && b == SCAN_FALSE) return SCAN_FALSE;
+  return SCAN_MAYBE;
+}
+
+// Macros whose state is known to the scanner. Macros not present in the map
+// are unknown (e.g., predefined by NVRTC) and evaluate to SCAN_MAYBE.
+struct ScanMacro {
+  ScanTruth defined;
+  std::string value;
+};
+typedef std::map<std::string, ScanMacro> scan_macro_map;
+
+// Splits source into logical lines: line continuations are joined and
+// comments are replaced by a single space. String and character literals are
+// kept intact so that comment markers inside them are not misinterpreted.
+inline std::vector<std::string> split_logical_source_lines(
+    std::string const& source) {
+  std::vector<std::string> lines;
+  std::string line;
+  bool in_block_comment = false;
+  for (size_t i = 0; i < source.size(); ++i) {
+    char c = source[i];
+    char next = i + 1 < source.size() ? source[i + 1] : '\0';
+    if (c == '\\' && (next == '\n' || (next == '\r' && i + 2 < source.size() &&
+                                       source[i + 2] == '\n'))) {
+      i += (next == '\r') ? 2 : 1;  // Line continuation
+      continue;
+    }
+    if (in_block_comment) {
+      if (c == '*' && next == '/') {
+        in_block_comment = false;
+        line += ' ';
+        ++i;
+      }
+      // Note: Newlines inside block comments do not end the logical line.
+      continue;
+    }
+    if (c == '/' && next == '*') {
+      in_block_comment = true;
+      ++i;
+      continue;
+    }
+    if (c == '/' && next == '/') {
+      // Skip to end of line, honouring continuations of the comment.
+      while (i < source.size() && source[i] != '\n') {
+        if (source[i] == '\\' && i + 1 < source.size() &&
+            source[i + 1] == '\n') {
+          ++i;
+        }
+        ++i;
+      }
+      lines.push_back(line);
+      line.clear();
+      continue;
+    }
+    if (c == '"' || c == '\'') {
+      char quote = c;
+      line += c;
+      for (++i; i < source.size() && source[i] != quote && source[i] != '\n';
+           ++i) {
+        line += source[i];
+        if (source[i] == '\\' && i + 1 < source.size() &&
+            source[i + 1] != '\n') {
+          line += source[++i];
+        }
+      }
+      if (i < source.size() && source[i] == quote) {
+        line += quote;
+      } else {
+        --i;  // Unterminated literal; let the newline be handled normally.
+      }
+      continue;
+    }
+    if (c == '\n') {
+      lines.push_back(line);
+      line.clear();
+      continue;
+    }
+    if (c != '\r') line += c;
+  }
+  lines.push_back(line);
+  return lines;
+}
+
+// Evaluates a #if/#elif expression using the macros known to the scanner.
+// Supports integer literals, identifiers, defined(), unary !, -, the
+// comparison operators, && and || and parentheses. Anything else makes the
+// result unknown.
+class ScanExpression {
+  struct Result {
+    bool known;
+    long long value;
+  };
+  std::vector<std::string> _tokens;
+  size_t _pos;
+  scan_macro_map const& _macros;
+  bool _failed;
+
+  static Result unknown() { return Result{false, 0}; }
+  static Result known(long long value) { return Result{true, value}; }
+
+  void tokenize(std::string const& expr) {
+    static const char* two_char_ops[] = {"&&", "||", "==", "!=", "<=", ">="};
+    for (size_t i = 0; i < expr.size();) {
+      char c = expr[i];
+      if (std::isspace((unsigned char)c)) {
+        ++i;
+      } else if (is_tokenchar(c)) {
+        size_t j = i;
+        while (j < expr.size() && is_tokenchar(expr[j])) ++j;
+        _tokens.push_back(expr.substr(i, j - i));
+        i = j;
+      } else {
+        bool matched = false;
+        for (const char* op : two_char_ops) {
+          if (expr.compare(i, 2, op) == 0) {
+            _tokens.push_back(op);
+            i += 2;
+            matched = true;
+            break;
+          }
+        }
+        if (!matched) {
+          _tokens.push_back(std::string(1, c));
+          ++i;
+        }
+      }
+    }
+  }
+  std::string const& peek() const {
+    static const std::string end;
+    return _pos < _tokens.size() ? _tokens[_pos] : end;
+  }
+  bool accept(const char* tok) {
+    if (peek() == tok) {
+      ++_pos;
+      return true;
+    }
+    return false;
+  }
+  static bool parse_integer(std::string const& s, long long* value) {
+    if (s.empty() || !std::isdigit((unsigned char)s[0])) return false;
+    char* end;
+    *value = std::strtoll(s.c_str(), &end, 0);
+    // Allow integer suffixes (u, l, ul, ll, ...).
+    while (*end == 'u' || *end == 'U' || *end == 'l' || *end == 'L') ++end;
+    return *end == '\0';
+  }
+  Result primary() {
+    if (accept("(")) {
+      Result r = logical_or();
+      if (!accept(")")) _failed = true;
+      return r;
+    }
+    if (accept("!")) {
+      Result r = primary();
+      return r.known ? known(!r.value) : r;
+    }
+    if (accept("-")) {
+      Result r = primary();
+      return r.known ? known(-r.value) : r;
+    }
+    if (accept("defined")) {
+      bool paren = accept("(");
+      std::string name = peek();
+      ++_pos;
+      if (paren && !accept(")")) _failed = true;
+      auto it = _macros.find(name);
+      if (it == _macros.end() || it->second.defined == SCAN_MAYBE) {
+        return unknown();
+      }
+      return known(it->second.defined == SCAN_TRUE);
+    }
+    std::string tok = peek();
+    ++_pos;
+    long long value;
+    if (parse_integer(tok, &value)) return known(value);
+    if (tok.empty() || !is_tokenchar(tok[0])) {
+      _failed = true;
+      return unknown();
+    }
+    if (accept("(")) {
+      // Function-like macro invocation; cannot evaluate.
+      for (int depth = 1; depth && _pos < _tokens.size(); ++_pos) {
+        depth += (_tokens[_pos] == "(") - (_tokens[_pos] == ")");
+      }
+      return unknown();
+    }
+    auto it = _macros.find(tok);
+    if (it == _macros.end() || it->second.defined == SCAN_MAYBE) {
+      return unknown();
+    }
+    if (it->second.defined == SCAN_FALSE) return known(0);
+    if (parse_integer(it->second.value, &value)) return known(value);
+    return unknown();
+  }
+  Result comparison() {
+    Result lhs = primary();
+    while (true) {
+      std::string op = peek();
+      if (op != "==" && op != "!=" && op != "<" && op != ">" && op != "<=" &&
+          op != ">=") {
+        return lhs;
+      }
+      ++_pos;
+      Result rhs = primary();
+      if (!lhs.known || !rhs.known) {
+        lhs = unknown();
+        continue;
+      }
+      long long a = lhs.value, b = rhs.value;
+      lhs = known(op == "==" ? a == b
+                  : op == "!=" ? a != b
+                  : op == "<"  ? a < b
+                  : op == ">"  ? a > b
+                  : op == "<=" ? a <= b
+                               : a >= b);
+    }
+  }
+  Result logical_and() {
+    Result lhs = comparison();
+    while (accept("&&")) {
+      Result rhs = comparison();
+      if ((lhs.known && !lhs.value) || (rhs.known && !rhs.value)) {
+        lhs = known(0);
+      } else if (lhs.known && rhs.known) {
+        lhs = known(1);
+      } else {
+        lhs = unknown();
+      }
+    }
+    return lhs;
+  }
+  Result logical_or() {
+    Result lhs = logical_and();
+    while (accept("||")) {
+      Result rhs = logical_and();
+      if ((lhs.known && lhs.value) || (rhs.known && rhs.value)) {
+        lhs = known(1);
+      } else if (lhs.known && rhs.known) {
+        lhs = known(0);
+      } else {
+        lhs = unknown();
+      }
+    }
+    return lhs;
+  }
+
+ public:
+  ScanExpression(std::string const& expr, scan_macro_map const& macros)
+      : _pos(0), _macros(macros), _failed(false) {
+    this->tokenize(expr);
+  }
+  ScanTruth evaluate() {
+    Result r = logical_or();
+    if (_failed || _pos != _tokens.size() || !r.known) return SCAN_MAYBE;
+    return r.value ? SCAN_TRUE : SCAN_FALSE;
+  }
+};
+
+struct ScannedInclude {
+  std::string name;
+  bool is_quoted;
+  int line_num;
+};
+
+// Returns the #include directives of source that are not statically
+// excluded by conditional compilation, updating macros with any
+// #define/#undef directives encountered along the way.
+inline std::vector<ScannedInclude> scan_include_directives(
+    std::string const& source, scan_macro_map* macros) {
+  struct Frame {
+    ScanTruth parent;  // Whether the enclosing block is active
+    ScanTruth taken;   // Whether any previous branch has been taken
+    ScanTruth active;  // Whether the current branch is active
+  };
+  std::vector<Frame> stack;
+  std::vector<ScannedInclude> includes;
+  std::vector<std::string> lines = split_logical_source_lines(source);
+  auto active = [&]() { return stack.empty() ? SCAN_TRUE : stack.back().active; };
+  for (int i = 0; i < (int)lines.size(); ++i) {
+    std::string const& line = lines[i];
+    size_t beg = line.find_first_not_of(" \t");
+    if (beg == std::string::npos || line[beg] != '#') continue;
+    beg = line.find_first_not_of(" \t", beg + 1);
+    if (beg == std::string::npos) continue;
+    size_t end = beg;
+    while (end < line.size() && is_tokenchar(line[end])) ++end;
+    std::string directive = line.substr(beg, end - beg);
+    size_t arg_beg = line.find_first_not_of(" \t", end);
+    std::string arg =
+        arg_beg == std::string::npos ? std::string() : line.substr(arg_beg);
+    std::string arg_name = arg.substr(
+        0, std::find_if(arg.begin(), arg.end(),
+                        [](char c) { return !is_tokenchar(c); }) -
+               arg.begin());
+    if (directive == "if" || directive == "ifdef" || directive == "ifndef") {
+      ScanTruth cond;
+      if (directive == "if") {
+        cond = ScanExpression(arg, *macros).evaluate();
+      } else {
+        auto it = macros->find(arg_name);
+        cond = it == macros->end() ? SCAN_MAYBE : it->second.defined;
+        if (directive == "ifndef") cond = scan_not(cond);
+      }
+      ScanTruth parent = active();
+      stack.push_back(Frame{parent, cond, scan_and(parent, cond)});
+    } else if (directive == "elif" || directive == "else") {
+      if (stack.empty()) continue;  // Unbalanced; leave it to the compiler
+      Frame& frame = stack.back();
+      ScanTruth cond = directive == "else"
+                           ? SCAN_TRUE
+                           : ScanExpression(arg, *macros).evaluate();
+      ScanTruth branch = scan_and(scan_not(frame.taken), cond);
+      frame.taken = scan_or(frame.taken, cond);
+      frame.active = scan_and(frame.parent, branch);
+    } else if (directive == "endif") {
+      if (!stack.empty()) stack.pop_back();
+    } else if (active() == SCAN_FALSE) {
+      continue;
+    } else if (directive == "define" || directive == "undef") {
+      if (arg_name.empty()) continue;
+      ScanMacro& macro = (*macros)[arg_name];
+      if (active() == SCAN_MAYBE) {
+        macro.defined = SCAN_MAYBE;
+      } else if (directive == "define") {
+        macro.defined = SCAN_TRUE;
+        std::string value = arg.substr(arg_name.size());
+        size_t value_beg = value.find_first_not_of(" \t");
+        size_t value_end = value.find_last_not_of(" \t");
+        macro.value = (value_beg == std::string::npos || value[0] == '(')
+                          ? std::string()
+                          : value.substr(value_beg, value_end - value_beg + 1);
+      } else {
+        macro.defined = SCAN_FALSE;
+      }
+    } else if (directive == "include") {
+      if (arg.empty() || (arg[0] != '"' && arg[0] != '<')) {
+        continue;  // Computed include; cannot be resolved statically
+      }
+      size_t name_end = arg.find(arg[0] == '"' ? '"' : '>', 1);
+      if (name_end == std::string::npos) continue;
+      includes.push_back(
+          ScannedInclude{arg.substr(1, name_end - 1), arg[0] == '"', i + 1});
+    }
+  }
+  return includes;
+}
+
+// Initializes the scanner's macro state from -D/-U compiler options.
+inline scan_macro_map get_scan_macros_from_options(
+    std::vector<std::string> const& options) {
+  scan_macro_map macros;
+  for (std::string const& opt : options) {
+    std::string def;
+    ScanTruth defined;
+    if (opt.substr(0, 2) == "-D" || opt.substr(0, 2) == "-U") {
+      def = opt.substr(2);
+      defined = opt[1] == 'D' ? SCAN_TRUE : SCAN_FALSE;
+    } else if (opt.substr(0, 15) == "--define-macro=") {
+      def = opt.substr(15);
+      defined = SCAN_TRUE;
+    } else if (opt.substr(0, 17) == "--undefine-macro=") {
+      def = opt.substr(17);
+      defined = SCAN_FALSE;
+    } else {
+      continue;
+    }
+    size_t eq = def.find('=');
+    ScanMacro& macro = macros[def.substr(0, eq)];
+    macro.defined = defined;
+    macro.value = eq == std::string::npos ? "1" : def.substr(eq + 1);
+  }
+  return macros;
+}
+
+// Recursively loads every header reachable from the given source via
+// #include directives, in the order a preprocessor would encounter them.
+inline void load_included_sources(
+    std::string const& name, std::map<std::string, std::string>& sources,
+    std::vector<std::string> const& include_paths,
+    file_callback_type file_callback,
+    std::map<std::string, std::string>* fullpaths, scan_macro_map* macros,
+    std::unordered_set<std::string>* scanned) {
+  if (!scanned->insert(name).second) return;
+  auto source = sources.find(name);
+  if (source == sources.end()) return;
+  std::vector<ScannedInclude> includes =
+      scan_include_directives(source->second, macros);
+  std::string include_path = path_base((*fullpaths)[name]);
+  for (ScannedInclude const& include : includes) {
+    if (!sources.count(include.name)) {
+      if (!load_source(include.name, sources, include_path, include_paths,
+                       file_callback, nullptr, fullpaths,
+                       include.is_quoted)) {
+        continue;  // Not found (or not really needed); see load_program
+      }
+#if JITIFY_PRINT_HEADER_PATHS
+      std::cout << "Found #include " << include.name << " from " << name
+                << ":" << include.line_num << " [" << (*fullpaths)[name]
+                << "]"
+                << " at:\n  " << (*fullpaths)[include.name] << std::endl;
+#endif
+    }
+    load_included_sources(include.name, sources, include_paths, file_callback,
+                          fullpaths, macros, scanned);
+  }
+}
+
 }  // namespace detail
 
 //! \endcond
@@ -1052,6 +1794,91 @@ inline std::string demangle_ptx_variable_name(const char* name) {
   return ss.str();
 }
 
+// A kernel parameter as declared in the .entry directive of a PTX module.
+struct PtxParam {
+  std::string type;  // The PTX element type without the dot, e.g. "f32".
+  size_t size;       // The total size in bytes (element size * array length).
+  size_t align;      // The alignment in bytes.
+};
+
+inline size_t get_ptx_type_size(std::string const& type) {
+  if (type == "pred") return 1;
+  if (type.size() < 2) return 0;
+  char kind = type[0];
+  if (kind != 'b' && kind != 's' && kind != 'u' && kind != 'f') return 0;
+  std::string bits = type.substr(1);
+  if (bits == "8") return 1;
+  if (bits == "16") return 2;
+  if (bits == "32") return 4;
+  if (bits == "64") return 8;
+  return 0;
+}
+
+// Parses the parameter list of the kernel named entry_name in ptx, e.g.
+//   .visible .entry _Z3fooPfi(
+//     .param .u64 .ptr .global .align 4 _Z3fooPfi_param_0,
+//     .param .u32 _Z3fooPfi_param_1,
+//     .param .align 8 .b8 _Z3fooPfi_param_2[40]
+//   )
+// Returns false if the entry cannot be found or parsed.
+inline bool parse_ptx_entry_params(std::string const& ptx,
+                                   std::string const& entry_name,
+                                   std::vector<PtxParam>* params) {
+  params->clear();
+  std::string entry = ".entry " + entry_name;
+  size_t pos = 0;
+  while (true) {
+    pos = ptx.find(entry, pos);
+    if (pos == std::string::npos) return false;
+    pos += entry.size();
+    while (pos < ptx.size() && std::isspace(ptx[pos])) ++pos;
+    // Make sure this is not just a prefix of another kernel's name.
+    if (pos < ptx.size() && ptx[pos] == '(') break;
+  }
+  size_t end = ptx.find(')', pos);
+  if (end == std::string::npos) return false;
+  std::stringstream list_ss(ptx.substr(pos + 1, end - pos - 1));
+  std::string decl;
+  while (std::getline(list_ss, decl, ',')) {
+    std::stringstream decl_ss(decl);
+    std::string token;
+    PtxParam param;
+    param.align = 0;
+    size_t count = 1;
+    bool have_type = false;
+    while (decl_ss >> token) {
+      if (token == ".param") continue;
+      if (token == ".align") {
+        size_t align = 0;
+        decl_ss >> align;
+        // An alignment after the type qualifies the pointee (.ptr), not the
+        // parameter itself.
+        if (!have_type) param.align = align;
+      } else if (token[0] == '.') {
+        if (!have_type && get_ptx_type_size(token.substr(1))) {
+          param.type = token.substr(1);
+          have_type = true;
+        }
+      } else {
+        size_t bracket = token.find('[');
+        if (bracket != std::string::npos) {
+          count = std::strtoul(token.c_str() + bracket + 1, nullptr, 10);
+        }
+      }
+    }
+    if (!have_type) {
+      // Kernel with no parameters.
+      if (decl.find_first_not_of(" \t\r\n") == std::string::npos) continue;
+      return false;
+    }
+    size_t elem_size = get_ptx_type_size(param.type);
+    param.size = elem_size * count;
+    if (!param.align) param.align = elem_size;
+    params->push_back(param);
+  }
+  return true;
+}
+
 static const char* get_current_executable_path() {
   static const char* path = []() -> const char* {
     static char buffer[JITIFY_PATH_MAX] = {};
@@ -1113,6 +1940,14 @@ class CUDAKernel {
   std::map<std::string, std::string> _global_map;
   std::vector<CUjit_option> _opts;
   std::vector<void*> _optvals;
+  // Set when this kernel is a function looked up from a module that is owned
+  // (and unloaded) by another CUDAKernel.
+  std::shared_ptr<CUDAKernel const> _module_owner;
+  // Size in bytes of the loaded module image.
+  size_t _module_size;
+  // Linked module images keyed by target architecture (e.g., "sm_75"), kept
+  // so that they can be serialized and reloaded without JIT compilation.
+  std::map<std::string, std::string> _cubins;
 #ifdef JITIFY_PRINT_LINKER_LOG
   static const unsigned int _log_size = 8192;
   char _error_log[_log_size];
@@ -1126,18 +1961,58 @@ class CUDAKernel {
       throw std::runtime_error(msg);
     }
   }
+ public:
+  // Returns the architecture of the current context's device (e.g.,
+  // "sm_75"), or an empty string if there is no current context.
+  static inline std::string current_arch() {
+    CUdevice device;
+    int major = 0, minor = 0;
+    if (cuCtxGetDevice(&device) != CUDA_SUCCESS ||
+        cuDeviceGetAttribute(&major,
+                             CU_DEVICE_ATTRIBUTE_COMPUTE_CAPABILITY_MAJOR,
+                             device) != CUDA_SUCCESS ||
+        cuDeviceGetAttribute(&minor,
+                             CU_DEVICE_ATTRIBUTE_COMPUTE_CAPABILITY_MINOR,
+                             device) != CUDA_SUCCESS) {
+      return "";
+    }
+    return "sm_" + std::to_string(major * 10 + minor);
+  }
+
+ private:
+  // Returns the cubin that can be loaded on a device of the given
+  // architecture: an exact match, or else the newest one of the same major
+  // architecture that is not above it.
+  inline std::map<std::string, std::string>::const_iterator find_cubin(
+      std::string const& arch) const {
+    auto found = _cubins.find(arch);
+    if (found != _cubins.end() || arch.size() != 5) {
+      return found;
+    }
+    for (auto it = _cubins.begin(); it != _cubins.end(); ++it) {
+      std::string const& candidate = it->first;
+      if (candidate.size() == 5 && candidate.compare(0, 4, arch, 0, 4) == 0 &&
+          candidate[4] < arch[4] &&
+          (found == _cubins.end() || candidate[4] > found->first[4])) {
+        found = it;
+      }
+    }
+    return found;
+  }
   inline void create_module(std::vector<std::string> link_files,
                             std::vector<std::string> link_paths) {
     CUresult result;
-#ifndef JITIFY_PRINT_LINKER_LOG
-    // WAR since linker log does not seem to be constructed using a single call
-    // to cuModuleLoadDataEx.
-    if (link_files.empty()) {
-      result =
-          cuModuleLoadDataEx(&_module, _ptx.c_str(), (unsigned)_opts.size(),
-                             _opts.data(), _optvals.data());
+    std::string arch = current_arch();
+    // Load a previously-linked image for this architecture if there is one,
+    // falling back to JIT compiling the PTX otherwise.
+    auto cached = find_cubin(arch);
+    if (cached != _cubins.end() &&
+        cuModuleLoadData(&_module, cached->second.data()) == CUDA_SUCCESS) {
+      _module_size = cached->second.size();
+      result = CUDA_SUCCESS;
     } else
-#endif
+    // Note: The linker is used even without link files (rather than
+    //         cuModuleLoadDataEx) so that the linked image can be kept.
     {
       cuda_safe_call(cuLinkCreate((unsigned)_opts.size(), _opts.data(),
                                   _optvals.data(), &_link_state));
@@ -1180,6 +2055,10 @@ class CUDAKernel {
       void* cubin;
       result = cuLinkComplete(_link_state, &cubin, &cubin_size);
       if (result == CUDA_SUCCESS) {
+        _module_size = cubin_size;
+        if (!arch.empty()) {
+          _cubins[arch].assign((const char*)cubin, cubin_size);
+        }
         result = cuModuleLoadData(&_module, cubin);
       }
     }
@@ -1203,6 +2082,11 @@ class CUDAKernel {
     }
   }
   inline void destroy_module() {
+    if (_module_owner) {
+      _module_owner.reset();
+      _module = 0;
+      return;
+    }
     if (_link_state) {
       cuda_safe_call(cuLinkDestroy(_link_state));
     }
@@ -1253,7 +2137,8 @@ class CUDAKernel {
   }
 
  public:
-  inline CUDAKernel() : _link_state(0), _module(0), _kernel(0) {}
+  inline CUDAKernel()
+      : _link_state(0), _module(0), _kernel(0), _module_size(0) {}
   inline CUDAKernel(const CUDAKernel& other) = delete;
   inline CUDAKernel& operator=(const CUDAKernel& other) = delete;
   inline CUDAKernel(CUDAKernel&& other) = delete;
@@ -1270,11 +2155,43 @@ class CUDAKernel {
         _func_name(func_name),
         _ptx(ptx),
         _opts(opts, opts + nopts),
-        _optvals(optvals, optvals + nopts) {
+        _optvals(optvals, optvals + nopts),
+        _module_size(0) {
+    this->set_linker_log();
+    this->create_module(link_files, link_paths);
+    this->create_global_variable_map();
+  }
+  // Like the above, but loads the module from a matching entry of cubins
+  // (keyed by architecture, see cubins()) instead of JIT compiling the PTX.
+  inline CUDAKernel(const char* func_name, const char* ptx,
+                    std::vector<std::string> link_files,
+                    std::vector<std::string> link_paths,
+                    std::map<std::string, std::string> const& cubins)
+      : _link_files(link_files),
+        _link_paths(link_paths),
+        _link_state(0),
+        _module(0),
+        _kernel(0),
+        _func_name(func_name),
+        _ptx(ptx),
+        _module_size(0),
+        _cubins(cubins) {
     this->set_linker_log();
     this->create_module(link_files, link_paths);
     this->create_global_variable_map();
   }
+  // Looks up func_name in the module already loaded by module_owner, which is
+  // kept alive for the lifetime of this kernel.
+  inline CUDAKernel(std::shared_ptr<CUDAKernel const> module_owner,
+                    const char* func_name)
+      : _link_state(0),
+        _module(module_owner->_module),
+        _kernel(0),
+        _func_name(func_name),
+        _module_owner(module_owner),
+        _module_size(0) {
+    cuda_safe_call(cuModuleGetFunction(&_kernel, _module, _func_name.c_str()));
+  }
 
   inline CUDAKernel& set(const char* func_name, const char* ptx,
                          std::vector<std::string> link_files,
@@ -1284,6 +2201,7 @@ class CUDAKernel {
     this->destroy_module();
     _func_name = func_name;
     _ptx = ptx;
+    _cubins.clear();
     _link_files = link_files;
     _link_paths = link_paths;
     _opts.assign(opts, opts + nopts);
@@ -1309,6 +2227,14 @@ class CUDAKernel {
                                          stream, arg_ptrs.data(), NULL));
   }
 
+  // Launches with a caller-owned argument pointer array (no copies).
+  inline CUresult launch_raw(dim3 const& grid, dim3 const& block,
+                             unsigned int smem, CUstream stream,
+                             void** arg_ptrs) const {
+    return cuLaunchKernel(_kernel, grid.x, grid.y, grid.z, block.x, block.y,
+                          block.z, smem, stream, arg_ptrs, NULL);
+  }
+
   inline int get_func_attribute(CUfunction_attribute attribute) const {
     int value;
     cuda_safe_call(cuFuncGetAttribute(&value, attribute, _kernel));
@@ -1322,6 +2248,9 @@ class CUDAKernel {
 
   inline CUdeviceptr get_global_ptr(const char* name,
                                     size_t* size = nullptr) const {
+    if (_module_owner) {
+      return _module_owner->get_global_ptr(name, size);
+    }
     CUdeviceptr global_ptr = 0;
     auto global = _global_map.find(name);
     if (global != _global_map.end()) {
@@ -1364,9 +2293,21 @@ class CUDAKernel {
   }
 
   const std::string& function_name() const { return _func_name; }
-  const std::string& ptx() const { return _ptx; }
-  const std::vector<std::string>& link_files() const { return _link_files; }
-  const std::vector<std::string>& link_paths() const { return _link_paths; }
+  const std::string& ptx() const {
+    return _module_owner ? _module_owner->ptx() : _ptx;
+  }
+  const std::vector<std::string>& link_files() const {
+    return _module_owner ? _module_owner->link_files() : _link_files;
+  }
+  const std::vector<std::string>& link_paths() const {
+    return _module_owner ? _module_owner->link_paths() : _link_paths;
+  }
+  size_t module_size() const {
+    return _module_owner ? _module_owner->module_size() : _module_size;
+  }
+  const std::map<std::string, std::string>& cubins() const {
+    return _module_owner ? _module_owner->cubins() : _cubins;
+  }
 };
 
 static const char* jitsafe_header_preinclude_h = R"(
@@ -2454,16 +3395,17 @@ inline void add_options_from_env(std::vector<std::string>& options) {
 #endif  // JITIFY_OPTIONS
 }
 
-inline void detect_and_add_cuda_arch(std::vector<std::string>& options) {
+inline bool has_cuda_arch_option(std::vector<std::string> const& options) {
   for (int i = 0; i < (int)options.size(); ++i) {
     // Note that this will also match the middle of "--gpu-architecture".
     if (options[i].find("-arch") != std::string::npos) {
-      // Arch already specified in options
-      return;
+      return true;
     }
   }
-  // Use the compute capability of the current device
-  // TODO: Check these API calls for errors
+  return false;
+}
+
+inline int get_current_device() {
   cudaError_t status;
   int device;
   status = cudaGetDevice(&device);
@@ -2473,15 +3415,56 @@ inline void detect_and_add_cuda_arch(std::vector<std::string>& options) {
             "Failed to detect GPU architecture: cudaGetDevice failed: ") +
         cudaGetErrorString(status));
   }
+  return device;
+}
+
+// Returns the compute capabilities that this version of NVRTC can compile
+// for, in ascending order.
+inline std::vector<int> get_nvrtc_supported_archs() {
+  std::vector<int> archs;
+#if CUDA_VERSION >= 11020
+  // Note: This queries the NVRTC library that is actually loaded, which may be
+  //         newer than the headers this was compiled against.
+  int count = 0;
+  if (nvrtcGetNumSupportedArchs(&count) == NVRTC_SUCCESS && count > 0) {
+    archs.resize(count);
+    if (nvrtcGetSupportedArchs(archs.data()) != NVRTC_SUCCESS) {
+      archs.clear();
+    }
+  }
+#endif
+  if (archs.empty()) {
+    // Older versions of NVRTC cannot be queried, so use the newest
+    // architecture known to each release.
+    const int cuda_version = CUDA_VERSION;
+    // clang-format off
+    int newest = cuda_version >= 11010 ? 86  // Ampere
+               : cuda_version >= 11000 ? 80  // Ampere
+               : cuda_version >= 10000 ? 75  // Turing
+               : cuda_version >=  9000 ? 70  // Volta
+               : cuda_version >=  8000 ? 61  // Pascal
+               : cuda_version >=  7000 ? 52  // Maxwell
+               : 0;
+    // clang-format on
+    if (!newest) {
+      throw std::runtime_error("Unexpected CUDA version " +
+                               std::to_string(cuda_version));
+    }
+    archs.push_back(newest);
+  }
+  std::sort(archs.begin(), archs.end());
+  return archs;
+}
+
+// Returns the compute capability to compile for on the given device: the
+// highest architecture supported by NVRTC that is not above the device's.
+inline int detect_cuda_arch(int device) {
+  // TODO: Check these API calls for errors
   int cc_major;
   cudaDeviceGetAttribute(&cc_major, cudaDevAttrComputeCapabilityMajor, device);
   int cc_minor;
   cudaDeviceGetAttribute(&cc_minor, cudaDevAttrComputeCapabilityMinor, device);
   int cc = cc_major * 10 + cc_minor;
-  // Note: We must limit the architecture to the max supported by the current
-  //         version of NVRTC, otherwise newer hardware will cause errors
-  //         on older versions of CUDA.
-  // TODO: It would be better to detect this somehow, rather than hard-coding it
 
   // Tegra chips do not have forwards compatibility so we need to special case
   // them.
@@ -2489,27 +3472,99 @@ inline void detect_and_add_cuda_arch(std::vector<std::string>& options) {
                    (cc_major == 5 && cc_minor == 3) ||  // Erista
                    (cc_major == 6 && cc_minor == 2) ||  // Parker
                    (cc_major == 7 && cc_minor == 2));   // Xavier
-  if (!is_tegra) {
-    // ensure that future CUDA versions just work (even if suboptimal)
-    const int cuda_major = std::min(10, CUDA_VERSION / 1000);
-    // clang-format off
-    switch (cuda_major) {
-      case 10: cc = std::min(cc, 75); break; // Turing
-      case  9: cc = std::min(cc, 70); break; // Volta
-      case  8: cc = std::min(cc, 61); break; // Pascal
-      case  7: cc = std::min(cc, 52); break; // Maxwell
-      default:
-        throw std::runtime_error("Unexpected CUDA major version " +
-                                 std::to_string(cuda_major));
-    }
-    // clang-format on
+  if (is_tegra) {
+    return cc;
   }
+  // Note: We must limit the architecture to the max supported by the current
+  //         version of NVRTC, otherwise newer hardware will cause errors
+  //         on older versions of CUDA.
+  std::vector<int> archs = get_nvrtc_supported_archs();
+  int arch = archs.front();
+  for (int supported : archs) {
+    if (supported <= cc) arch = supported;
+  }
+  // An architecture list of one entry is only an upper bound (see
+  // get_nvrtc_supported_archs), so anything below it is also supported.
+  if (archs.size() == 1) arch = std::min(cc, archs.front());
+  return arch;
+}
+
+// Returns true if NVRTC can compile for the real architecture sm_<arch> and
+// still provide the PTX, which is needed for reflection (e.g., parameter
+// layouts) and for loading on other devices. Checked with a tiny program.
+inline bool nvrtc_supports_native_cubin(int arch) {
+#if CUDA_VERSION >= 11010
+  nvrtcProgram program;
+  if (nvrtcCreateProgram(&program, "__global__ void jitify_probe() {}",
+                         "jitify_probe", 0, nullptr,
+                         nullptr) != NVRTC_SUCCESS) {
+    return false;
+  }
+  std::string option = "-arch=sm_" + std::to_string(arch);
+  const char* options[] = {option.c_str()};
+  size_t ptx_size = 0, cubin_size = 0;
+  bool supported =
+      nvrtcCompileProgram(program, 1, options) == NVRTC_SUCCESS &&
+      nvrtcGetPTXSize(program, &ptx_size) == NVRTC_SUCCESS && ptx_size > 1 &&
+      nvrtcGetCUBINSize(program, &cubin_size) == NVRTC_SUCCESS &&
+      cubin_size > 0;
+  nvrtcDestroyProgram(&program);
+  return supported;
+#else
+  (void)arch;
+  return false;
+#endif
+}
+
+// The compile settings of one device. These never change for the lifetime of
+// the process, so they are computed once per device and shared.
+struct CompileProfile {
+  int device;
+  int arch;
+  // Whether kernels are compiled directly to a cubin for the device (see
+  // JITIFY_NATIVE_CUBIN).
+  bool native;
+  // The option selecting the architecture, e.g., "-arch=sm_86" when native
+  // or "-arch=compute_75" otherwise.
+  std::string arch_option;
+};
+
+inline std::shared_ptr<CompileProfile const> get_compile_profile(int device) {
+  static std::map<int, std::shared_ptr<CompileProfile const> > profiles;
+#if JITIFY_THREAD_SAFE
+  static std::mutex mutex;
+  std::lock_guard<std::mutex> lock(mutex);
+#endif
+  std::shared_ptr<CompileProfile const>& profile = profiles[device];
+  if (!profile) {
+    std::shared_ptr<CompileProfile> created(new CompileProfile());
+    created->device = device;
+    created->arch = detect_cuda_arch(device);
+    const char* native_env = std::getenv("JITIFY_NATIVE_CUBIN");
+    bool native_enabled =
+        native_env ? std::string(native_env) != "0" : JITIFY_NATIVE_CUBIN;
+    int cc_major = 0;
+    cudaDeviceGetAttribute(&cc_major, cudaDevAttrComputeCapabilityMajor,
+                           device);
+    // Note: A cubin only runs on devices of the same major architecture.
+    created->native = native_enabled && created->arch / 10 == cc_major &&
+                      nvrtc_supports_native_cubin(created->arch);
+    created->arch_option = (created->native ? "-arch=sm_" : "-arch=compute_") +
+                           std::to_string(created->arch);
+    profile = created;
+  }
+  return profile;
+}
+
+inline void detect_and_add_cuda_arch(std::vector<std::string>& options) {
+  if (has_cuda_arch_option(options)) {
+    // Arch already specified in options
+    return;
+  }
+  // Use the compute capability of the current device
+  options.push_back(get_compile_profile(get_current_device())->arch_option);
+}
 
-  std::stringstream ss;
-  ss << cc;
-  options.push_back("-arch=compute_" + ss.str());
-}
-
 inline void detect_and_add_cxx11_flag(std::vector<std::string>& options) {
   // Reverse loop so we can erase on the fly.
   for (int i = (int)options.size() - 1; i >= 0; --i) {
@@ -2527,6 +3582,59 @@ inline void detect_and_add_cxx11_flag(std::vector<std::string>& options) {
   options.push_back("-std=c++11");
 }
 
+// A list of compiler options with the architecture and language standard
+// resolved (see detect_and_add_cuda_arch and detect_and_add_cxx11_flag), and
+// the hash of the resolved list.
+struct CompileOptions {
+  std::vector<std::string> given;
+  std::vector<std::string> options;
+  uint64_t hash;
+};
+
+// Returns the resolved form of options for the current device. Results are
+// cached (per device, unless options already select an architecture), so
+// repeated instantiations do not rescan and rehash their options.
+inline std::shared_ptr<CompileOptions const> resolve_options(
+    std::vector<std::string> const& options) {
+  enum { MAX_CACHED_OPTIONS = 1024 };
+  static std::unordered_map<uint64_t, std::shared_ptr<CompileOptions const> >
+      resolved;
+#if JITIFY_THREAD_SAFE
+  static std::mutex mutex;
+#endif
+  int device = has_cuda_arch_option(options) ? -1 : get_current_device();
+  uint64_t key = hash_combine(0, (uint64_t)(int64_t)device);
+  for (size_t i = 0; i < options.size(); ++i) {
+    key = hash_combine(key, hash_larson64(options[i].c_str()));
+  }
+  {
+#if JITIFY_THREAD_SAFE
+    std::lock_guard<std::mutex> lock(mutex);
+#endif
+    auto it = resolved.find(key);
+    if (it != resolved.end() && it->second->given == options) {
+      return it->second;
+    }
+  }
+  std::shared_ptr<CompileOptions> result(new CompileOptions());
+  result->given = options;
+  result->options = options;
+  if (device >= 0) {
+    result->options.push_back(get_compile_profile(device)->arch_option);
+  }
+  detect_and_add_cxx11_flag(result->options);
+  result->hash =
+      hash_larson64(reflection::reflect_list(result->options).c_str());
+#if JITIFY_THREAD_SAFE
+  std::lock_guard<std::mutex> lock(mutex);
+#endif
+  if (resolved.size() >= MAX_CACHED_OPTIONS) {
+    resolved.clear();
+  }
+  resolved[key] = result;
+  return result;
+}
+
 inline void split_compiler_and_linker_options(
     std::vector<std::string> options,
     std::vector<std::string>* compiler_options,
@@ -2630,24 +3738,67 @@ inline void ptx_remove_unused_globals(std::string* ptx) {
   *ptx = oss.str();
 }
 
-inline nvrtcResult compile_kernel(std::string program_name,
-                                  std::map<std::string, std::string> sources,
-                                  std::vector<std::string> options,
-                                  std::string instantiation = "",
-                                  std::string* log = 0, std::string* ptx = 0,
-                                  std::string* mangled_instantiation = 0) {
-  std::string program_source = sources[program_name];
+// Counts calls to nvrtcCompileProgram made by this process (for profiling).
+inline std::atomic<size_t>& nvrtc_compile_count() {
+  static std::atomic<size_t> count(0);
+  return count;
+}
+
+// Returns the index of the option selecting a real architecture (e.g.,
+// "-arch=sm_86"), or -1 if there is none.
+inline int find_real_arch_option(std::vector<std::string> const& options) {
+  for (int i = 0; i < (int)options.size(); ++i) {
+    if (options[i].find("-arch") != std::string::npos &&
+        options[i].find("sm_") != std::string::npos) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+//LCG调整::程序源码名称到源码的视图，源码可以来自程序自己的副本或者共享的头文件
+//编译和计算缓存键时直接引用，不再复制源码
+typedef std::map<std::string, std::string const*> source_view;
+
+inline source_view make_source_view(
+    std::map<std::string, std::string> const& sources,
+    std::map<std::string, std::shared_ptr<const std::string>> const& shared =
+        std::map<std::string, std::shared_ptr<const std::string>>()) {
+  source_view view;
+  for (auto const& kv : sources) {
+    view[kv.first] = &kv.second;
+  }
+  for (auto const& kv : shared) {
+    view[kv.first] = kv.second.get();
+  }
+  return view;
+}
+
+// Compiles a program, instantiating each of the given name expressions (which
+// are all emitted into the same PTX). If cubin is given and the options select
+// a real architecture, it is set to the compiled cubin (otherwise it is left
+// empty).
+inline nvrtcResult compile_kernel(
+    std::string program_name, source_view const& sources,
+    std::vector<std::string> options,
+    std::vector<std::string> const& instantiations, std::string* log,
+    std::string* ptx, std::vector<std::string>* mangled_instantiations,
+    std::string* cubin = nullptr) {
+  std::vector<std::string> const given_options = options;
+  source_view::const_iterator program_iter = sources.find(program_name);
+  std::string const empty_source;
+  std::string const& program_source =
+      program_iter != sources.end() ? *program_iter->second : empty_source;
   // Build arrays of header names and sources
   std::vector<const char*> header_names_c;
   std::vector<const char*> header_sources_c;
   int num_headers = (int)(sources.size() - 1);
   header_names_c.reserve(num_headers);
   header_sources_c.reserve(num_headers);
-  typedef std::map<std::string, std::string> source_map;
-  for (source_map::const_iterator iter = sources.begin(); iter != sources.end();
+  for (source_view::const_iterator iter = sources.begin(); iter != sources.end();
        ++iter) {
     std::string const& name = iter->first;
-    std::string const& code = iter->second;
+    std::string const& code = *iter->second;
     if (name == program_name) {
       continue;
     }
@@ -2667,13 +3818,15 @@ inline nvrtcResult compile_kernel(std::string program_name,
   }
 
 #if CUDA_VERSION < 8000
-  std::string inst_dummy;
-  if (!instantiation.empty()) {
+  std::vector<std::string> inst_dummies;
+  for (int i = 0; i < (int)instantiations.size(); ++i) {
     // WAR for no nvrtcAddNameExpression before CUDA 8.0
     // Force template instantiation by adding dummy reference to kernel
-    inst_dummy = "__jitify_instantiation";
+    std::string inst_dummy = "__jitify_instantiation" +
+                             (i ? std::to_string(i) : std::string());
     program_source +=
-        "\nvoid* " + inst_dummy + " = (void*)" + instantiation + ";\n";
+        "\nvoid* " + inst_dummy + " = (void*)" + instantiations[i] + ";\n";
+    inst_dummies.push_back(inst_dummy);
   }
 #endif
 
@@ -2691,11 +3844,12 @@ inline nvrtcResult compile_kernel(std::string program_name,
       header_sources_c.data(), header_names_c.data()));
 
 #if CUDA_VERSION >= 8000
-  if (!instantiation.empty()) {
+  for (std::string const& instantiation : instantiations) {
     CHECK_NVRTC(nvrtcAddNameExpression(nvrtc_program, instantiation.c_str()));
   }
 #endif
 
+  ++nvrtc_compile_count();
   nvrtcResult ret = nvrtcCompileProgram(nvrtc_program, (int)options_c.size(),
                                         options_c.data());
   if (log) {
@@ -2709,39 +3863,104 @@ inline nvrtcResult compile_kernel(std::string program_name,
     return ret;
   }
 
+  int real_arch = find_real_arch_option(options);
+  if (cubin) {
+    cubin->clear();
+#if CUDA_VERSION >= 11010
+    size_t cubinsize = 0;
+    if (real_arch >= 0 &&
+        nvrtcGetCUBINSize(nvrtc_program, &cubinsize) == NVRTC_SUCCESS &&
+        cubinsize > 0) {
+      std::vector<char> vcubin(cubinsize);
+      CHECK_NVRTC(nvrtcGetCUBIN(nvrtc_program, vcubin.data()));
+      cubin->assign(vcubin.data(), cubinsize);
+    }
+#endif
+  }
+
+  bool ptx_missing = false;
   if (ptx) {
     size_t ptxsize;
-    CHECK_NVRTC(nvrtcGetPTXSize(nvrtc_program, &ptxsize));
-    std::vector<char> vptx(ptxsize);
-    CHECK_NVRTC(nvrtcGetPTX(nvrtc_program, vptx.data()));
-    ptx->assign(vptx.data(), ptxsize);
-    if (should_remove_unused_globals) {
-      detail::ptx_remove_unused_globals(ptx);
+    nvrtcResult ptx_ret = nvrtcGetPTXSize(nvrtc_program, &ptxsize);
+    if (ptx_ret != NVRTC_SUCCESS && real_arch >= 0) {
+      // Some versions of NVRTC only emit a cubin for real architectures; the
+      // PTX is obtained below by compiling for the virtual architecture.
+      ptx_missing = true;
+    } else {
+      CHECK_NVRTC(ptx_ret);
+      std::vector<char> vptx(ptxsize);
+      CHECK_NVRTC(nvrtcGetPTX(nvrtc_program, vptx.data()));
+      ptx->assign(vptx.data(), ptxsize);
+      if (should_remove_unused_globals) {
+        detail::ptx_remove_unused_globals(ptx);
+      }
     }
   }
 
-  if (!instantiation.empty() && mangled_instantiation) {
+  if (mangled_instantiations) {
+    mangled_instantiations->clear();
+    for (int i = 0; i < (int)instantiations.size(); ++i) {
 #if CUDA_VERSION >= 8000
-    const char* mangled_instantiation_cstr;
-    // Note: The returned string pointer becomes invalid after
-    //         nvrtcDestroyProgram has been called, so we save it.
-    CHECK_NVRTC(nvrtcGetLoweredName(nvrtc_program, instantiation.c_str(),
-                                    &mangled_instantiation_cstr));
-    *mangled_instantiation = mangled_instantiation_cstr;
+      const char* mangled_instantiation_cstr;
+      // Note: The returned string pointer becomes invalid after
+      //         nvrtcDestroyProgram has been called, so we save it.
+      CHECK_NVRTC(nvrtcGetLoweredName(nvrtc_program, instantiations[i].c_str(),
+                                      &mangled_instantiation_cstr));
+      mangled_instantiations->push_back(mangled_instantiation_cstr);
 #else
-    // Extract mangled kernel template instantiation from PTX
-    inst_dummy += " = ";  // Note: This must match how the PTX is generated
-    int mi_beg = ptx->find(inst_dummy) + inst_dummy.size();
-    int mi_end = ptx->find(";", mi_beg);
-    *mangled_instantiation = ptx->substr(mi_beg, mi_end - mi_beg);
+      // Extract mangled kernel template instantiation from PTX
+      // Note: This must match how the PTX is generated
+      std::string inst_dummy = inst_dummies[i] + " = ";
+      int mi_beg = ptx->find(inst_dummy) + inst_dummy.size();
+      int mi_end = ptx->find(";", mi_beg);
+      mangled_instantiations->push_back(ptx->substr(mi_beg, mi_end - mi_beg));
 #endif
+    }
   }
 
   CHECK_NVRTC(nvrtcDestroyProgram(&nvrtc_program));
 #undef CHECK_NVRTC
+  if (ptx_missing) {
+    std::vector<std::string> virtual_options = given_options;
+    std::string& arch = virtual_options[find_real_arch_option(virtual_options)];
+    arch.replace(arch.find("sm_"), 3, "compute_");
+    return compile_kernel(program_name, sources, virtual_options,
+                          instantiations, nullptr, ptx, nullptr);
+  }
   return NVRTC_SUCCESS;
 }
 
+inline nvrtcResult compile_kernel(std::string program_name,
+                                  source_view const& sources,
+                                  std::vector<std::string> options,
+                                  std::string instantiation = "",
+                                  std::string* log = 0, std::string* ptx = 0,
+                                  std::string* mangled_instantiation = 0,
+                                  std::string* cubin = 0) {
+  std::vector<std::string> instantiations, mangled_instantiations;
+  if (!instantiation.empty()) {
+    instantiations.push_back(instantiation);
+  }
+  nvrtcResult ret = compile_kernel(
+      program_name, sources, options, instantiations, log, ptx,
+      mangled_instantiation ? &mangled_instantiations : nullptr, cubin);
+  if (ret == NVRTC_SUCCESS && !mangled_instantiations.empty()) {
+    *mangled_instantiation = mangled_instantiations[0];
+  }
+  return ret;
+}
+
+inline nvrtcResult compile_kernel(std::string program_name,
+                                  std::map<std::string, std::string> const& sources,
+                                  std::vector<std::string> options,
+                                  std::string instantiation = "",
+                                  std::string* log = 0, std::string* ptx = 0,
+                                  std::string* mangled_instantiation = 0,
+                                  std::string* cubin = 0) {
+  return compile_kernel(program_name, make_source_view(sources), options,
+                        instantiation, log, ptx, mangled_instantiation, cubin);
+}
+
 inline void load_program(std::string const& cuda_source,
                          std::vector<std::string> const& headers,
                          file_callback_type file_callback,
@@ -2750,12 +3969,17 @@ inline void load_program(std::string const& cuda_source,
                          std::vector<std::string>* program_options,
                          std::string* program_name) {
   // Extract include paths from compile options
+  bool should_scan_includes = true;
   std::vector<std::string>::iterator iter = program_options->begin();
   while (iter != program_options->end()) {
     std::string const& opt = *iter;
     if (opt.substr(0, 2) == "-I") {
       include_paths->push_back(opt.substr(2));
       iter = program_options->erase(iter);
+    } else if (opt == "-no-scan-includes") {
+      // Disables static include discovery (e.g., for benchmarking).
+      should_scan_includes = false;
+      iter = program_options->erase(iter);
     } else {
       ++iter;
     }
@@ -2799,8 +4023,28 @@ inline void load_program(std::string const& cuda_source,
   detail::detect_and_add_cuda_arch(compiler_options);
   detail::detect_and_add_cxx11_flag(compiler_options);
 
+  // Load the statically-discoverable header closure up front, so that the
+  // loop below normally needs only a single call to NVRTC.
+  if (should_scan_includes) {
+    scan_macro_map macros = get_scan_macros_from_options(compiler_options);
+    std::unordered_set<std::string> scanned;
+    for (int i = 0; i < preinclude_jitsafe_headers_count; ++i) {
+      load_included_sources(preinclude_jitsafe_header_names[i],
+                            *program_sources, *include_paths, file_callback,
+                            &header_fullpaths, &macros, &scanned);
+    }
+    load_included_sources(*program_name, *program_sources, *include_paths,
+                          file_callback, &header_fullpaths, &macros, &scanned);
+    for (auto const& source : *program_sources) {
+      load_included_sources(source.first, *program_sources, *include_paths,
+                            file_callback, &header_fullpaths, &macros,
+                            &scanned);
+    }
+  }
+
   // Iteratively try to compile the sources, and use the resulting errors to
-  // identify missing headers.
+  // identify missing headers (only headers that could not be found by the
+  // static scan above, e.g., computed includes, should get here).
   std::string log;
   nvrtcResult ret;
   while ((ret = detail::compile_kernel(*program_name, *program_sources,
@@ -2884,19 +4128,27 @@ inline void load_program(std::string const& cuda_source,
 }
 
 inline void instantiate_kernel(
-    std::string const& program_name,
-    std::map<std::string, std::string> const& program_sources,
+    std::string const& program_name, detail::source_view const& program_sources,
     std::string const& instantiation, std::vector<std::string> const& options,
     std::string* log, std::string* ptx, std::string* mangled_instantiation,
     std::vector<std::string>* linker_files,
-    std::vector<std::string>* linker_paths) {
+    std::vector<std::string>* linker_paths,
+    std::map<std::string, std::string>* cubins = nullptr) {
   std::vector<std::string> compiler_options;
   detail::split_compiler_and_linker_options(options, &compiler_options,
                                             linker_files, linker_paths);
 
-  nvrtcResult ret =
-      detail::compile_kernel(program_name, program_sources, compiler_options,
-                             instantiation, log, ptx, mangled_instantiation);
+  std::string cubin;
+  nvrtcResult ret = detail::compile_kernel(
+      program_name, program_sources, compiler_options, instantiation, log, ptx,
+      mangled_instantiation, cubins ? &cubin : nullptr);
+  // Note: The cubin from NVRTC is not linked, so it can only be loaded
+  //         directly when there is nothing to link.
+  if (cubins && !cubin.empty() && linker_files->empty()) {
+    std::string const& arch =
+        compiler_options[find_real_arch_option(compiler_options)];
+    (*cubins)[arch.substr(arch.find("sm_"))] = cubin;
+  }
 #if JITIFY_PRINT_LOG
   if (log->size() > 1) {
     detail::print_compile_log(program_name, *log);
@@ -2919,6 +4171,42 @@ inline void instantiate_kernel(
 #endif
 }
 
+// As instantiate_kernel, but instantiates several name expressions with a
+// single NVRTC invocation.
+inline void instantiate_kernels(
+    std::string const& program_name, detail::source_view const& program_sources,
+    std::vector<std::string> const& instantiations,
+    std::vector<std::string> const& options, std::string* log,
+    std::string* ptx, std::vector<std::string>* mangled_instantiations,
+    std::vector<std::string>* linker_files,
+    std::vector<std::string>* linker_paths) {
+  std::vector<std::string> compiler_options;
+  detail::split_compiler_and_linker_options(options, &compiler_options,
+                                            linker_files, linker_paths);
+
+  nvrtcResult ret =
+      detail::compile_kernel(program_name, program_sources, compiler_options,
+                             instantiations, log, ptx, mangled_instantiations);
+#if JITIFY_PRINT_LOG
+  if (log->size() > 1) {
+    detail::print_compile_log(program_name, *log);
+  }
+#endif
+  if (ret != NVRTC_SUCCESS) {
+    throw std::runtime_error(std::string("NVRTC error: ") +
+                             nvrtcGetErrorString(ret) + std::string("\n") + *log);
+  }
+
+#if JITIFY_PRINT_PTX
+  std::cout << "---------------------------------------" << std::endl;
+  std::cout << "--- PTX for " << instantiations.size() << " instantiations in "
+            << program_name << " ---" << std::endl;
+  std::cout << "---------------------------------------" << std::endl;
+  std::cout << *ptx << std::endl;
+  std::cout << "---------------------------------------" << std::endl;
+#endif
+}
+
 inline void get_1d_max_occupancy(CUfunction func,
                                  CUoccupancyB2DSize smem_callback,
                                  unsigned int* smem, int max_block_size,
@@ -2958,20 +4246,19 @@ struct ProgramConfig {
 };
 
 class JitCache_impl {
+  friend class JitCache;
   friend class Program_impl;
   friend class KernelInstantiation_impl;
   friend class KernelLauncher_impl;
   typedef uint64_t key_type;
-  jitify::ObjectCache<key_type, detail::CUDAKernel> _kernel_cache;
-  jitify::ObjectCache<key_type, ProgramConfig> _program_config_cache;
+  jitify::SharedObjectCache<key_type, detail::CUDAKernel> _kernel_cache;
+  jitify::SharedObjectCache<key_type, ProgramConfig> _program_config_cache;
   std::vector<std::string> _options;
-#if JITIFY_THREAD_SAFE
-  std::mutex _kernel_cache_mutex;
-  std::mutex _program_cache_mutex;
-#endif
+
  public:
-  inline JitCache_impl(size_t cache_size)
-      : _kernel_cache(cache_size), _program_config_cache(cache_size) {
+  inline JitCache_impl(size_t cache_size, size_t cache_bytes = 0)
+      : _kernel_cache(cache_size, cache_bytes),
+        _program_config_cache(cache_size) {
     detail::add_options_from_env(_options);
 
     // Bootstrap the cuda context to avoid errors
@@ -2989,8 +4276,9 @@ class Program_impl {
   //           instances are static.
   JitCache_impl& _cache;
   uint64_t _hash;
-  ProgramConfig* _config;
-  void load_sources(std::string source, std::vector<std::string> headers,
+  std::shared_ptr<ProgramConfig> _config;
+  void load_sources(ProgramConfig* config, std::string source,
+                    std::vector<std::string> headers,
                     std::vector<std::string> options,
                     file_callback_type file_callback);
 
@@ -3018,7 +4306,7 @@ class Kernel_impl {
   friend class KernelInstantiation_impl;
   Program_impl _program;
   std::string _name;
-  std::vector<std::string> _options;
+  std::shared_ptr<detail::CompileOptions const> _options;
   uint64_t _hash;
 
  public:
@@ -3033,10 +4321,9 @@ class KernelInstantiation_impl {
   Kernel_impl _kernel;
   uint64_t _hash;
   std::string _template_inst;
-  std::vector<std::string> _options;
-  detail::CUDAKernel* _cuda_kernel;
+  std::shared_ptr<detail::CUDAKernel> _cuda_kernel;
   inline void print() const;
-  void build_kernel();
+  std::shared_ptr<detail::CUDAKernel> build_kernel(size_t* weight) const;
 
  public:
   inline KernelInstantiation_impl(
@@ -3399,10 +4686,19 @@ class JitCache {
   /*! JitCache constructor.
    *  \param cache_size The number of kernels to hold in the cache
    *    before overwriting the least-recently-used ones.
+   *  \param cache_bytes The maximum total PTX and module size (in bytes) of
+   *    the cached kernels, or 0 for no limit.
    */
   enum { DEFAULT_CACHE_SIZE = 128 };
-  JitCache(size_t cache_size = DEFAULT_CACHE_SIZE)
-      : _impl(new JitCache_impl(cache_size)) {}
+  JitCache(size_t cache_size = DEFAULT_CACHE_SIZE, size_t cache_bytes = 0)
+      : _impl(new JitCache_impl(cache_size, cache_bytes)) {}
+
+  /*! Get the hit/miss/eviction counters and current size of the kernel
+   *    cache.
+   */
+  ObjectCacheStats kernel_cache_stats() const {
+    return _impl->_kernel_cache.stats();
+  }
 
   /*! Create a program.
    *
@@ -3515,7 +4811,7 @@ inline void KernelLauncher_impl::safe_launch(
 
 inline KernelInstantiation_impl::KernelInstantiation_impl(
     Kernel_impl const& kernel, std::vector<std::string> const& template_args)
-    : _kernel(kernel), _options(kernel._options) {
+    : _kernel(kernel) {
   _template_inst =
       (template_args.empty() ? ""
                              : reflection::reflect_template(template_args));
@@ -3525,60 +4821,72 @@ inline KernelInstantiation_impl::KernelInstantiation_impl(
   _hash = hash_combine(_hash, hash_larson64(_template_inst.c_str()));
   JitCache_impl& cache = _kernel._program._cache;
   uint64_t cache_key = _hash;
-#if JITIFY_THREAD_SAFE
-  std::lock_guard<std::mutex> lock(cache._kernel_cache_mutex);
-#endif
-  if (cache._kernel_cache.contains(cache_key)) {
+  // Only the first requester of a kernel compiles it; the cache lock is not
+  // held while compiling, so different kernels compile concurrently.
+  bool built = false;
+  _cuda_kernel = cache._kernel_cache.get_or_build(
+      cache_key, [this, &built](size_t* weight) {
+        built = true;
+        return this->build_kernel(weight);
+      });
 #if JITIFY_PRINT_INSTANTIATION
+  if (!built) {
     std::cout << "Found ";
     this->print();
-#endif
-    _cuda_kernel = &cache._kernel_cache.get(cache_key);
-  } else {
-#if JITIFY_PRINT_INSTANTIATION
-    std::cout << "Building ";
-    this->print();
-#endif
-    _cuda_kernel = &cache._kernel_cache.emplace(cache_key);
-    this->build_kernel();
   }
+#endif
+  (void)built;
 }
 
 inline void KernelInstantiation_impl::print() const {
-  std::string options_string = reflection::reflect_list(_options);
+  std::string options_string =
+      reflection::reflect_list(_kernel._options->options);
   std::cout << _kernel._name << _template_inst << " [" << options_string << "]"
             << std::endl;
 }
 
-inline void KernelInstantiation_impl::build_kernel() {
+inline std::shared_ptr<detail::CUDAKernel>
+KernelInstantiation_impl::build_kernel(size_t* weight) const {
+#if JITIFY_PRINT_INSTANTIATION
+  std::cout << "Building ";
+  this->print();
+#endif
   Program_impl const& program = _kernel._program;
 
   std::string instantiation = _kernel._name + _template_inst;
 
   std::string log, ptx, mangled_instantiation;
   std::vector<std::string> linker_files, linker_paths;
-  detail::instantiate_kernel(program.name(), program.sources(), instantiation,
-                             _options, &log, &ptx, &mangled_instantiation,
-                             &linker_files, &linker_paths);
-
-  _cuda_kernel->set(mangled_instantiation.c_str(), ptx.c_str(), linker_files,
-                    linker_paths);
+  std::map<std::string, std::string> cubins;
+  detail::instantiate_kernel(program.name(),
+                             detail::make_source_view(program.sources()),
+                             instantiation,
+                             _kernel._options->options, &log, &ptx,
+                             &mangled_instantiation, &linker_files,
+                             &linker_paths, &cubins);
+
+  std::shared_ptr<detail::CUDAKernel> cuda_kernel(
+      new detail::CUDAKernel(mangled_instantiation.c_str(), ptx.c_str(),
+                             linker_files, linker_paths, cubins));
+  // Weight the cache entry by its host (PTX) and device (module) footprint.
+  *weight = ptx.size() + cuda_kernel->module_size();
+  return cuda_kernel;
 }
 
 Kernel_impl::Kernel_impl(Program_impl const& program, std::string name,
                          jitify::detail::vector<std::string> options)
-    : _program(program), _name(name), _options(options) {
+    : _program(program), _name(name) {
   // Merge options from parent
-  _options.insert(_options.end(), _program.options().begin(),
-                  _program.options().end());
-  detail::detect_and_add_cuda_arch(_options);
-  detail::detect_and_add_cxx11_flag(_options);
-  std::string options_string = reflection::reflect_list(_options);
+  std::vector<std::string> merged = options;
+  merged.insert(merged.end(), _program.options().begin(),
+                _program.options().end());
+  // Note: The resolved options and their hash are cached per device.
+  _options = detail::resolve_options(merged);
   using detail::hash_combine;
   using detail::hash_larson64;
   _hash = _program._hash;
   _hash = hash_combine(_hash, hash_larson64(_name.c_str()));
-  _hash = hash_combine(_hash, hash_larson64(options_string.c_str()));
+  _hash = hash_combine(_hash, _options->hash);
 }
 
 Program_impl::Program_impl(JitCache_impl& cache, std::string source,
@@ -3605,25 +4913,25 @@ Program_impl::Program_impl(JitCache_impl& cache, std::string source,
   }
   // Merge options from parent
   options.insert(options.end(), _cache._options.begin(), _cache._options.end());
-  // Load sources
-#if JITIFY_THREAD_SAFE
-  std::lock_guard<std::mutex> lock(cache._program_cache_mutex);
-#endif
-  if (!cache._program_config_cache.contains(_hash)) {
-    _config = &cache._program_config_cache.insert(_hash);
-    this->load_sources(source, headers, options, file_callback);
-  } else {
-    _config = &cache._program_config_cache.get(_hash);
-  }
+  // Load sources (outside of the cache lock; see SharedObjectCache)
+  _config = cache._program_config_cache.get_or_build(
+      _hash, [&](size_t* weight) {
+        std::shared_ptr<ProgramConfig> config(new ProgramConfig());
+        this->load_sources(config.get(), source, headers, options,
+                           file_callback);
+        *weight = 0;
+        return config;
+      });
 }
 
-inline void Program_impl::load_sources(std::string source,
+inline void Program_impl::load_sources(ProgramConfig* config,
+                                       std::string source,
                                        std::vector<std::string> headers,
                                        std::vector<std::string> options,
                                        file_callback_type file_callback) {
-  _config->options = options;
-  detail::load_program(source, headers, file_callback, &_config->include_paths,
-                       &_config->sources, &_config->options, &_config->name);
+  config->options = options;
+  detail::load_program(source, headers, file_callback, &config->include_paths,
+                       &config->sources, &config->options, &config->name);
 }
 
 enum Location { HOST, DEVICE };
@@ -3836,7 +5144,10 @@ namespace detail {
 
 // This should be incremented whenever the serialization format changes in any
 // incompatible way.
-static constexpr const size_t kSerializationVersion = 2;
+// Version 3 appends the linked cubins to serialized kernel instantiations;
+// version 2 data (which has no cubins) can still be read.
+static constexpr const size_t kSerializationVersion = 3;
+static constexpr const size_t kMinSerializationVersion = 2;
 
 inline void serialize(std::ostream& stream, size_t u) {
   uint64_t u64 = u;
@@ -3901,6 +5212,16 @@ inline void serialize(std::ostream& stream,
   }
 }
 
+//LCG调整::源码视图按源码表的格式写入，可以反序列化为源码表，缓存键也不因头文件是否共享而改变
+inline void serialize(std::ostream& stream,
+                      jitify::detail::source_view const& m) {
+  serialize(stream, m.size());
+  for (auto const& kv : m) {
+    serialize(stream, kv.first);
+    serialize(stream, *kv.second);
+  }
+}
+
 inline bool deserialize(std::istream& stream,
                         std::map<std::string, std::string>* m) {
   size_t size;
@@ -3939,7 +5260,8 @@ inline bool deserialize_magic_number(std::istream& stream) {
   }
   size_t serialization_version;
   if (!deserialize(stream, &serialization_version)) return false;
-  return serialization_version == kSerializationVersion;
+  return serialization_version >= kMinSerializationVersion &&
+         serialization_version <= kSerializationVersion;
 }
 
 }  // namespace detail
@@ -3962,6 +5284,210 @@ inline bool deserialize(std::string const& serialized, Values*... values) {
 
 }  // namespace serialization
 
+/*! A persistent, content-addressed cache of compiled kernel instantiations.
+ *
+ *  Entries are stored as one file per instantiation in a single directory,
+ *  named by the SHA-256 of everything that affects compilation (see
+ *  make_key). Files are written to a temporary name and then renamed into
+ *  place, so concurrent processes sharing a directory never observe partial
+ *  entries. Hits refresh the file's modification time, and the
+ *  least-recently-used entries are removed whenever the directory exceeds
+ *  max_bytes.
+ */
+class KernelDiskCache {
+  std::string _dir;
+  size_t _max_bytes;
+
+  // This should be incremented whenever the entry format or key changes.
+  //LCG调整::条目中加入按架构索引的cubin，命中时不需要再JIT编译PTX
+  static constexpr const size_t kDiskCacheVersion = 2;
+
+  struct Entry {
+    std::string path;
+    size_t size;
+    time_t mtime;
+  };
+
+  std::string entry_path(std::string const& key) const {
+    return jitify::detail::path_join(_dir, key + ".jitify");
+  }
+
+  static bool read_file(std::string const& path, std::string* contents) {
+    std::ifstream file(path.c_str(), std::ios::in | std::ios::binary);
+    if (!file) return false;
+    std::stringstream ss;
+    ss << file.rdbuf();
+    *contents = ss.str();
+    return file.good() || file.eof();
+  }
+
+  static void touch_file(std::string const& path) {
+#if defined(_WIN32) || defined(_WIN64)
+    _utime(path.c_str(), nullptr);
+#else
+    utime(path.c_str(), nullptr);
+#endif
+  }
+
+  static bool replace_file(std::string const& from, std::string const& to) {
+#if defined(_WIN32) || defined(_WIN64)
+    return MoveFileExA(from.c_str(), to.c_str(), MOVEFILE_REPLACE_EXISTING) !=
+           0;
+#else
+    return std::rename(from.c_str(), to.c_str()) == 0;
+#endif
+  }
+
+  std::vector<Entry> list_entries() const {
+    std::vector<Entry> entries;
+#if defined(_WIN32) || defined(_WIN64)
+    WIN32_FIND_DATAA find_data;
+    HANDLE handle = FindFirstFileA(
+        jitify::detail::path_join(_dir, "*.jitify").c_str(), &find_data);
+    if (handle == INVALID_HANDLE_VALUE) return entries;
+    do {
+      std::string path = jitify::detail::path_join(_dir, find_data.cFileName);
+      struct _stat st;
+      if (_stat(path.c_str(), &st) == 0) {
+        entries.push_back(Entry{path, (size_t)st.st_size, st.st_mtime});
+      }
+    } while (FindNextFileA(handle, &find_data));
+    FindClose(handle);
+#else
+    DIR* dir = opendir(_dir.c_str());
+    if (!dir) return entries;
+    while (struct dirent* ent = readdir(dir)) {
+      std::string name = ent->d_name;
+      if (!jitify::detail::endswith(name, ".jitify")) continue;
+      std::string path = jitify::detail::path_join(_dir, name);
+      struct stat st;
+      if (stat(path.c_str(), &st) == 0) {
+        entries.push_back(Entry{path, (size_t)st.st_size, st.st_mtime});
+      }
+    }
+    closedir(dir);
+#endif
+    return entries;
+  }
+
+ public:
+  /*! Create a disk cache.
+   *
+   *  \param dir The directory in which to store entries. It is created if it
+   *    does not already exist.
+   *  \param max_bytes The total size of all entries above which the
+   *    least-recently-used ones are discarded (0 for no limit).
+   */
+  KernelDiskCache(std::string const& dir, size_t max_bytes = 0)
+      : _dir(dir), _max_bytes(max_bytes) {
+#if defined(_WIN32) || defined(_WIN64)
+    _mkdir(_dir.c_str());
+#else
+    mkdir(_dir.c_str(), 0755);
+#endif
+  }
+
+  std::string const& directory() const { return _dir; }
+  size_t max_bytes() const { return _max_bytes; }
+
+  /*! Compute the cache key for a kernel instantiation.
+   *
+   *  \note \p options must be the fully-merged options, including the target
+   *    architecture.
+   */
+  static std::string make_key(std::string const& program_name,
+                              jitify::detail::source_view const& sources,
+                              std::vector<std::string> const& options,
+                              std::string const& instantiation) {
+    return jitify::detail::sha256_hex(serialization::serialize(
+        size_t(kDiskCacheVersion), size_t(CUDA_VERSION), program_name, sources,
+        options,
+        instantiation));
+  }
+
+  static std::string make_key(std::string const& program_name,
+                              std::map<std::string, std::string> const& sources,
+                              std::vector<std::string> const& options,
+                              std::string const& instantiation) {
+    return make_key(program_name, jitify::detail::make_source_view(sources),
+                    options, instantiation);
+  }
+
+  /*! Look up a compiled instantiation. Returns false on a miss (including
+   *  unreadable or corrupt entries, which are removed).
+   *
+   *  \param cubins Receives the linked images stored with the entry, keyed
+   *    by architecture (e.g., "sm_75").
+   */
+  bool load(std::string const& key, std::string* func_name, std::string* ptx,
+            std::vector<std::string>* link_files,
+            std::vector<std::string>* link_paths,
+            std::map<std::string, std::string>* cubins) const {
+    std::string path = entry_path(key);
+    std::string contents;
+    if (!read_file(path, &contents)) return false;
+    if (!serialization::deserialize(contents, func_name, ptx, link_files,
+                                    link_paths, cubins)) {
+      std::remove(path.c_str());
+      return false;
+    }
+    touch_file(path);
+    return true;
+  }
+
+  /*! Store a compiled instantiation. Failures are ignored, since the cache is
+   *  only an optimization.
+   */
+  void store(std::string const& key, std::string const& func_name,
+             std::string const& ptx, std::vector<std::string> const& link_files,
+             std::vector<std::string> const& link_paths,
+             std::map<std::string, std::string> const& cubins) const {
+    std::string path = entry_path(key);
+    std::stringstream tmp_name;
+#if defined(_WIN32) || defined(_WIN64)
+    tmp_name << path << ".tmp" << _getpid();
+#else
+    tmp_name << path << ".tmp" << getpid();
+#endif
+    tmp_name << "_" << std::hex << (uintptr_t)&tmp_name;
+    std::string tmp_path = tmp_name.str();
+    {
+      std::ofstream file(tmp_path.c_str(),
+                         std::ios::out | std::ios::binary | std::ios::trunc);
+      if (!file) return;
+      std::string contents = serialization::serialize(
+          func_name, ptx, link_files, link_paths, cubins);
+      file.write(contents.data(), contents.size());
+      if (!file.good()) {
+        file.close();
+        std::remove(tmp_path.c_str());
+        return;
+      }
+    }
+    if (!replace_file(tmp_path, path)) {
+      std::remove(tmp_path.c_str());
+      return;
+    }
+    this->evict();
+  }
+
+  /*! Remove least-recently-used entries until the cache fits in max_bytes.
+   */
+  void evict() const {
+    if (!_max_bytes) return;
+    std::vector<Entry> entries = this->list_entries();
+    size_t total = 0;
+    for (Entry const& entry : entries) total += entry.size;
+    if (total <= _max_bytes) return;
+    std::sort(entries.begin(), entries.end(),
+              [](Entry const& a, Entry const& b) { return a.mtime < b.mtime; });
+    for (Entry const& entry : entries) {
+      if (total <= _max_bytes) break;
+      if (std::remove(entry.path.c_str()) == 0) total -= entry.size;
+    }
+  }
+};
+
 class Program;
 class Kernel;
 class KernelInstantiation;
@@ -3976,10 +5502,18 @@ class Program {
   std::string _name;
   std::vector<std::string> _options;
   std::map<std::string, std::string> _sources;
+  //LCG调整::与其他程序共享的头文件源码，不在_sources中重复保存，见share_sources
+  std::map<std::string, std::shared_ptr<const std::string>> _shared_sources;
+  std::shared_ptr<KernelDiskCache const> _disk_cache;
 
   // Private constructor used by deserialize()
   Program() {}
 
+  //LCG调整::全部源码的视图，包括共享的头文件
+  jitify::detail::source_view sources_view() const {
+    return jitify::detail::make_source_view(_sources, _shared_sources);
+  }
+
  public:
   /*! Create a program.
    *
@@ -4059,9 +5593,43 @@ class Program {
    */
   std::string serialize() const {
     // Note: Must update kSerializationVersion if this is changed.
-    return serialization::serialize(_name, _options, _sources);
+    return serialization::serialize(_name, _options, sources_view());
   };
 
+  //LCG调整::把与共享源码内容相同的头文件换成共享的引用，多个程序引入同一个头文件时只保存一份
+  //lookup根据头文件名称返回共享的源码，没有则返回空，内容不同（例如引入行被注释掉）的头文件仍然保存副本
+  void share_sources(
+      std::function<std::shared_ptr<const std::string>(std::string const&)> const&
+          lookup) {
+    for (auto it = _sources.begin(); it != _sources.end();) {
+      std::shared_ptr<const std::string> shared;
+      if (it->first != _name) shared = lookup(it->first);
+      if (shared && *shared == it->second) {
+        _shared_sources[it->first] = shared;
+        it = _sources.erase(it);
+      } else {
+        ++it;
+      }
+    }
+  }
+
+  //LCG调整::程序自己保存的源码字节数，不包括共享的头文件
+  size_t source_bytes() const {
+    size_t bytes = 0;
+    for (auto const& kv : _sources) bytes += kv.first.size() + kv.second.size();
+    return bytes;
+  }
+
+  /*! Persist compiled kernel instantiations of this program on disk.
+   *
+   * \param disk_cache The cache to use, or null to disable disk caching.
+   *
+   * \note Instantiations found in the cache skip NVRTC entirely.
+   */
+  void set_disk_cache(std::shared_ptr<KernelDiskCache const> disk_cache) {
+    _disk_cache = disk_cache;
+  }
+
   /*! Select a kernel.
    *
    * \param name The name of the kernel (unmangled and without
@@ -4071,6 +5639,42 @@ class Program {
    */
   Kernel kernel(std::string const& name,
                 std::vector<std::string> const& options = {}) const;
+
+  /*! Instantiate several kernels with a single NVRTC invocation.
+   *
+   * \param kernels A vector of (kernel name, template arguments) pairs.
+   * \param options A vector of options to be passed to the NVRTC
+   * compiler when compiling these kernels.
+   *
+   * \note All instantiations share one compiled module, which is unloaded
+   * once every returned instantiation has been destroyed.
+   */
+  std::vector<KernelInstantiation> instantiate_many(
+      std::vector<std::pair<std::string, std::vector<std::string> > > const&
+          kernels,
+      std::vector<std::string> const& options = {}) const;
+
+  //LCG调整::加入只编译PTX不加载模块的方法，不需要cuda上下文，用于预编译工具
+  //options中没有指定-arch时使用当前设备的架构，指定真实架构(sm_XX)时cubins中会写入编译好的cubin
+  void compile_ptx(std::string const& name,
+                   std::vector<std::string> const& template_args,
+                   std::vector<std::string> const& options,
+                   std::string* mangled_name, std::string* ptx,
+                   std::vector<std::string>* link_files,
+                   std::vector<std::string>* link_paths,
+                   std::map<std::string, std::string>* cubins = nullptr) const {
+    std::string instantiation =
+        name + (template_args.empty()
+                    ? ""
+                    : reflection::reflect_template(template_args));
+    std::vector<std::string> all_options = options;
+    all_options.insert(all_options.begin(), _options.begin(), _options.end());
+    all_options = detail::resolve_options(all_options)->options;
+    std::string log;
+    detail::instantiate_kernel(_name, sources_view(), instantiation, all_options,
+                               &log, ptx, mangled_name, link_files,
+                               link_paths, cubins);
+  }
 };
 
 class Kernel {
@@ -4130,14 +5734,40 @@ class Kernel {
 
 class KernelInstantiation {
   friend class KernelLauncher;
+  friend class Program;
   std::unique_ptr<detail::CUDAKernel> _cuda_kernel;
 
+  // Private constructor used by Program::instantiate_many()
+  explicit KernelInstantiation(detail::CUDAKernel* cuda_kernel)
+      : _cuda_kernel(cuda_kernel) {}
+
   // Private constructor used by deserialize()
   KernelInstantiation(std::string const& func_name, std::string const& ptx,
                       std::vector<std::string> const& link_files,
-                      std::vector<std::string> const& link_paths)
+                      std::vector<std::string> const& link_paths,
+                      std::map<std::string, std::string> const& cubins = {})
       : _cuda_kernel(new detail::CUDAKernel(func_name.c_str(), ptx.c_str(),
-                                            link_files, link_paths)) {}
+                                            link_files, link_paths, cubins)) {}
+
+  // Reads the fields written by serialize(), including data written before
+  // cubins were added (serialization version 2).
+  static void deserialize_fields(std::string const& serialized_kernel_inst,
+                                 std::string* func_name, std::string* ptx,
+                                 std::vector<std::string>* link_files,
+                                 std::vector<std::string>* link_paths,
+                                 std::map<std::string, std::string>* cubins) {
+    if (serialization::deserialize(serialized_kernel_inst, func_name, ptx,
+                                   link_files, link_paths, cubins)) {
+      return;
+    }
+    cubins->clear();
+    link_files->clear();
+    link_paths->clear();
+    if (!serialization::deserialize(serialized_kernel_inst, func_name, ptx,
+                                    link_files, link_paths)) {
+      throw std::runtime_error("Failed to deserialize kernel instantiation");
+    }
+  }
 
  public:
   KernelInstantiation(Kernel const& kernel,
@@ -4154,18 +5784,40 @@ class KernelInstantiation {
                    program->_options.end());
     options.insert(options.begin(), kernel._options.begin(),
                    kernel._options.end());
-    detail::detect_and_add_cuda_arch(options);
-    detail::detect_and_add_cxx11_flag(options);
+    options = detail::resolve_options(options)->options;
 
     std::string log, ptx, mangled_instantiation;
     std::vector<std::string> linker_files, linker_paths;
-    detail::instantiate_kernel(program->_name, program->_sources, instantiation,
-                               options, &log, &ptx, &mangled_instantiation,
-                               &linker_files, &linker_paths);
+    std::map<std::string, std::string> cubins;
+    std::string disk_cache_key;
+    if (program->_disk_cache) {
+      disk_cache_key = KernelDiskCache::make_key(
+          program->_name, program->sources_view(), options, instantiation);
+    }
+    bool hit = program->_disk_cache &&
+               program->_disk_cache->load(disk_cache_key, &mangled_instantiation,
+                                          &ptx, &linker_files, &linker_paths,
+                                          &cubins);
+    if (!hit) {
+      cubins.clear();
+      detail::instantiate_kernel(program->_name, program->sources_view(),
+                                 instantiation, options, &log, &ptx,
+                                 &mangled_instantiation, &linker_files,
+                                 &linker_paths, &cubins);
+    }
+    size_t cached_cubins = cubins.size();
 
     _cuda_kernel.reset(new detail::CUDAKernel(mangled_instantiation.c_str(),
                                               ptx.c_str(), linker_files,
-                                              linker_paths));
+                                              linker_paths, cubins));
+    //LCG调整::加载模块后再写入缓存，条目中包括为当前架构链接的cubin
+    //命中的条目没有当前架构的cubin时(如缓存目录在不同显卡之间共享)把新链接的cubin补充进去
+    if (program->_disk_cache &&
+        (!hit || _cuda_kernel->cubins().size() != cached_cubins)) {
+      program->_disk_cache->store(disk_cache_key, mangled_instantiation, ptx,
+                                  linker_files, linker_paths,
+                                  _cuda_kernel->cubins());
+    }
   }
 
   /*! Implicit conversion to the underlying CUfunction object.
@@ -4186,11 +5838,10 @@ class KernelInstantiation {
       std::string const& serialized_kernel_inst) {
     std::string func_name, ptx;
     std::vector<std::string> link_files, link_paths;
-    if (!serialization::deserialize(serialized_kernel_inst, &func_name, &ptx,
-                                    &link_files, &link_paths)) {
-      throw std::runtime_error("Failed to deserialize kernel instantiation");
-    }
-    return KernelInstantiation(func_name, ptx, link_files, link_paths);
+    std::map<std::string, std::string> cubins;
+    deserialize_fields(serialized_kernel_inst, &func_name, &ptx, &link_files,
+                       &link_paths, &cubins);
+    return KernelInstantiation(func_name, ptx, link_files, link_paths, cubins);
   }
 
   //LCG调整::加入一个生成反序列化指针的方法
@@ -4198,14 +5849,46 @@ class KernelInstantiation {
       std::string const& serialized_kernel_inst) {
     std::string func_name, ptx;
     std::vector<std::string> link_files, link_paths;
-    if (!serialization::deserialize(serialized_kernel_inst, &func_name, &ptx,
-                                    &link_files, &link_paths)) {
-      throw std::runtime_error("Failed to deserialize kernel instantiation");
-    }
-    return new KernelInstantiation(func_name, ptx, link_files, link_paths);
+    std::map<std::string, std::string> cubins;
+    deserialize_fields(serialized_kernel_inst, &func_name, &ptx, &link_files,
+                       &link_paths, &cubins);
+    return new KernelInstantiation(func_name, ptx, link_files, link_paths,
+                                   cubins);
+  }
+
+  //LCG调整::加入实例的内容键，和磁盘缓存的键相同(程序名、源码、合并后的选项和实例化)，用于在多次批量编译之间去重
+  static std::string cache_key(Kernel const& kernel,
+                               std::vector<std::string> const& template_args) {
+    Program const* program = kernel._program;
+    std::string instantiation =
+        kernel._name + (template_args.empty()
+                            ? ""
+                            : reflection::reflect_template(template_args));
+    std::vector<std::string> options;
+    options.insert(options.begin(), program->_options.begin(),
+                   program->_options.end());
+    options.insert(options.begin(), kernel._options.begin(),
+                   kernel._options.end());
+    options = detail::resolve_options(options)->options;
+    return KernelDiskCache::make_key(program->_name, program->sources_view(), options,
+                                     instantiation);
+  }
+
+  //LCG调整::加入从各部分数据创建实例指针的方法，用于从打包文件加载
+  static KernelInstantiation * create_ptr(
+      std::string const& func_name, std::string const& ptx,
+      std::vector<std::string> const& link_files,
+      std::vector<std::string> const& link_paths,
+      std::map<std::string, std::string> const& cubins) {
+    return new KernelInstantiation(func_name, ptx, link_files, link_paths,
+                                   cubins);
   }
 
   /*! Save the program.
+   *
+   * \note The linked cubin is saved along with the PTX, and is loaded
+   * directly (without JIT compilation) when deserializing on a device of the
+   * same architecture.
    *
    * \see deserialize
    */
@@ -4213,7 +5896,8 @@ class KernelInstantiation {
     // Note: Must update kSerializationVersion if this is changed.
     return serialization::serialize(
         _cuda_kernel->function_name(), _cuda_kernel->ptx(),
-        _cuda_kernel->link_files(), _cuda_kernel->link_paths());
+        _cuda_kernel->link_files(), _cuda_kernel->link_paths(),
+        _cuda_kernel->cubins());
   }
 
   /*! Configure the kernel launch.
@@ -4259,6 +5943,22 @@ class KernelInstantiation {
     _cuda_kernel->set_func_attribute(attribute, value);
   }
 
+  /*! Get the parameter signature of the kernel, parsed from the .entry
+   *  directive in its PTX.
+   *
+   * \note Throws if the signature cannot be parsed.
+   */
+  std::vector<detail::PtxParam> get_param_layout() const {
+    std::vector<detail::PtxParam> params;
+    if (!detail::parse_ptx_entry_params(_cuda_kernel->ptx(),
+                                        _cuda_kernel->function_name(),
+                                        &params)) {
+      throw std::runtime_error("Failed to parse parameters of kernel " +
+                               _cuda_kernel->function_name());
+    }
+    return params;
+  }
+
   /*
    * \deprecated Use \p get_global_ptr instead.
    */
@@ -4328,6 +6028,11 @@ class KernelInstantiation {
   const std::vector<std::string>& link_paths() const {
     return _cuda_kernel->link_paths();
   }
+
+  //LCG调整::加入获取链接后cubin的方法，用于写入打包文件
+  const std::map<std::string, std::string>& cubins() const {
+    return _cuda_kernel->cubins();
+  }
 };
 
 class KernelLauncher {
@@ -4384,6 +6089,31 @@ class KernelLauncher {
                                             arg_ptrs);
   }
 
+  /*! Launch the kernel with a pre-packed argument array.
+   *
+   *  \param arg_ptrs An array of pointers to each function argument for the
+   *    kernel, passed straight through to cuLaunchKernel.
+   *
+   *  \note Unlike launch(), this makes no copies and performs no heap
+   *    allocations, so the array may be reused across launches.
+   */
+  CUresult launch_raw(void** arg_ptrs) const {
+#if JITIFY_PRINT_LAUNCH
+    pre_launch();
+#endif
+    return _kernel_inst->_cuda_kernel->launch_raw(_grid, _block, _smem, _stream,
+                                                  arg_ptrs);
+  }
+
+  /*! Launch the kernel with a pre-packed argument array, overriding the
+   *    configured grid, block and stream for this launch only.
+   */
+  CUresult launch_raw(dim3 const& grid, dim3 const& block, cudaStream_t stream,
+                      void** arg_ptrs) const {
+    return _kernel_inst->_cuda_kernel->launch_raw(grid, block, _smem, stream,
+                                                  arg_ptrs);
+  }
+
   /*! Launch the kernel.
    *
    *  \param args Function arguments for the kernel.
@@ -4410,6 +6140,78 @@ inline Kernel Program::kernel(std::string const& name,
   return Kernel(this, name, options);
 }
 
+inline std::vector<KernelInstantiation> Program::instantiate_many(
+    std::vector<std::pair<std::string, std::vector<std::string> > > const&
+        kernels,
+    std::vector<std::string> const& given_options) const {
+  std::vector<std::string> instantiations;
+  for (auto const& kernel : kernels) {
+    instantiations.push_back(
+        kernel.first + (kernel.second.empty()
+                            ? ""
+                            : reflection::reflect_template(kernel.second)));
+  }
+
+  std::vector<std::string> options;
+  options.insert(options.begin(), _options.begin(), _options.end());
+  options.insert(options.begin(), given_options.begin(), given_options.end());
+  options = detail::resolve_options(options)->options;
+
+  std::string log, ptx;
+  std::vector<std::string> mangled_instantiations;
+  std::vector<std::string> linker_files, linker_paths;
+  // The disk cache stores a single function name per entry, so the batch is
+  // keyed (and its lowered names stored) as newline-separated lists.
+  std::string disk_cache_key, mangled_names;
+  if (_disk_cache) {
+    std::string joined;
+    for (std::string const& instantiation : instantiations) {
+      joined += instantiation + "\n";
+    }
+    disk_cache_key =
+        KernelDiskCache::make_key(_name, sources_view(), options, joined);
+  }
+  std::map<std::string, std::string> cubins;
+  if (_disk_cache && _disk_cache->load(disk_cache_key, &mangled_names, &ptx,
+                                       &linker_files, &linker_paths, &cubins)) {
+    std::istringstream names(mangled_names);
+    std::string name;
+    while (std::getline(names, name)) mangled_instantiations.push_back(name);
+  }
+  bool hit = mangled_instantiations.size() == instantiations.size();
+  if (!hit) {
+    mangled_instantiations.clear();
+    linker_files.clear();
+    linker_paths.clear();
+    cubins.clear();
+    detail::instantiate_kernels(_name, sources_view(), instantiations, options, &log,
+                                &ptx, &mangled_instantiations, &linker_files,
+                                &linker_paths);
+  }
+  size_t cached_cubins = cubins.size();
+
+  // Load the module once (with no function) and look up every lowered name
+  // in it.
+  //LCG调整::命中时使用缓存中的cubin加载，加载后把新链接的cubin写入缓存
+  std::shared_ptr<detail::CUDAKernel const> module(new detail::CUDAKernel(
+      "", ptx.c_str(), linker_files, linker_paths, cubins));
+  if (_disk_cache && (!hit || module->cubins().size() != cached_cubins)) {
+    mangled_names.clear();
+    for (std::string const& name : mangled_instantiations) {
+      mangled_names += name + "\n";
+    }
+    _disk_cache->store(disk_cache_key, mangled_names, ptx, linker_files,
+                       linker_paths, module->cubins());
+  }
+  std::vector<KernelInstantiation> results;
+  results.reserve(mangled_instantiations.size());
+  for (std::string const& name : mangled_instantiations) {
+    results.push_back(
+        KernelInstantiation(new detail::CUDAKernel(module, name.c_str())));
+  }
+  return results;
+}
+
 inline KernelInstantiation Kernel::instantiate(
     std::vector<std::string> const& template_args) const {
   return KernelInstantiation(*this, template_args);
@@ -0,0 +1,265 @@
+//Ԥ빤
+//ڹʱ嵥ģɴļлʵʱֱӼأҪٵNVRTC
+//ҪԿcudaģCUDA 11.1ͬʱÿܹcubinʱҪٱPTX
+//͵İ汾ֻPTXʱPTXΪǰ豸Ĵ
+//
+//÷nvrtc_precompile <嵥ļ> [-o ·] [-j ߳] [--serialized]
+//  -o            Ĵļʹ--serializedʱΪĿ¼Ĭʹ嵥еoutput
+//  -j            б߳ĬΪCPU
+//  --serialized  ÿʵһлļ(deserializeInstance)Ǵļ
+//
+//嵥ļÿһָ#ͷΪעͣ·ڵǰĿ¼
+//  output kernels.bundle        ·
+//  arch sm_61 sm_75             ĿܹÿʵΪÿܹһΣûָʱʹõǰ豸ļܹ
+//  program kernels/math.cu      ʼһ֮optionkernel
+//  header kernels/common.h      ͷļ
+//  option -I kernels/include    ıѡһһ
+//  kernel reduce float; 256     Ҫʵĺģ֮Ϊ;ָģ
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include "jitify.hpp"
+#include "cuda_bundle.hpp"
+#include "cuda_compile_pool.hpp"
+
+//嵥еһ
+struct ManifestProgram {
+  std::string source;
+  std::vector<std::string> headers;
+  std::vector<std::string> options;
+  //ƺģ
+  std::vector<std::pair<std::string,std::vector<std::string> > > kernels;
+};
+
+//嵥
+struct Manifest {
+  std::string output;
+  std::vector<std::string> archs;
+  std::vector<ManifestProgram> programs;
+};
+
+static std::string trim(const std::string & value){
+  size_t start = value.find_first_not_of(" \t\r\n");
+  if(start == std::string::npos) {return "";}
+  size_t end = value.find_last_not_of(" \t\r\n");
+  return value.substr(start,end - start + 1);
+}
+
+//ȡ嵥ʽʱ׳쳣
+static Manifest readManifest(const std::string & path){
+  std::ifstream file(path.c_str());
+  if(!file) {throw std::runtime_error("޷嵥ļ:" + path);}
+  Manifest manifest;
+  std::string line;
+  int lineNumber = 0;
+  while(std::getline(file,line)){
+    lineNumber++;
+    line = trim(line);
+    if(line.empty() || line[0] == '#') {continue;}
+    size_t space = line.find_first_of(" \t");
+    std::string command = line.substr(0,space);
+    std::string value = space == std::string::npos ? "" : trim(line.substr(space));
+    std::string where = path + ":" + std::to_string(lineNumber);
+    if(value.empty()) {throw std::runtime_error(where + " ȱٲ");}
+    if(command == "output"){
+      manifest.output = value;
+    }else if(command == "arch"){
+      std::istringstream archs(value);
+      std::string arch;
+      while(archs >> arch) {manifest.archs.push_back(arch.find('_') == std::string::npos ? "sm_" + arch : arch);}
+    }else if(command == "program"){
+      manifest.programs.push_back(ManifestProgram());
+      manifest.programs.back().source = value;
+    }else if(manifest.programs.empty()){
+      throw std::runtime_error(where + " " + command + "Ҫprogram֮");
+    }else if(command == "header"){
+      manifest.programs.back().headers.push_back(value);
+    }else if(command == "option"){
+      manifest.programs.back().options.push_back(value);
+    }else if(command == "kernel"){
+      space = value.find_first_of(" \t");
+      std::string name = value.substr(0,space);
+      std::vector<std::string> templates;
+      if(space != std::string::npos){
+        std::string list = value.substr(space);
+        size_t start = 0,end;
+        do{
+          end = list.find(';',start);
+          std::string temp = trim(list.substr(start,end == std::string::npos ? std::string::npos : end - start));
+          if(!temp.empty()) {templates.push_back(temp);}
+          start = end + 1;
+        }while(end != std::string::npos);
+      }
+      manifest.programs.back().kernels.push_back(std::make_pair(name,templates));
+    }else{
+      throw std::runtime_error(where + " δָ֪:" + command);
+    }
+  }
+  return manifest;
+}
+
+//һÿʵÿܹһ
+struct CompileTask {
+  const ManifestProgram * program;
+  std::shared_ptr<jitify::experimental::Program> compiled;
+  size_t kernel;
+  std::string arch;
+  bundle::Entry entry;
+  std::string error;
+};
+
+//ʵʾƣ reduce<float,256>
+static std::string instanceName(const bundle::Entry & entry){
+  std::string re = entry.name + "<";
+  for(size_t i = 0;i < entry.templates.size();i++) {re += (i ? "," : "") + entry.templates[i];}
+  return re + ">";
+}
+
+static void printUsage(){
+  printf("÷: nvrtc_precompile <嵥ļ> [-o ·] [-j ߳] [--serialized]\n");
+}
+
+int main(int argc,char ** argv){
+  std::string manifestPath,output;
+  size_t threads = 0;
+  bool serialized = false;
+  for(int i = 1;i < argc;i++){
+    std::string arg = argv[i];
+    if(arg == "-o" && i + 1 < argc){
+      output = argv[++i];
+    }else if(arg == "-j" && i + 1 < argc){
+      threads = (size_t)atoi(argv[++i]);
+    }else if(arg == "--serialized"){
+      serialized = true;
+    }else if(arg[0] != '-' && manifestPath.empty()){
+      manifestPath = arg;
+    }else{
+      printUsage();
+      return 2;
+    }
+  }
+  if(manifestPath.empty()){
+    printUsage();
+    return 2;
+  }
+
+  Manifest manifest;
+  try{
+    manifest = readManifest(manifestPath);
+  }catch(std::runtime_error & e){
+    fprintf(stderr,"%s\n",e.what());
+    return 2;
+  }
+  if(output.empty()) {output = manifest.output;}
+  if(output.empty()){
+    fprintf(stderr,"ûָ·\n");
+    return 2;
+  }
+  //ûָܹʱjitify⵱ǰ豸
+  if(manifest.archs.empty()) {manifest.archs.push_back("");}
+
+  auto time = std::chrono::steady_clock::now();
+
+  //سͷļĲһ
+  std::vector<CompileTask> tasks;
+  for(auto & program : manifest.programs){
+    std::shared_ptr<jitify::experimental::Program> compiled;
+    try{
+      compiled = std::make_shared<jitify::experimental::Program>(program.source,program.headers,program.options);
+    }catch(std::runtime_error & e){
+      fprintf(stderr,"%s: %s\n",program.source.c_str(),e.what());
+      return 1;
+    }
+    for(size_t i = 0;i < program.kernels.size();i++){
+      for(auto & arch : manifest.archs){
+        CompileTask task;
+        task.program = &program;
+        task.compiled = compiled;
+        task.kernel = i;
+        task.arch = arch;
+        tasks.push_back(task);
+      }
+    }
+  }
+
+  //ڱ̳߳вб
+  CompilePool pool(threads);
+  std::mutex mutex;
+  std::condition_variable cv;
+  size_t done = 0;
+  for(auto & item : tasks){
+    CompileTask * task = &item;
+    pool.submit([task,&mutex,&cv,&done]{
+      const std::pair<std::string,std::vector<std::string> > & kernel = task->program->kernels[task->kernel];
+      std::vector<std::string> options;
+      std::string number = task->arch.substr(task->arch.find('_') + 1);
+#if CUDA_VERSION >= 11010
+      if(!task->arch.empty()) {options.push_back("-arch=sm_" + number);}
+#else
+      if(!task->arch.empty()) {options.push_back("-arch=compute_" + number);}
+#endif
+      bundle::Entry & entry = task->entry;
+      entry.name = kernel.first;
+      entry.templates = kernel.second;
+      entry.arch = task->arch;
+      try{
+        std::map<std::string,std::string> cubins;
+        task->compiled->compile_ptx(kernel.first,kernel.second,options,&entry.func_name,&entry.ptx,&entry.link_files,&entry.link_paths,&cubins);
+        if(!cubins.empty()) {entry.cubin = cubins.begin()->second;}
+      }catch(std::runtime_error & e){
+        task->error = e.what();
+      }
+      std::lock_guard<std::mutex> lock(mutex);
+      done++;
+      cv.notify_one();
+    });
+  }
+  {
+    std::unique_lock<std::mutex> lock(mutex);
+    cv.wait(lock,[&]{return done == tasks.size();});
+  }
+
+  //
+  int failed = 0;
+  for(auto & task : tasks){
+    if(task.error.empty()) {continue;}
+    failed++;
+    fprintf(stderr,"%s %s %s: %s\n",task.program->source.c_str(),instanceName(task.entry).c_str(),task.arch.c_str(),task.error.c_str());
+  }
+  if(failed){
+    fprintf(stderr,"%dʵʧ\n",failed);
+    return 1;
+  }
+
+  //д
+  try{
+    if(serialized){
+      //ļΪ ..ܹ.jitifyΪʵ嵥е˳
+      for(size_t i = 0;i < tasks.size();i++){
+        bundle::Entry & entry = tasks[i].entry;
+        std::string name = output + "/" + entry.name + "." + std::to_string(i / manifest.archs.size()) + (entry.arch.empty() ? "" : "." + entry.arch) + ".jitify";
+        std::map<std::string,std::string> cubins;
+        if(!entry.cubin.empty()) {cubins["sm_" + entry.arch.substr(entry.arch.find('_') + 1)] = entry.cubin;}
+        std::string data = jitify::experimental::serialization::serialize(entry.func_name,entry.ptx,entry.link_files,entry.link_paths,cubins);
+        std::ofstream file(name.c_str(),std::ios::out | std::ios::binary | std::ios::trunc);
+        file.write(data.data(),data.size());
+        if(!file.good()) {throw std::runtime_error("дļʧ:" + name);}
+        printf("%s %s\n",name.c_str(),instanceName(entry).c_str());
+      }
+    }else{
+      bundle::Writer writer;
+      for(auto & task : tasks) {writer.add(task.entry);}
+      writer.write(output);
+    }
+  }catch(std::runtime_error & e){
+    fprintf(stderr,"%s\n",e.what());
+    return 1;
+  }
+
+  double ms = std::chrono::duration<double,std::milli>(std::chrono::steady_clock::now() - time).count();
+  printf("%zuʵʱ%.0fms%s\n",tasks.size(),ms,output.c_str());
+  return 0;
+}